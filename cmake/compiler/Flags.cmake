@@ -104,6 +104,24 @@ else()
 	)
 endif()
 
+# Per-call-site kernel heap accounting, see memory/heap_profile.hpp.
+if(${PROJECT_NAME}_HEAP_PROFILE)
+	list(
+		APPEND
+		${PROJECT_NAME}_CX_DEFINES
+		"-DHEAP_PROFILE=1"
+	)
+endif()
+
+# Memory subsystem benchmarks logged during boot, see memory/boot_bench.hpp.
+if(${PROJECT_NAME}_BOOT_BENCH)
+	list(
+		APPEND
+		${PROJECT_NAME}_CX_DEFINES
+		"-DBOOT_BENCH=1"
+	)
+endif()
+
 if(${PROJECT_NAME}_ARCHITECTURE STREQUAL "x86_64")
 	list(
 		APPEND
@@ -126,6 +144,23 @@ if(${PROJECT_NAME}_ARCHITECTURE STREQUAL "x86_64")
 		"-DUSTACK_SIZE=0x4000"
 		"-DCACHE_LINE_SIZE=64"
 	)
+
+	# Huge frames the PMM reserves at boot for 2MB/1GB mappings.
+	if(${PROJECT_NAME}_HUGE_POOL_2M)
+		list(
+			APPEND
+			${PROJECT_NAME}_CX_DEFINES
+			"-DHUGE_POOL_2M=${${PROJECT_NAME}_HUGE_POOL_2M}"
+		)
+	endif()
+
+	if(${PROJECT_NAME}_HUGE_POOL_1G)
+		list(
+			APPEND
+			${PROJECT_NAME}_CX_DEFINES
+			"-DHUGE_POOL_1G=${${PROJECT_NAME}_HUGE_POOL_1G}"
+		)
+	endif()
 else()
 	message(FATAL_ERROR "Unsupported ${PROJECT_NAME} Architecture: '${${PROJECT_NAME}_ARCHITECTURE}'")
 endif()
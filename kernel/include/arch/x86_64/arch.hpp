@@ -5,6 +5,11 @@
 namespace kernel::arch {
 [[noreturn]] void halt(bool interrupts);
 void pause();
+// Sleep until the next interrupt (single `hlt`, unlike `halt`).
+void wait_for_interrupt();
+
+// Zero a 4K page with non-temporal stores so it doesn't evict the cache.
+void zero_page_nt(void* page);
 
 void disable_interrupts();
 void enable_interrupts();
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace kernel::cpu::arch {
+/// Scans over bitmaps stored as arrays of 64-bit words. Large ranges use
+/// AVX2/AVX-512 kernels (picked at runtime) that skip uniform words 4-8 at a
+/// time; short ones and CPUs without AVX2 use plain `ctz` loops. Bit indices
+/// follow the PMM convention: bit `i` lives in word `i / 64`, bit `i % 64`.
+class BitScan {
+   public:
+    /// Pick the widest kernels the CPU supports. Enables the AVX state
+    /// early, so it can run before the per-CPU setup does it.
+    static void init();
+
+    /// First clear bit in [start, end), or `end` if there is none.
+    static size_t find_first_zero(const uint64_t* words, size_t start, size_t end);
+
+    /// First set bit in [start, end), or `end` if there is none.
+    static size_t find_first_set(const uint64_t* words, size_t start, size_t end);
+
+    /// Number of set bits in the first `count` words.
+    static size_t popcount(const uint64_t* words, size_t count);
+
+    /// Write one summary bit per word (set when the word is all ones) for the
+    /// first `count` words and return their popcount, in a single pass.
+    static size_t summarize(const uint64_t* words, size_t count, uint64_t* summary);
+
+   private:
+    // Index of the first word in [start, end) that differs from `skip`.
+    static size_t find_word(const uint64_t* words, size_t start, size_t end, uint64_t skip);
+};
+}  // namespace kernel::cpu::arch
\ No newline at end of file
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <cstddef>
 #include "cpu/gdt.hpp"
 
 namespace kernel::cpu::arch {
 struct alignas(CACHE_LINE_SIZE) CpuData {
     GDTManager* gdt;
 
-    CpuData() : gdt(new GDTManager) {}
+    std::byte* simd_area;  // Holds the interrupted SIMD state during `SIMD::kernel_begin`
+    bool simd_busy;        // Kernel code currently owns the vector registers
+
+    CpuData() : gdt(new GDTManager), simd_area(nullptr), simd_busy(false) {}
 };
 }  // namespace kernel::cpu::arch
\ No newline at end of file
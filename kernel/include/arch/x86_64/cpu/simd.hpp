@@ -18,6 +18,18 @@ class SIMD {
     static void save(void* buffer);
     static void restore(void* buffer);
 
+    /// Claim the vector registers for kernel code. Whatever state is live
+    /// (usually the current thread's) is saved to a per-CPU area, and
+    /// preemption stays off until `kernel_end`. Returns false when AVX is
+    /// unavailable or the registers are already claimed on this core; the
+    /// caller must then stay on its scalar path.
+    static bool kernel_begin();
+    static void kernel_end();
+
+    static FpuMode get_mode() {
+        return mode;
+    }
+
     static uint32_t get_save_size() {
         if (save_size == 0) {
             SIMD::init();
@@ -30,6 +30,8 @@ class Lapic {
     }
 
     static uint64_t get_ticks_ns();
+    // Length of a TSC interval in nanoseconds, 0 before calibration.
+    static uint64_t tsc_to_ns(uint64_t tsc);
 
     static const uint32_t get_ticks_ms() {
         return ticks_per_ms;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace kernel::memory {
@@ -22,6 +23,9 @@ constexpr uint64_t page_mask = 0x000FFFFFFFFFF000ULL;
 
 class TLB {
    public:
+    // Past this many pages a whole-context flush is cheaper than `invlpg`s
+    static constexpr size_t FLUSH_CEILING = 33;
+
     static bool has_invpcid;
 
     static void flush(uintptr_t virt_addr);
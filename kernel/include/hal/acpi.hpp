@@ -10,6 +10,7 @@ class ACPI {
 
    private:
     static void parse_tables();
+    static void parse_numa();
 
     static acpi_fadt* fadt;
     static uint8_t* early_tbl_buff;
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace kernel::hal {
+constexpr size_t MAX_NUMA_NODES  = 16;
+constexpr size_t MAX_NUMA_RANGES = 64;
+constexpr size_t MAX_NUMA_CPUS   = 1024;
+
+// SLIT convention: 10 is the distance of a node to itself.
+constexpr uint8_t NUMA_LOCAL_DISTANCE  = 10;
+constexpr uint8_t NUMA_REMOTE_DISTANCE = 20;
+
+/// Physical memory range owned by a single node (from SRAT).
+struct NumaMemoryRange {
+    uintptr_t base;
+    size_t length;
+    uint32_t node;
+};
+
+/// System memory topology. ACPI proximity domains are remapped to dense node
+/// ids in discovery order; without SRAT everything belongs to node 0.
+class Numa {
+   public:
+    // Populated by the ACPI table parser.
+    static void add_memory(uint32_t domain, uintptr_t base, size_t length);
+    static void add_cpu(uint32_t apic_id, uint32_t domain);
+    static void set_distance(uint32_t from_domain, uint32_t to_domain, uint8_t distance);
+
+    /// Sort the memory ranges and build per-node fallback orders.
+    static void finalize();
+
+    static size_t node_count();
+    static uint32_t node_of_cpu(uint32_t apic_id);
+    static uint32_t node_of_addr(uintptr_t phys_addr);
+    static uint8_t distance(uint32_t from, uint32_t to);
+
+    /// All nodes ordered by distance from `node`, nearest (itself) first.
+    static const uint32_t* fallback_order(uint32_t node);
+
+    static size_t memory_range_count();
+    static const NumaMemoryRange& memory_range(size_t idx);
+
+   private:
+    static uint32_t node_of_domain(uint32_t domain, bool create);
+};
+}  // namespace kernel::hal
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <atomic>
 #include "cpu/cpu.hpp"
+#include "libs/cpu_mask.hpp"
 #include "libs/spinlock.hpp"
 #include "libs/vector.hpp"
 #include "task/process.hpp"
@@ -32,6 +33,18 @@ struct alignas(CACHE_LINE_SIZE) PerCpuData {
 
     arch::CpuData arch;
 
+    // Appended after everything entry.S addresses by fixed %gs offsets.
+    uint32_t preempt_count;  // Non-zero while the current thread must not be switched out
+
+    // Process whose address space is loaded in CR3, nullptr for the boot
+    // map. Kernel threads only touch the kernel half, so they run on
+    // whatever is loaded (lazy TLB); the core stays in that map's
+    // `active_cpus` meanwhile, which keeps its shootdowns coming here.
+    task::Process* active_proc;
+
+    // Running shrinkers; an allocation they make must not reclaim again
+    bool in_reclaim;
+
     PerCpuData(uint32_t idx, limine_mp_info* info);
     void init(void* bsp_stack_top = nullptr);
     void commit();
@@ -40,6 +53,41 @@ struct alignas(CACHE_LINE_SIZE) PerCpuData {
     void arch_init();
 };
 
+// Set once the BSP has loaded GS_BASE; APs load theirs before touching any
+// shared state, so %gs-relative accessors are usable everywhere after this.
+extern bool percpu_available;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+constexpr size_t PERCPU_CORE_IDX      = offsetof(PerCpuData, core_idx);
+constexpr size_t PERCPU_PREEMPT_COUNT = offsetof(PerCpuData, preempt_count);
+#pragma GCC diagnostic pop
+
+/// Index of the executing core. Only stable while preemption is disabled.
+inline uint32_t current_core_idx() {
+    uint32_t idx;
+    asm volatile("movl %%gs:%c1, %0" : "=r"(idx) : "i"(PERCPU_CORE_IDX));
+    return idx;
+}
+
+/// Keep the current thread on this core until the matching `preempt_enable`.
+/// A single %gs-relative increment, so interrupts stay enabled throughout.
+inline void preempt_disable() {
+    asm volatile("incl %%gs:%c0" ::"i"(PERCPU_PREEMPT_COUNT) : "memory");
+}
+
+void preempt_resched();
+
+inline void preempt_enable() {
+    bool zero;
+    asm volatile("decl %%gs:%c1" : "=@ccz"(zero) : "i"(PERCPU_PREEMPT_COUNT) : "memory");
+
+    if (zero) {
+        // A tick that landed inside the critical section only left a note.
+        preempt_resched();
+    }
+}
+
 class CpuCoreManager {
    public:
     static CpuCoreManager& get();
@@ -52,9 +100,17 @@ class CpuCoreManager {
     size_t get_total_cores() const;
     void send_ipi(uint32_t dest, uint8_t vector);
 
+    // Flush `count` pages from `start` on each online core of `targets`,
+    // this one included, and wait for all of them. Shootdowns from different
+    // cores run concurrently.
+    static void tlb_shootdown(const CpuMask& targets, uintptr_t start, size_t count);
     static void tlb_shootdown(uintptr_t virt_addr);
     static void tlb_shootdown(uintptr_t start, size_t count);
+    // Drop every non-global translation, in all address spaces, on all cores.
+    static void tlb_shootdown_all();
     static void call_on_core(uint32_t core_idx, void (*func)(void*), void* arg);
+    // Run `func` in interrupt context on every other core and wait for all of them.
+    static void call_on_others(void (*func)(void*), void* arg);
     static void stop_other_cores();
 
     void allow_io_port(uint16_t port, bool enable) {
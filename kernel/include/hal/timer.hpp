@@ -63,6 +63,11 @@ class Timer : public cpu::IInterruptHandler {
 
     static size_t get_ticks_ns();
 
+    // Raw cycle counter. Unlike `get_ticks_ns` it runs before any time source
+    // is calibrated; `cycles_to_ns` converts an interval once one is (0 until then).
+    static size_t get_cycles();
+    static size_t cycles_to_ns(size_t cycles);
+
     static void udelay(uint32_t us);
     static void mdelay(uint32_t ms);
 
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace kernel {
+// A set of cores by index. Every operation is a single atomic access, so
+// cores may add and remove themselves while others read the set.
+class CpuMask {
+   public:
+    static constexpr size_t MAX_CPUS = 256;
+
+    void set(uint32_t cpu) {
+        this->words[cpu / 64].fetch_or(bit(cpu), std::memory_order_seq_cst);
+    }
+
+    void clear(uint32_t cpu) {
+        this->words[cpu / 64].fetch_and(~bit(cpu), std::memory_order_seq_cst);
+    }
+
+    bool test(uint32_t cpu) const {
+        return (this->words[cpu / 64].load(std::memory_order_seq_cst) & bit(cpu)) != 0;
+    }
+
+    bool test_and_clear(uint32_t cpu) {
+        return (this->words[cpu / 64].fetch_and(~bit(cpu), std::memory_order_seq_cst) &
+                bit(cpu)) != 0;
+    }
+
+    // Add every core of `other`
+    void merge(const CpuMask& other) {
+        for (size_t i = 0; i < WORDS; ++i) {
+            uint64_t bits = other.words[i].load(std::memory_order_seq_cst);
+
+            if (bits) {
+                this->words[i].fetch_or(bits, std::memory_order_seq_cst);
+            }
+        }
+    }
+
+    void fill(size_t count) {
+        for (uint32_t cpu = 0; cpu < count; ++cpu) {
+            this->set(cpu);
+        }
+    }
+
+    // Call `func(cpu)` for every core in the set at the time of the call
+    template <typename F>
+    void for_each(F&& func) const {
+        for (size_t i = 0; i < WORDS; ++i) {
+            uint64_t bits = this->words[i].load(std::memory_order_seq_cst);
+
+            while (bits) {
+                uint32_t cpu = static_cast<uint32_t>((i * 64) + __builtin_ctzll(bits));
+                bits &= bits - 1;
+                func(cpu);
+            }
+        }
+    }
+
+   private:
+    static constexpr size_t WORDS = MAX_CPUS / 64;
+
+    static constexpr uint64_t bit(uint32_t cpu) {
+        return 1ull << (cpu % 64);
+    }
+
+    std::atomic<uint64_t> words[WORDS] = {};
+};
+}  // namespace kernel
\ No newline at end of file
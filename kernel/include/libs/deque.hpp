@@ -5,6 +5,7 @@
 #include <type_traits>
 #include <utility>
 #include "libs/log.hpp"
+#include "memory/heap.hpp"
 
 namespace kernel {
 const size_t BLOCK_SIZE = 8;
@@ -182,7 +183,7 @@ class Deque {
             if (this->map[i]) delete[] this->map[i];
         }
 
-        delete[] this->map;
+        memory::kfree(this->map);
     }
 
     Deque(const Deque& other) {
@@ -240,7 +241,7 @@ class Deque {
             if (this->map[i]) delete[] this->map[i];
         }
 
-        delete[] this->map;
+        memory::kfree(this->map);
 
         this->map           = other.map;
         this->map_capacity  = other.map_capacity;
@@ -479,7 +480,7 @@ class Deque {
 
         if (used_blocks < this->map_capacity / 4 && this->map_capacity > 8) {
             size_t new_capacity = std::max(8ul, used_blocks * 2);
-            T** new_map         = new T*[new_capacity];
+            T** new_map = static_cast<T**>(memory::kmalloc(new_capacity * sizeof(T*)));
             memset(new_map, 0, new_capacity * sizeof(T*));
 
             size_t new_start_block = (new_capacity - used_blocks) / 2;
@@ -487,7 +488,7 @@ class Deque {
             memcpy(new_map + new_start_block, this->map + this->start_block,
                    used_blocks * sizeof(T*));
 
-            delete[] this->map;
+            memory::kfree(this->map);
 
             this->map          = new_map;
             this->start_block  = new_start_block;
@@ -498,7 +499,7 @@ class Deque {
 
    private:
     void allocate_map(size_t capacity) {
-        this->map = new T*[capacity];
+        this->map = static_cast<T**>(memory::kmalloc(capacity * sizeof(T*)));
         memset(this->map, 0, capacity * sizeof(T*));
         this->map_capacity = capacity;
     }
@@ -513,15 +514,22 @@ class Deque {
         size_t old_num_blocks = this->end_block - this->start_block + 1;
         size_t new_capacity   = std::max(8ul, this->map_capacity * 2);
 
-        T** new_map = new T*[new_capacity];
-        memset(new_map, 0, new_capacity * sizeof(T*));
+        // The map only holds block pointers, so it can grow in place and
+        // then slide the used blocks to the middle.
+        T** new_map = static_cast<T**>(memory::krealloc(this->map, new_capacity * sizeof(T*)));
+
+        if (!new_map) {
+            PANIC("Deque: out of memory growing the block map");
+        }
 
         size_t new_start_block = (new_capacity - old_num_blocks) / 2;
 
-        memcpy(new_map + new_start_block, this->map + this->start_block,
-               old_num_blocks * sizeof(T*));
+        memmove(new_map + new_start_block, new_map + this->start_block,
+                old_num_blocks * sizeof(T*));
+        memset(new_map, 0, new_start_block * sizeof(T*));
+        memset(new_map + new_start_block + old_num_blocks, 0,
+               (new_capacity - new_start_block - old_num_blocks) * sizeof(T*));
 
-        delete[] this->map;
         this->map          = new_map;
         this->start_block  = new_start_block;
         this->end_block    = new_start_block + old_num_blocks - 1;
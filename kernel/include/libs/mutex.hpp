@@ -4,6 +4,7 @@
 #include <cstdint>
 
 #include "libs/spinlock.hpp"
+#include "memory/kmem_cache.hpp"
 
 namespace kernel::task {
 struct Thread;
@@ -29,9 +30,14 @@ class Mutex {
 
     std::atomic<int32_t> state{0};
 
-    struct WaitNode {
+    // Nodes come and go with every contended lock; keep them in a kmem cache
+    struct WaitNode : memory::KmemCached<WaitNode> {
+        static constexpr const char* kmem_cache_name = "mutex_wait_node";
+
         task::Thread* thread;
         WaitNode* next;
+
+        WaitNode(task::Thread* thread) : thread(thread), next(nullptr) {}
     };
 
     WaitNode* wait_head = nullptr;
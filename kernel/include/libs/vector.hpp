@@ -8,6 +8,7 @@
 #include <iterator>
 
 #include "libs/log.hpp"
+#include "memory/heap.hpp"
 
 #define likely(x)   __builtin_expect(!!(x), 1)
 #define unlikely(x) __builtin_expect(!!(x), 0)
@@ -56,6 +57,23 @@ class Vector {
         return ptr;
     }
 
+    // Storage from `allocate_internal` resized to `count`, in place if the
+    // heap can. Only for relocatable types: the bytes may just move.
+    pointer reallocate_internal(pointer ptr, size_type count) {
+        if (unlikely(count > size_type(-1) / sizeof(T))) {
+            LOG_ERROR("Allocation size overflow");
+            return nullptr;
+        }
+
+        pointer new_ptr = static_cast<pointer>(memory::krealloc(ptr, count * sizeof(T)));
+
+        if (unlikely(!new_ptr)) {
+            LOG_ERROR("Memory allocation failed (OOM)");
+        }
+
+        return new_ptr;
+    }
+
     void deallocate_internal(pointer ptr) {
         if (ptr) {
             ::operator delete(ptr);
@@ -84,6 +102,21 @@ class Vector {
     }
 
     bool realloc_insert(size_type new_cap) {
+        if constexpr (UseMemOps<T>) {
+            size_type current_size = this->size();
+            pointer new_start      = this->reallocate_internal(this->start, new_cap);
+
+            if (!new_start) {
+                return false;
+            }
+
+            this->start          = new_start;
+            this->finish         = new_start + current_size;
+            this->end_of_storage = new_start + new_cap;
+
+            return true;
+        }
+
         pointer __restrict new_start = this->allocate_internal(new_cap);
 
         if (!new_start) {
@@ -93,22 +126,13 @@ class Vector {
         pointer __restrict new_finish = new_start;
         pointer __restrict old_start  = this->start;
 
-        if constexpr (UseMemOps<T>) {
-            size_type current_size = this->size();
-
-            if (current_size > 0) {
-                memcpy(new_start, old_start, current_size * sizeof(T));
-                new_finish += current_size;
-            }
-        } else {
-            for (pointer cur = old_start; cur != this->finish; ++cur) {
-                new (new_finish) T(std::move(*cur));
-                ++new_finish;
-            }
+        for (pointer cur = old_start; cur != this->finish; ++cur) {
+            new (new_finish) T(std::move(*cur));
+            ++new_finish;
+        }
 
-            for (pointer cur = old_start; cur != this->finish; ++cur) {
-                cur->~T();
-            }
+        for (pointer cur = old_start; cur != this->finish; ++cur) {
+            cur->~T();
         }
 
         this->deallocate_internal(old_start);
@@ -122,6 +146,20 @@ class Vector {
     template <typename... Args>
     void emplace_back_slow(Args&&... args) {
         size_type new_cap = this->calculate_growth(1);
+
+        if constexpr (UseMemOps<T>) {
+            // `args` may point into the storage that is about to move
+            T value(std::forward<Args>(args)...);
+
+            if (!this->realloc_insert(new_cap)) {
+                return;
+            }
+
+            new (this->finish) T(std::move(value));
+            ++this->finish;
+            return;
+        }
+
         pointer new_start = this->allocate_internal(new_cap);
 
         if (!new_start) {
@@ -130,23 +168,13 @@ class Vector {
 
         pointer new_finish = new_start;
 
-        if constexpr (UseMemOps<T>) {
-            size_type current_size = this->size();
-
-            if (current_size > 0) {
-                memcpy(new_start, this->start, current_size * sizeof(T));
-            }
-
-            new_finish += current_size;
-        } else {
-            for (pointer ptr = this->start; ptr != this->finish; ++ptr) {
-                new (new_finish) T(std::move(*ptr));
-                ++new_finish;
-            }
+        for (pointer ptr = this->start; ptr != this->finish; ++ptr) {
+            new (new_finish) T(std::move(*ptr));
+            ++new_finish;
+        }
 
-            for (pointer ptr = this->start; ptr != this->finish; ++ptr) {
-                ptr->~T();
-            }
+        for (pointer ptr = this->start; ptr != this->finish; ++ptr) {
+            ptr->~T();
         }
 
         new (new_finish) T(std::forward<Args>(args)...);
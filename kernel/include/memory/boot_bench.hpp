@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+#ifndef BOOT_BENCH
+#define BOOT_BENCH 0
+#endif
+
+namespace kernel::memory {
+// Memory subsystem microbenchmarks, built in with BOOT_BENCH. They run once
+// on the BSP after the cores are up and log one `bench:` line per result.
+class BootBench {
+   public:
+    // Does nothing unless benchmarks are built in
+    static void run();
+
+   private:
+    // kfree throughput, freeing in allocation and in shuffled order, and the
+    // cost of the pointer-to-slab lookup on its own
+    static void kfree_lookup();
+    // kmalloc_bulk/kfree_bulk against a kmalloc/kfree loop, for batches of
+    // 1 to 256 objects
+    static void bulk();
+    // Mapping and unmapping 1GB of 4K pages a page at a time against the
+    // range engine, in a scratch page map that is never loaded
+    static void map_ranges();
+
+    static void report(const char* what, size_t ops, size_t cycles);
+};
+}  // namespace kernel::memory
\ No newline at end of file
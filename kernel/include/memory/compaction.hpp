@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace kernel::memory {
+class UserAddressSpace;
+
+struct CompactionStats {
+    size_t blocks_scanned;    ///< Mostly-free 2MB blocks isolated as candidates.
+    size_t blocks_compacted;  ///< Blocks emptied and handed back as free 2MB blocks.
+    size_t blocks_skipped;    ///< Blocks given up on (unmovable or shared pages).
+    size_t pages_migrated;    ///< User pages copied to a new frame.
+    size_t shootdowns;        ///< TLB flushes issued, one per address space per block.
+    size_t migrate_ns;        ///< Time spent isolating, copying and remapping.
+};
+
+// Background defragmentation of physical memory. When few free 2MB blocks
+// are left, user pages are moved out of blocks that are almost free so the
+// buddy allocator can merge them again.
+class Compactor {
+   public:
+    // Start the compaction thread on the calling core.
+    static void start();
+
+    // Try to empty one mostly-free 2MB block. Returns false once no block
+    // qualifies, true otherwise (whether or not this one succeeded).
+    static bool compact_block();
+
+    static CompactionStats get_stats();
+
+   private:
+    static void worker(void* arg);
+
+    // Record every 4K user mapping of `space` pointing into the 2MB block at
+    // `base`. Returns false if there are more than we can track.
+    static bool collect(UserAddressSpace& space, uintptr_t base);
+    // Move the `used` pages of the isolated block at `base` to new frames.
+    // `move_pages` is the part run under the address-space registry lock.
+    static bool migrate(uintptr_t base, size_t used);
+    static bool move_pages(uintptr_t base, size_t used);
+};
+}  // namespace kernel::memory
\ No newline at end of file
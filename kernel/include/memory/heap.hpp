@@ -2,30 +2,67 @@
 
 #include "libs/spinlock.hpp"
 #include "memory/memory.hpp"
+#include <atomic>
 #include <bit>
 
-// 48 bits total. 12 bits -> offset. 36 bits index
-// Similar to how x86_64's paging behaves.
-// Level 4: Bits 39-47
-// Level 3: Bits 30-38
-// Level 2: Bits 21-29
-// Level 1: Bits 12-20
-#define MASK            0x1ff
-#define FREE_BATCH_SIZE 32
-
 namespace kernel::memory {
+class KmemCache;
+struct PageFrame;
+
+// Which size class list a kmalloc slab is on
+enum class SlabList : uint16_t {
+    None,
+    Partial,
+    Empty,
+};
+
 struct alignas(32) Slab {
     void* freelist;
     Slab* next;
     Slab* prev;
     void* page_addr;
+    KmemCache* cache;  // Owning typed cache; nullptr for kmalloc slabs
+
+    // Objects freed by anyone but the owning CPU, pushed lock-free, packed
+    // with the slab's state (see SlubAllocator::SLAB_FROZEN).
+    std::atomic<uintptr_t> remote;
 
     uint16_t in_use;
     uint16_t total;
     uint16_t size_class;
     uint16_t is_large;
+    SlabList list;  // Under the size class lock
 };
 
+inline void slab_list_add(Slab*& head, Slab* s) {
+    s->next = head;
+    s->prev = nullptr;
+
+    if (head) {
+        head->prev = s;
+    }
+
+    head = s;
+}
+
+inline void slab_list_remove(Slab*& head, Slab* s) {
+    if (s->prev) {
+        s->prev->next = s->next;
+    } else {
+        head = s->next;
+    }
+
+    if (s->next) {
+        s->next->prev = s->prev;
+    }
+
+    s->next = s->prev = nullptr;
+}
+
+// Hands out Slab structs carved from whole pages. The pages come from the
+// PMM through the HHDM like slab pages, so the shrinkers that free structs
+// here never reach the VMM and its locks. A page goes back once none of its
+// structs is in use, unless it's the last one with room.
 class MetadataAllocator {
    public:
     Slab* alloc();
@@ -34,47 +71,52 @@ class MetadataAllocator {
     static MetadataAllocator& get();
 
    private:
+    // Header of every metadata page; the structs follow it
     struct Page {
         Page* next;
-        uint8_t data[memory::PAGE_SIZE_4K - sizeof(Page*)];
+        Page* prev;
+        Slab* free_list;  // Released structs of this page
+        uint32_t carved;  // Structs handed out at least once
+        uint32_t live;    // Structs in use
     };
 
-    Page* head      = nullptr;
-    size_t offset   = 0;
-    Slab* free_pool = nullptr;
+    static_assert((sizeof(Page) % alignof(Slab)) == 0);
+
+    static constexpr size_t SLABS_PER_PAGE = (PAGE_SIZE_4K - sizeof(Page)) / sizeof(Slab);
+
+    void link(Page* page);
+    void unlink(Page* page);
+
+    Page* avail        = nullptr;  // Pages with a free or uncarved struct
+    size_t avail_count = 0;
     SpinLock lock;
 };
 
-// Inspiration: Radix maps used by x86_64 architecture for mapping
-// Virtual Address Space to Physical Address Space.
-class HeapMap {
+// Finds the slab owning a heap pointer through the PMM frame database. Slab
+// pages come straight from the PMM and are used through the HHDM, so their
+// frame is one subtraction away; only large allocations, which live in the
+// VMM heap, take a page-table walk.
+class SlabMap {
    public:
-    static void set(void* ptr, Slab* meta);
+    // Point the frames of `pages` pages at `ptr` to `meta`, or detach them
+    // when `meta` is nullptr.
+    static void set(void* ptr, size_t pages, Slab* meta);
     static Slab* get(void* ptr);
 
-    struct Node {
-        // Can be Node* (Levels 4-2)
-        std::atomic<void*> entries[MASK + 1];
-    };
-
    private:
-    static std::atomic<Node*> root;
-    static SpinLock lock;
+    static PageFrame* frame_of(void* ptr);
 };
 
-struct HeapTLB {
-    static constexpr size_t TLB_SIZE = 64;
-    static constexpr size_t TLB_MASK = TLB_SIZE - 1;
+// Physically contiguous pages for a slab, addressed through the HHDM.
+void* alloc_slab_pages(size_t pages);
+void free_slab_pages(void* base, size_t pages);
 
-    struct Entry {
-        uintptr_t page_base;
-        Slab* slab;
-    } entries[TLB_SIZE];
-
-    void init();
-
-    Slab* lookup(void* ptr);
-    void insert(void* ptr, Slab* s);
+struct HeapClassStats {
+    size_t object_size;  ///< Bytes per object.
+    size_t slab_pages;   ///< Pages per slab.
+    size_t active;       ///< Slabs owned by a CPU.
+    size_t partial;      ///< Unowned slabs with free objects.
+    size_t empty;        ///< Fully free slabs kept for reuse.
 };
 
 class SlubAllocator {
@@ -84,76 +126,179 @@ class SlubAllocator {
     void init();
     void* allocate(size_t size);
     void free(void* ptr);
+    // `free` for a caller that knows the size it asked for
+    void free_sized(void* ptr, size_t size);
+    // Resize in place when the object's size class, or for a large
+    // allocation the virtual space after it, has room; otherwise move it.
+    // On failure `ptr` is left as it was.
+    void* reallocate(void* ptr, size_t size);
+    // `alignment` must be a power of two. The result is a plain allocation
+    // that `free` takes back like any other.
+    void* allocate_aligned(size_t size, size_t alignment);
+
+    // Fill `out` with `count` objects of `size` bytes, taking the per-CPU
+    // cache once and whole freelist runs at a time. All or nothing: on
+    // failure nothing stays allocated.
+    bool allocate_bulk(size_t size, size_t count, void** out);
+    // `free` each of `ptrs`; runs from one slab go back in a single step
+    void free_bulk(void** ptrs, size_t count);
+
+    // Release up to `nr_pages` worth of empty slabs. Returns the pages freed.
+    size_t shrink(size_t nr_pages);
+    // Fill `out` with up to `max` size classes. Returns how many it filled.
+    size_t get_stats(HeapClassStats* out, size_t max);
 
     static SlubAllocator& get();
 
    private:
-    inline int get_size_idx(size_t size) const {
-        if (size > 2048) {
-            return -1;
+    static constexpr int NUM_CLASSES = 16;
+
+    // Every class is a multiple of 16, so plain operator new gets its
+    // __STDCPP_DEFAULT_NEW_ALIGNMENT__ from any of them.
+    static constexpr uint16_t CLASS_SIZES[NUM_CLASSES] = {
+        16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096,
+    };
+
+    static_assert([] {
+        for (int i = 0; i < NUM_CLASSES; ++i) {
+            if ((CLASS_SIZES[i] % __STDCPP_DEFAULT_NEW_ALIGNMENT__) != 0) {
+                return false;
+            }
         }
 
-        if (size <= 16) {
-            return 0;
+        return true;
+    }());
+
+    static constexpr size_t MAX_CLASS_SIZE   = 4096;
+    static constexpr size_t MAX_SLAB_PAGES   = 4;
+    static constexpr size_t MIN_SLAB_OBJECTS = 4;
+    static constexpr size_t MAX_EMPTY_SLABS  = 2;  // Per class; the rest go back at once
+
+    // Smallest slab of up to MAX_SLAB_PAGES that holds MIN_SLAB_OBJECTS and
+    // leaves no more than 1/8 of itself unused.
+    static constexpr size_t slab_pages(size_t size) {
+        for (size_t pages = 1; pages < MAX_SLAB_PAGES; pages *= 2) {
+            size_t bytes = pages * PAGE_SIZE_4K;
+
+            if (((bytes / size) >= MIN_SLAB_OBJECTS) && (((bytes % size) * 8) <= bytes)) {
+                return pages;
+            }
         }
 
-        // Log 2
-        return std::bit_width(size - 1) - 4;
+        return MAX_SLAB_PAGES;
     }
 
-    void* alloc_large(size_t size);
-    void free_large(Slab* s, void* ptr);
+    // Size to class, in 8-byte steps up to 1K and 128-byte steps above it
+    struct SizeIndex {
+        uint8_t fine[(1024 / 8) + 1];
+        uint8_t coarse[(MAX_CLASS_SIZE / 128) + 1];
+    };
 
-    void* take_object(Slab* s);
-    Slab* refill_slab(int idx);
+    static constexpr SizeIndex SIZE_INDEX = [] {
+        SizeIndex index = {};
+        int idx         = 0;
+
+        for (size_t i = 0; i < sizeof(index.fine); ++i) {
+            while (CLASS_SIZES[idx] < (i * 8)) {
+                idx++;
+            }
+
+            index.fine[i] = static_cast<uint8_t>(idx);
+        }
 
-    static inline void list_add(Slab*& head, Slab* s) {
-        s->next = head;
-        s->prev = nullptr;
+        for (size_t i = 0; i < sizeof(index.coarse); ++i) {
+            while (CLASS_SIZES[idx] < (i * 128)) {
+                idx++;
+            }
 
-        if (head) {
-            head->prev = s;
+            index.coarse[i] = static_cast<uint8_t>(idx);
         }
 
-        head = s;
+        return index;
+    }();
+
+    // Objects sit at multiples of their size from a page boundary, so a
+    // class is aligned to the lowest set bit of its size.
+    static constexpr size_t class_align(int idx) {
+        return static_cast<size_t>(1) << std::countr_zero(CLASS_SIZES[idx]);
     }
 
-    static inline void list_remove(Slab*& head, Slab* s) {
-        if (s->prev) {
-            s->prev->next = s->next;
-        } else {
-            head = s->next;
+    inline int get_size_idx(size_t size) const {
+        if (size <= 1024) {
+            return SIZE_INDEX.fine[(size + 7) >> 3];
         }
 
-        if (s->next) {
-            s->next->prev = s->prev;
+        if (size <= MAX_CLASS_SIZE) {
+            return SIZE_INDEX.coarse[(size + 127) >> 7];
         }
 
-        s->next = s->prev = nullptr;
+        return -1;
     }
 
-    // 16, 32, 64, 128, 256, 512, 1K, 2K
-    static constexpr int NUM_CLASSES = 8;
+    // `Slab::is_large` of a large allocation: mapped into the VMM heap, or
+    // physically contiguous through the HHDM for alignments above a page.
+    static constexpr uint16_t LARGE_MAPPED = 1;
+    static constexpr uint16_t LARGE_CONTIG = 2;
+
+    void* alloc_large(size_t size);
+    void* alloc_contig(size_t size, size_t alignment);
+    void free_large(Slab* s, void* ptr);
+
+    // A kmalloc slab is either the active slab of one CPU (frozen), on a
+    // size class list, or fully allocated and on no list at all (floating).
+    // Only the owner touches `freelist`; everybody else frees into `remote`,
+    // and whoever frees first into a floating slab puts it on `partial`.
+    //
+    // `Slab::remote` packs the state (bits 0-1), the remote list head (bits
+    // 2-47 of a canonical heap address) and, while no CPU owns the slab, how
+    // many of its objects are still allocated (bits 48-63). The free that
+    // counts that down to zero moves the slab to `empty`.
+    static constexpr uintptr_t SLAB_FROZEN     = 1;
+    static constexpr uintptr_t SLAB_FLOATING   = 2;
+    static constexpr uintptr_t SLAB_STATE_MASK = SLAB_FROZEN | SLAB_FLOATING;
+
+    static constexpr int SLAB_COUNT_SHIFT     = 48;
+    static constexpr uintptr_t SLAB_COUNT_ONE = 1ul << SLAB_COUNT_SHIFT;
+    static constexpr uintptr_t SLAB_HEAD_MASK = (SLAB_COUNT_ONE - 1) & ~SLAB_STATE_MASK;
+
+    static void* remote_head(uintptr_t word) {
+        // Bit 47 sign-extends back into the upper half
+        return reinterpret_cast<void*>(static_cast<intptr_t>((word & SLAB_HEAD_MASK) << 16) >> 16);
+    }
 
     struct SizeClass {
         size_t size;
+        size_t pages;  // Pages per slab
         Slab* partial;
         Slab* empty;
+        size_t nr_active;
+        size_t nr_partial;
+        size_t nr_empty;
         SpinLock lock;
     };
 
-    struct alignas(CACHE_LINE_SIZE) CpuCache {
-        HeapTLB tlb;
+    void* take_object(Slab* s);
+    void put_object(Slab* s, void* ptr);
+    // Push the chain `head`..`tail` of `count` objects onto `s->remote`
+    void remote_free(Slab* s, void* head, void* tail, size_t count);
+    size_t drain_remote(Slab* s, uintptr_t state);
+    bool retire_slab(Slab* s);
+    bool settle_slab(SizeClass& sc, Slab* s);
+    void release_slab(Slab* s);
+    Slab* refill_slab(int idx);
+
+    static size_t shrink_count(void* ctx);
+    static size_t shrink_scan(void* ctx, size_t nr_pages);
 
+    struct alignas(CACHE_LINE_SIZE) CpuCache {
         struct ClassCache {
             Slab* active;
-            void* free_buf[FREE_BATCH_SIZE];
-            int free_count;
         } classes[NUM_CLASSES];
     };
 
-    [[gnu::noinline]] void free_slow(void* ptr, CpuCache& cache);
-    void flush(int idx, CpuCache::ClassCache& cache);
+    // This CPU's slab of class `idx` with a non-empty freelist, after
+    // draining, retiring or replacing the active one. Called under `irq_lock`.
+    Slab* ready_slab(CpuCache::ClassCache& cache, int idx);
 
     SizeClass size_classes[NUM_CLASSES];
     CpuCache* cpu_caches = nullptr;
@@ -165,6 +310,10 @@ class SlubAllocator {
 
 void* kmalloc(size_t size);
 void kfree(void* ptr);
+bool kmalloc_bulk(size_t size, size_t count, void** out);
+void kfree_bulk(void** ptrs, size_t count);
+void kfree_sized(void* ptr, size_t size);
+void* krealloc(void* ptr, size_t size);
 void* aligned_kalloc(size_t size, size_t alignment);
 void aligned_kfree(void* ptr);
 }  // namespace kernel::memory
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+
+#ifndef HEAP_PROFILE
+#define HEAP_PROFILE 0
+#endif
+
+// Charge an allocation or free to the caller of the function this expands in
+#if HEAP_PROFILE
+#define HEAP_PROFILE_ALLOC(ptr, size) \
+    kernel::memory::HeapProfiler::record_alloc(__builtin_return_address(0), ptr, size)
+#define HEAP_PROFILE_FREE(ptr) kernel::memory::HeapProfiler::record_free(ptr)
+#else
+#define HEAP_PROFILE_ALLOC(ptr, size) static_cast<void>(0)
+#define HEAP_PROFILE_FREE(ptr) static_cast<void>(0)
+#endif
+
+namespace kernel::memory {
+// Heap use per allocation site, built in with HEAP_PROFILE. A site is the
+// return address of a kmalloc or operator new call. Each CPU counts into its
+// own site table, and every live pointer remembers the entry it was charged
+// to, so a free is credited back there from whichever CPU it happens on.
+class HeapProfiler {
+   public:
+    static void init(size_t num_cpus);
+
+    static void record_alloc(void* site, void* ptr, size_t size);
+    // Call before the object is actually freed
+    static void record_free(void* ptr);
+
+    // Log one `heapprof:` line per site, for misc/scripts/heapprof.py to
+    // symbolize. Returns false when profiling isn't built in.
+    static bool dump();
+};
+}  // namespace kernel::memory
\ No newline at end of file
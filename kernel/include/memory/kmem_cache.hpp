@@ -0,0 +1,138 @@
+#pragma once
+
+#include "libs/intrusive_list.hpp"
+#include "libs/log.hpp"
+#include "libs/spinlock.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace kernel::memory {
+struct Slab;
+
+struct KmemCacheTag {};
+
+// A slab cache for one object type (Bonwick's object caches). Objects are
+// packed at their own size instead of the next kmalloc power of two, and a
+// slab spans as many pages as it takes to keep the tail waste under 1/8.
+//
+// With a constructor, objects are built once when their slab is created and
+// must be handed back in constructed state; the free-list link then lives
+// past the object so it never clobbers that state. Successive slabs start
+// their first object at a different cache-line offset (coloring), so the
+// same field of objects in different slabs doesn't always hit the same set.
+//
+// Empty slabs stay with their cache until the reclaimer asks for memory
+// back; one shrinker covers every cache.
+class KmemCache : public IntrusiveListNode<KmemCacheTag> {
+   public:
+    using Constructor = void (*)(void* obj);
+
+    // `align` of 0 means pointer alignment. Returns nullptr on bad arguments
+    // or when out of memory.
+    static KmemCache* create(const char* name, size_t size, size_t align, Constructor ctor);
+    // Release every slab and the cache itself. All objects must be freed.
+    static void destroy(KmemCache* cache);
+
+    void* allocate();
+    void free(void* ptr);
+
+    const char* get_name() const {
+        return this->name;
+    }
+
+    size_t get_object_size() const {
+        return this->object_size;
+    }
+
+   private:
+    KmemCache() = default;
+
+    // A new, unlisted slab. Called without `lock`: it may run reclaim.
+    Slab* grow();
+    void release_slab(Slab* s);
+    // Free empty slabs until `nr_pages` pages went back. Returns the pages freed.
+    size_t shrink(size_t nr_pages);
+
+    // Shrinker callbacks over every cache (see `Reclaimer`)
+    static size_t shrink_count(void* ctx);
+    static size_t shrink_scan(void* ctx, size_t nr_pages);
+
+    void** link_of(void* obj) const {
+        return reinterpret_cast<void**>(static_cast<char*>(obj) + this->link_offset);
+    }
+
+    const char* name   = nullptr;
+    size_t object_size = 0;  // Size asked for by `create`
+    size_t stride      = 0;  // Distance between objects, free link included
+    size_t link_offset = 0;  // Where a free object keeps its next pointer
+    Constructor ctor   = nullptr;
+
+    size_t slab_pages  = 0;
+    size_t objects     = 0;  // Objects per slab
+    size_t color_unit  = 0;  // Bytes between two colors
+    size_t color_count = 0;  // Distinct first-object offsets
+    size_t color_next  = 0;  // Bumped atomically; taken modulo `color_count`
+
+    Slab* partial   = nullptr;  // Some objects free
+    Slab* full      = nullptr;  // No object free
+    Slab* empty     = nullptr;  // Every object free
+    size_t nr_empty = 0;        // Slabs on `empty`
+    IrqLock lock;
+
+    struct Registry {
+        SpinLock lock;
+        IntrusiveList<KmemCache, KmemCacheTag> caches;
+        bool shrinker_added = false;
+    };
+
+    static Registry& registry();
+};
+
+KmemCache* kmem_cache_create(const char* name, size_t size, size_t align,
+                             KmemCache::Constructor ctor = nullptr);
+void kmem_cache_destroy(KmemCache* cache);
+void* kmem_cache_alloc(KmemCache* cache);
+void kmem_cache_free(KmemCache* cache, void* ptr);
+
+void* kmalloc(size_t size);
+void kfree(void* ptr);
+
+// Class-specific operator new/delete that keep `T` in a kmem cache of its
+// own, named `T::kmem_cache_name` and created on first use:
+//
+//     struct Foo : memory::KmemCached<Foo> {
+//         static constexpr const char* kmem_cache_name = "foo";
+//     };
+//
+// Objects fall back to kmalloc if the cache couldn't be created.
+template <typename T>
+struct KmemCached {
+    static void* operator new(size_t size) {
+        KmemCache* cache = kmem_cache();
+
+        if (!cache) {
+            return kmalloc(size);
+        }
+
+        // A derived class would overrun objects sized for `T`
+        if (size > cache->get_object_size()) {
+            PANIC("kmem: %zu-byte object too big for cache %s", size, cache->get_name());
+        }
+
+        return cache->allocate();
+    }
+
+    static void operator delete(void* ptr) {
+        if (KmemCache* cache = kmem_cache()) {
+            cache->free(ptr);
+        } else {
+            kfree(ptr);
+        }
+    }
+
+    static KmemCache* kmem_cache() {
+        static KmemCache* cache = kmem_cache_create(T::kmem_cache_name, sizeof(T), alignof(T));
+        return cache;
+    }
+};
+}  // namespace kernel::memory
\ No newline at end of file
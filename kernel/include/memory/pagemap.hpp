@@ -3,9 +3,12 @@
 #include <cstdint>
 #include <cstddef>
 #include <utility>
+#include "libs/cpu_mask.hpp"
 #include "memory/memory.hpp"
 
 namespace kernel::memory {
+class TlbGather;
+
 enum class CacheType : uint8_t {
     WriteBack,
     Uncached,
@@ -25,23 +28,68 @@ enum PageFlags : uint8_t {
 
 class PageMap {
    public:
+    // Called by `walk` for each leaf; return false to stop the walk.
+    using LeafFn = bool (*)(void* ctx, uintptr_t virt_addr, uintptr_t phys_addr, size_t size);
+
     static void global_init();
     static void create_new(PageMap* map);
 
     bool map(uintptr_t virt_addr, uintptr_t phys_addr, uint8_t flags, CacheType cache,
              PageSize size, uint8_t pkey = 0, bool do_flush = true);
 
+    // Map a fresh frame. 2M/1G frames come from the buddy lists unless
+    // `use_reserve`, which only user regions that asked for huge pages pass.
     bool map(uintptr_t virt_addr, uint8_t flags, CacheType cache, PageSize size,
-             bool do_flush = true);
+             bool do_flush = true, bool use_reserve = false);
     void map_range(uintptr_t virt_start, uintptr_t phys_start, size_t length, uint8_t flags,
                    CacheType cache);
+    // Back every unmapped page of the range with a fresh frame, using pages
+    // up to `max_size` where the alignment allows. Existing mappings are kept.
+    // Huge frames come from the huge reserve only with `use_reserve`.
+    bool populate_range(uintptr_t virt_start, size_t length, uint8_t flags, CacheType cache,
+                        PageSize max_size = PageSize::Size1G, bool use_reserve = false);
 
-    void unmap(uintptr_t virt_addr, uint16_t owner_pcid = 0, bool free_phys = false);
+    // Returns the size of the mapping removed, 0 if nothing was mapped.
+    size_t unmap(uintptr_t virt_addr, bool free_phys = false);
+    // Same, but the flush and the frees are left to `gather`
+    size_t unmap(uintptr_t virt_addr, TlbGather& gather, bool free_phys = false);
+    void unmap_range(uintptr_t start, size_t length, TlbGather& gather, bool free_phys = false);
+
+    // Page migration: `detach` clears the 4K mapping at `virt_addr` without
+    // freeing the frame or flushing the TLB, returning the frame (0 if none)
+    // and the raw entry; `reattach` reinstalls that entry over `phys_addr`.
+    uintptr_t detach(uintptr_t virt_addr, uintptr_t& entry);
+    void reattach(uintptr_t virt_addr, uintptr_t entry, uintptr_t phys_addr);
+    // Physical address `virt_addr` maps to, 0 if it isn't mapped.
     uintptr_t translate(uintptr_t virt_addr);
+    // Call `fn` for every present leaf overlapping [start, start + length),
+    // in address order, with the leaf's base and size. Holes are skipped a
+    // whole table at a time.
+    void walk(uintptr_t start, size_t length, LeafFn fn, void* ctx);
     size_t set_page_flags(uintptr_t virt_addr, uint8_t flags,
-                          CacheType cache = CacheType::WriteBack, uint16_t owner_pcid = 0);
+                          CacheType cache = CacheType::WriteBack, bool do_flush = true);
+
+    // Size of the leaf mapping `virt_addr`, 0 if it isn't mapped.
+    size_t leaf_size(uintptr_t virt_addr);
+    // `split` replaces the 2M/1G leaf covering `virt_addr` with a table one
+    // level down mapping the same memory the same way. `collapse` turns the
+    // 512 identically mapped 4K pages of the 2M range at `virt_addr` back into
+    // one leaf; in place if their frames are an aligned run, else, with
+    // `allow_copy`, by copying them into a new huge frame taken from the
+    // buddy lists, never the huge reserve. The caller must hold off page
+    // faults and other page-table changes on the range while it collapses.
+    bool split(uintptr_t virt_addr);
+    bool collapse(uintptr_t virt_addr, bool allow_copy = false);
 
     void load(uint16_t pcid = 0, bool flush = true);
+    // Switch this core from `prev` (may be null) to this map. Use instead of
+    // `load` wherever a core changes address space, so shootdowns find it.
+    void activate(PageMap* prev, uint16_t pcid, bool flush);
+
+    // Invalidate `count` 4K pages from `start` on every core that may cache
+    // them: kernel-half addresses everywhere, the rest only on cores running
+    // this map. Cores that ran it before flush when they next switch to it.
+    void flush_tlb(uintptr_t start, size_t count);
 
     uintptr_t get_root_phys() const {
         return this->phys_root_addr;
@@ -52,13 +100,34 @@ class PageMap {
 
     static PageMap* get_kernel_map();
 
+    // The upper canonical half, shared by every address space
+    static bool is_kernel_half(uintptr_t virt_addr) {
+        return (virt_addr >> 63) != 0;
+    }
+
    private:
     static bool is_table_empty(uintptr_t* table);
 
     uintptr_t* get_pte(uintptr_t virt_addr, int target_level, bool allocate);
+    // Clear the leaf at `virt_addr`, then free the tables it leaves empty if
+    // `prune`. `span` is set to the size of the entry or hole found there.
+    size_t unmap_entry(uintptr_t virt_addr, TlbGather& gather, bool free_phys, bool prune,
+                       size_t& span);
+    // The range-mapping engine behind `map_range` and `populate_range`: one
+    // walk per page table, whose run of entries is then filled in one loop.
+    // `phys_start` is ALLOC_FRAMES to back the range with fresh frames.
+    // Returns how many bytes are mapped; `replaced` is set if any present
+    // entry was overwritten and so needs a flush.
+    static constexpr uintptr_t ALLOC_FRAMES = ~0ul;
+    size_t map_run(uintptr_t virt_start, uintptr_t phys_start, size_t length, uint8_t flags,
+                   CacheType cache, PageSize max_size, bool use_reserve, bool& replaced);
     bool is_active() const;
 
     /// Physical address of the root page-table.
     uintptr_t phys_root_addr;
+
+    CpuMask active_cpus;  // Cores with this map in CR3 right now
+    CpuMask used_cpus;    // Cores that loaded it since boot; cleared lazily
+    CpuMask stale_cpus;   // Cores that must flush before running it again
 };
 }  // namespace kernel::memory
\ No newline at end of file
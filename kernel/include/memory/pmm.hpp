@@ -1,33 +1,145 @@
 #pragma once
 
+#include "memory/memory.hpp"
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+
+// Boot-time reserve of huge frames, kept off the buddy lists (see `alloc_huge`).
+#ifndef HUGE_POOL_2M
+#define HUGE_POOL_2M 0
+#endif
+
+#ifndef HUGE_POOL_1G
+#define HUGE_POOL_1G 0
+#endif
 
 namespace kernel::memory {
-constexpr size_t CACHE_SIZE = 512;  // 2MB cache per CPU
-constexpr size_t BATCH_SIZE = 256;  // Transfer 1MB at a time between Global <-> Local CPU cache
+constexpr size_t MAGAZINE_SIZE     = 256;  // Pages per magazine: 1MB moves CPU <-> depot at once
+constexpr size_t MAGAZINES_PER_CPU = 4;    // Loaded + previous, plus two depot slots per CPU
+constexpr size_t MAX_ORDER         = 18;   // Largest buddy block: 2^18 pages = 1GB
+constexpr size_t HUGE_2M_ORDER     = 9;    // 2^9 pages = 2MB
+constexpr size_t HUGE_1G_ORDER     = 18;   // 2^18 pages = 1GB
+
+constexpr size_t ZERO_POOL_SIZE = 64;  // 256KB of pre-zeroed pages per CPU
+
+struct Slab;
+
+// Bits of `PageFrame::flags`.
+enum FrameFlags : uint16_t {
+    FrameReserved  = (1 << 0),  // Not RAM the PMM hands out (firmware, holes, PMM metadata)
+    FrameHuge      = (1 << 1),  // First page of a 2MB/1GB frame from `alloc_huge`
+    FramePageTable = (1 << 2),  // Holds a paging structure
+    FrameSlab      = (1 << 3),  // Backs a heap slab, see `PageFrame::slab`
+};
+
+// Metadata of one physical page, indexed by PFN (see `PhysicalManager::frame`).
+// Allocation resets the frame of the first page only; for a multi-page block
+// the other frames keep whatever they held before.
+struct PageFrame {
+    std::atomic<uint32_t> refcount;  ///< References held; 1 when allocated, 0 once freed.
+    std::atomic<uint32_t> mapcount;  ///< User page-table entries pointing at the page.
+    Slab* slab;                      ///< Owning slab while `FrameSlab` is set.
+    uint16_t flags;                  ///< `FrameFlags`.
+    uint16_t node;                   ///< NUMA node of the page.
+    uint8_t zone;                    ///< Index of the PMM zone owning the page.
+    uint8_t order;                   ///< Buddy order of a huge frame, 0 otherwise.
+};
+
+static_assert(sizeof(PageFrame) <= 32, "PageFrame must stay within 32 bytes per page");
+
+// Free-memory thresholds, in buddy-list pages (see `watermark_deficit`).
+enum class Watermark : uint8_t {
+    Min,   // Last reserve; allocations that dip below it kick the reclaim thread
+    Low,   // Below this the reclaim thread is woken
+    High,  // The reclaim thread stops once free memory is back above this
+};
 
 struct PMMStats {
-    size_t total_memory;  ///< Total managed physical memory (bytes).
-    size_t used_memory;   ///< Bytes currently allocated.
-    size_t free_memory;   ///< Bytes currently free.
+    size_t total_memory;   ///< Total managed physical memory (bytes).
+    size_t used_memory;    ///< Bytes currently allocated.
+    size_t free_memory;    ///< Bytes currently free.
+    size_t zeroed_memory;  ///< Free bytes already zeroed in the per-CPU clean pools.
+    size_t huge_reserved;  ///< Bytes held back in the huge-frame pools (not in `free_memory`).
 };
 
 class PhysicalManager {
    public:
     struct PerCPUCache;
+    struct Magazine;
 
     static void init();
+    // Re-zone memory per NUMA node once ACPI (SRAT/SLIT) has been parsed.
+    static void init_numa();
+    // Bring up the memory `init` left for later (everything above 4GB) one
+    // 1GB slice at a time. Every core calls this once SMP is up; it returns
+    // when no slice is left to take.
+    static void init_deferred();
 
     static void* alloc(size_t count = 1);
     static void* alloc_aligned(size_t count, size_t alignment);
     static void* alloc_clear(size_t count = 1);
     static void* alloc_dma(size_t count, size_t alignment);
+    // Allocate from `node`, falling back to the nearest node with free memory.
+    static void* alloc_on_node(uint32_t node, size_t count = 1);
+    // One naturally aligned 2MB or 1GB frame for a huge mapping. Served from
+    // the boot-time reserve first, then from the buddy lists; opportunistic
+    // callers pass `use_reserve = false` to leave the reserve alone.
+    static void* alloc_huge(PageSize size, bool use_reserve = true);
 
     static void free(void* ptr, size_t count = 1);
+    // Free a page whose contents are known to be zero (e.g. an emptied page
+    // table); it goes straight back to the clean pool.
+    static void free_clean(void* ptr);
+    // Release a frame from `alloc_huge`; it refills the reserve while short.
+    static void free_huge(void* ptr, PageSize size);
+    // `put_frame` on `count` single pages, given by physical address. The
+    // pages whose last reference went are freed together, claiming the CPU
+    // cache (or the global lock) once; they are moved to the front of `pages`.
+    static void put_batch(uintptr_t* pages, size_t count);
     static void reclaim_type(size_t memmap_type);
 
     static PMMStats get_stats();
 
+    // Pages the buddy lists are short of `mark`, 0 when above it. Pages
+    // parked in the CPU caches don't count; only reclaim brings them back.
+    static size_t watermark_deficit(Watermark mark);
+    // Return every page cached by the executing CPU to the buddy lists.
+    static void drain_local_cache();
+
+    // Frame database. `frame` returns nullptr for addresses past the end of
+    // RAM (e.g. MMIO). `get_frame` takes an extra reference on an allocated
+    // page or huge frame; `put_frame` drops one and frees the page (or the
+    // whole huge frame) with the last. Unmapping with `free_phys` drops the
+    // mapping's reference this way (see `TlbGather`), so a page someone
+    // pinned with `get_frame` outlives its mappings.
+    static PageFrame* frame(uintptr_t phys);
+    static void get_frame(uintptr_t phys);
+    static void put_frame(uintptr_t phys);
+
+    // Huge frames mapped piecewise (see `PageMap::split` and `collapse`).
+    // `split_huge` turns the `alloc_huge` frame at `phys` into 512 frames one
+    // size down, each freeable on its own. `merge_huge` makes the 512 pages
+    // from the 2MB-aligned `phys` one 2MB frame again; it fails unless every
+    // page is a plain allocation with a single reference.
+    static void split_huge(uintptr_t phys, PageSize size);
+    static bool merge_huge(uintptr_t phys);
+
+    // Compaction support (see `Compactor`). `isolate_block` picks a 2MB block
+    // with 1 to `max_used` pages in use, takes its free pages off the buddy
+    // lists so nothing new lands there, and returns its base (0 if nothing
+    // qualifies) with the pages in use in `used`. `release_block` hands back
+    // the isolated pages plus `count` frames in `migrated` that were moved out.
+    static uintptr_t isolate_block(size_t max_used, size_t& used);
+    static void release_block(uintptr_t base, const uintptr_t* migrated, size_t count);
+    // Free 2MB blocks on the buddy lists; a larger block counts as several.
+    static size_t free_huge_blocks();
+
+    // Zero up to `budget` pages into the calling CPU's clean pool with
+    // non-temporal stores. Meant for the idle thread; returns the number of
+    // pages added, 0 once the pool is full.
+    static size_t refill_zero_pool(size_t budget);
+
    private:
     // Bitmap helpers: manage page allocation state. Each bit corresponds
     // to a physical page; 1 means "allocated", 0 means "free".
@@ -35,13 +147,62 @@ class PhysicalManager {
     static void clear_bit(size_t idx);
     static bool test_bit(size_t idx);
 
-    // Walk and modify the bitmap to allocate or free ranges of pages.
-    static void* alloc_from_bitmap(size_t count);
+    // Range variants of the above; whole 64-page words are written at once.
+    static void set_range(size_t idx, size_t count);
+    static void clear_range(size_t idx, size_t count);
+
+    // Buddy helpers: every free page that is not parked in a CPU cache lives
+    // in exactly one naturally aligned block on a per-zone, per-order list.
+    // The bitmap mirrors this state and stays the source of truth for stats.
+    static size_t buddy_alloc(size_t zone_idx, size_t order, size_t max_order);
+    static void buddy_free(size_t page_idx, size_t order);
+    static void buddy_free_range(size_t page_idx, size_t count);
+
+    // Carve `count` contiguous pages out of the buddy lists and mark them used,
+    // trying the nodes in SLIT distance order starting at `node`. Blocks above
+    // `max_order` are left alone, which keeps small requests out of free
+    // huge-page-sized blocks while smaller fragments remain.
+    static size_t alloc_from_node(uint32_t node, size_t order, bool dma,
+                                  size_t max_order = MAX_ORDER);
+    // The pages' clean bits are dropped unless `keep_clean`, in which case
+    // the caller reads and clears them itself (see `alloc_clear`).
+    static void* alloc_block(size_t count, size_t alignment, uint32_t node, bool dma,
+                             bool keep_clean = false);
+    // `alloc_block` under the lock. Falls back to direct reclaim when memory
+    // is out, and wakes the reclaim thread below the low watermark.
+    static void* alloc_slow(size_t count, size_t alignment, uint32_t node, bool dma,
+                            bool keep_clean = false);
     static void free_to_bitmap(size_t page_idx, size_t count);
 
+    // Deferred init. `init_slice` sets up a slice claimed by the caller and
+    // puts its free pages on the buddy lists; whoever finishes the last one
+    // runs `finish_deferred`. `grow_deferred` is the fallback of an allocation
+    // that found nothing: it brings up a slice itself, or waits for one that
+    // another core is on, and returns false once all memory is in.
+    static void init_slice(size_t slice);
+    static bool grow_deferred(uint32_t node);
+    static void finish_deferred();
+
+    // Put every clear run of the bitmap on the buddy lists of the current zones.
+    static void rebuild_free_lists();
+
+    // Fill the huge-frame reserve up to HUGE_POOL_2M / HUGE_POOL_1G frames.
+    static void reserve_huge_pool();
+
     // CPU cache helpers for fast single-page alloc/free. This layer sits
-    // above the bitmap and is completely transparent to callers.
-    static void cache_refill(PerCPUCache& cache);
-    static void cache_flush(PerCPUCache& cache);
+    // above the bitmap and is completely transparent to callers. Pages move
+    // between a CPU and the global depot one full magazine at a time; the
+    // buddy lists (and `pmm_state.lock`) are only reached when the depot
+    // can't satisfy the exchange.
+    static uintptr_t cache_pop(PerCPUCache& cache);
+    static void cache_push(PerCPUCache& cache, uintptr_t page);
+    static void magazine_fill(Magazine& mag, uint32_t node);
+    static void magazine_drain(Magazine& mag);
+    // Empty every full magazine in the depot; the caller holds the lock.
+    static void depot_drain();
+
+    // Shrinker callbacks for the CPU caches and the depot (see `Reclaimer`).
+    static size_t shrink_count(void* ctx);
+    static size_t shrink_scan(void* ctx, size_t nr_pages);
 };
 }  // namespace kernel::memory
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace kernel::memory {
+class UserAddressSpace;
+
+struct PromotionStats {
+    size_t passes;          ///< Scans over every address space.
+    size_t ranges_scanned;  ///< 2MB ranges of user regions looked at.
+    size_t promoted;        ///< Ranges turned into a 2MB mapping.
+    size_t copied;          ///< Of those, ranges whose pages had to be copied.
+};
+
+// Background huge-page promotion. User regions are mapped with 4K pages;
+// once every page of a 2MB-aligned range is populated with the same
+// protection, the range is collapsed into one 2MB mapping so the process
+// gets the TLB reach without asking for huge pages.
+class Promoter {
+   public:
+    // Start the promotion thread on the calling core.
+    static void start();
+
+    static PromotionStats get_stats();
+
+   private:
+    static void worker(void* arg);
+
+    // Collapse up to `budget` ranges of `space`. Returns the number collapsed.
+    static size_t scan(UserAddressSpace& space, size_t budget);
+};
+}  // namespace kernel::memory
\ No newline at end of file
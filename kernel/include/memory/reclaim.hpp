@@ -0,0 +1,75 @@
+#pragma once
+
+#include "libs/intrusive_list.hpp"
+#include "libs/spinlock.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace kernel::task {
+struct Thread;
+}
+
+namespace kernel::memory {
+struct ShrinkerTag {};
+
+// A cache that can give memory back under pressure. `count` estimates how
+// many pages `scan` could free right now; `scan` frees up to `nr_pages`
+// and returns how many it did.
+//
+// Direct reclaim calls them from inside a PMM allocation, under whatever
+// locks the allocating caller holds, possibly with interrupts disabled:
+//  - They must not allocate. If one does anyway, that allocation can't
+//    reclaim again on this CPU and simply fails.
+//  - They may take only their own locks and the PMM's, and must never call
+//    into the VMM, which allocates under its own lock.
+//  - One that takes heap locks sets `reenters_heap`. It is then skipped for
+//    callers that can't wait (interrupts off, so an IrqLock may be held),
+//    and only runs when the caller can block or from the reclaim thread.
+struct Shrinker : IntrusiveListNode<ShrinkerTag> {
+    const char* name;
+    size_t (*count)(void* ctx);
+    size_t (*scan)(void* ctx, size_t nr_pages);
+    void* ctx;
+    bool reenters_heap;
+};
+
+struct ReclaimStats {
+    size_t kswapd_wakeups;   ///< Times the reclaim thread was woken at the low watermark.
+    size_t direct_reclaims;  ///< Allocations that had to reclaim memory themselves.
+    size_t pages_reclaimed;  ///< Pages handed back by shrinkers, from either path.
+};
+
+// Page reclaim. The PMM wakes a background thread when free memory falls
+// below the low watermark, and reclaims synchronously only when an
+// allocation would fail.
+class Reclaimer {
+   public:
+    // Start the reclaim thread on the calling core.
+    static void start();
+
+    static void register_shrinker(Shrinker& shrinker);
+    static void unregister_shrinker(Shrinker& shrinker);
+
+    // Run the shrinkers until `nr_pages` were freed. Returns the pages freed.
+    static size_t direct_reclaim(size_t nr_pages);
+
+    // Ask for background reclaim; only sets a flag, so any context may call it.
+    static void wake();
+    // For the scheduler tick on `cpu_id`: the reclaim thread, if it sleeps
+    // there and was asked to run.
+    static task::Thread* pending_wakeup(uint32_t cpu_id);
+
+    static ReclaimStats get_stats();
+
+   private:
+    static void worker(void* arg);
+    static size_t shrink(size_t nr_pages, bool may_wait);
+
+    struct Registry {
+        SpinLock lock;
+        IntrusiveList<Shrinker, ShrinkerTag> shrinkers;
+    };
+
+    static Registry& registry();
+};
+}  // namespace kernel::memory
\ No newline at end of file
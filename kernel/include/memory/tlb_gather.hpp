@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "memory/memory.hpp"
+
+namespace kernel::memory {
+class PageMap;
+
+// Everything one unmap operation tears down. Unmapped ranges and the frames
+// and page tables behind them are collected as the entries are cleared;
+// `finish` (or the destructor) then flushes the TLB once for the whole range
+// and drops the mappings' references on the frames in a batch, freeing the
+// ones nobody else holds. Nothing is freed before the flush, so no core can
+// still reach a frame through a stale translation or a cached page-table walk.
+class TlbGather {
+   public:
+    explicit TlbGather(PageMap* map) : map(map) {}
+    ~TlbGather();
+
+    TlbGather(const TlbGather&)            = delete;
+    TlbGather& operator=(const TlbGather&) = delete;
+
+    // A leaf mapping of `size` bytes at `virt_addr` was cleared
+    void add_range(uintptr_t virt_addr, size_t size);
+    void add_frame(uintptr_t phys, PageSize size);
+    // `clean` if the table is all zeroes, so it can skip the zeroing pool
+    void add_table(uintptr_t phys, bool clean);
+
+    // Flush and free what was gathered so far. The gather can be reused.
+    void finish();
+
+   private:
+    static constexpr size_t LOCAL_ENTRIES = 32;
+
+    // Overflow storage, one PMM page each, taken only for big unmaps
+    struct Batch {
+        Batch* next;
+        size_t count;
+        uintptr_t entries[(PAGE_SIZE_4K / sizeof(uintptr_t)) - 2];
+    };
+
+    void add_entry(uintptr_t entry);
+    static void release(uintptr_t* entries, size_t count);
+
+    PageMap* map;
+
+    uintptr_t range_start = 0;
+    uintptr_t range_end   = 0;
+
+    // Frame address with its kind in the low bits
+    uintptr_t local[LOCAL_ENTRIES];
+    size_t local_count = 0;
+    Batch* batches     = nullptr;
+};
+}  // namespace kernel::memory
\ No newline at end of file
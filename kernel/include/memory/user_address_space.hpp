@@ -1,6 +1,7 @@
 #pragma once
 
 #include "memory/pagemap.hpp"
+#include "libs/intrusive_list.hpp"
 #include "libs/mutex.hpp"
 #include "libs/spinlock.hpp"
 #include "memory/pagemap.hpp"
@@ -47,7 +48,9 @@ class UserVmRegionAllocator {
     SpinLock lock;
 };
 
-class UserAddressSpace {
+struct AddressSpaceTag {};
+
+class UserAddressSpace : public IntrusiveListNode<AddressSpaceTag> {
    public:
     static constexpr uintptr_t USER_START = 0x1000;
     static constexpr uintptr_t USER_END   = 0x00007FFFFFFFFFFF;
@@ -64,10 +67,27 @@ class UserAddressSpace {
     bool handle_page_fault(uintptr_t fault_addr, size_t error_code);
 
    private:
+    // The compactor walks every address space to find and move user pages,
+    // the promoter to find ranges it can map with huge pages. mprotect
+    // splits and rewrites PTEs, so it takes the same mutex as both.
+    friend class Compactor;
+    friend class Promoter;
+    friend struct task::Process;
+
+    // Every initialized address space, so the compactor can find the owner
+    // of a physical page.
+    struct Registry {
+        Mutex lock;
+        IntrusiveList<UserAddressSpace, AddressSpaceTag> spaces;
+    };
+
+    static Registry& registry();
+
     uintptr_t find_hole(size_t size, size_t alignment);
     uintptr_t find_hole(UserVmRegion* node, size_t size, size_t alignment);
 
-    bool populate(uintptr_t start, size_t size, uint8_t flags, CacheType cache);
+    // Back the holes of [start, start + size) with pages of up to `type`
+    bool populate(uintptr_t start, size_t size, uint8_t flags, CacheType cache, PageSize type);
 
     UserVmRegion* find_region_containing(uintptr_t addr);
     bool check_overlap(uintptr_t start, size_t size);
@@ -86,7 +106,7 @@ class UserAddressSpace {
     UserVmRegion* predecessor(UserVmRegion* node);
     UserVmRegion* successor(UserVmRegion* node);
 
-    void free_tree(UserVmRegion* node);
+    void free_tree(UserVmRegion* node, TlbGather& gather);
 
     Mutex mutex;
     PageMap* page_map;
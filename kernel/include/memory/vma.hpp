@@ -54,6 +54,8 @@ class VirtualMemoryAllocator {
 
     void* reserve(size_t size, size_t alignment, uint8_t flags);
     void free(void* ptr, bool free_phys);
+    // Extend the region at `ptr` to `size` bytes over the gap that follows it
+    bool grow(void* ptr, size_t size);
 
    private:
     void map(uintptr_t virt_addr, size_t size, uint8_t flags, CacheType cache);
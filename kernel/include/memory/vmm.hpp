@@ -16,6 +16,9 @@ class VirtualManager {
     static void* allocate(size_t count, PageSize size = PageSize::Size4K,
                           uint8_t flags = Read | Write, CacheType cache = CacheType::WriteBack);
     static void free(void* ptr, bool free_phys = true);
+    // Grow the allocation at `ptr` to `count` 4K pages without moving it.
+    // Fails if the virtual space right after it is taken.
+    static bool grow(void* ptr, size_t count);
 
     // Returns an unmapped, aligned virtual region that callers can
     // manually map to device physical addresses. Only the virtual space
@@ -32,6 +35,7 @@ class VirtualManager {
 };
 
 struct ScopedAddressSpaceSwitch {
+    task::Process* old_proc;
     PageMap* old_map;
     uint16_t old_pcid;
 
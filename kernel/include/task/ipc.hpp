@@ -15,7 +15,10 @@ struct IPCMessage {
     size_t message_id;
 };
 
-struct IPCPort {
+// Ports are too big for kmalloc's classes; they get their own kmem cache
+struct IPCPort : memory::KmemCached<IPCPort> {
+    static constexpr const char* kmem_cache_name = "ipc_port";
+
     size_t id;
     SpinLock lock;
 
@@ -4,6 +4,7 @@
 #include "memory/pagemap.hpp"
 #include "libs/spinlock.hpp"
 #include "libs/intrusive_list.hpp"
+#include "memory/kmem_cache.hpp"
 #include "memory/user_address_space.hpp"
 
 #define PROT_READ  0x01
@@ -34,9 +35,13 @@ struct SchedulerTag {};
 struct ProcessTag {};
 struct WaitTag {};
 
+// Threads and processes live in their own kmem caches
 struct Thread : public IntrusiveListNode<SchedulerTag>,
                 public IntrusiveListNode<ProcessTag>,
-                public IntrusiveListNode<WaitTag> {
+                public IntrusiveListNode<WaitTag>,
+                public memory::KmemCached<Thread> {
+    static constexpr const char* kmem_cache_name = "thread";
+
     size_t tid;
     uintptr_t kernel_stack_ptr;
 
@@ -66,7 +71,9 @@ struct Thread : public IntrusiveListNode<SchedulerTag>,
     static std::align_val_t fpu_alignment;
 };
 
-struct Process : public IntrusiveListNode<ProcessTag> {
+struct Process : public IntrusiveListNode<ProcessTag>, public memory::KmemCached<Process> {
+    static constexpr const char* kmem_cache_name = "process";
+
     size_t pid;
     memory::PageMap* map;
     SpinLock lock;
@@ -39,6 +39,9 @@ struct Scheduler {
     bool check_for_higher_priority(int curr_level);
 
     Thread* get_next_thread();
+    // Load `next_proc`'s address space unless the core already runs on it
+    // or `next_proc` is the kernel, which borrows whatever is loaded.
+    void switch_address_space(Process* next_proc);
     Thread* try_steal();
 
     uint32_t cpu_id;
@@ -1,14 +1,22 @@
 #include <new>
 #include "memory/heap.hpp"
+#include "memory/heap_profile.hpp"
 
 using namespace kernel::memory;
 
+// The operators allocate from the heap directly rather than through kmalloc,
+// so the heap profiler charges their caller instead of this file.
+
 void* operator new(std::size_t size) {
-    return kmalloc(size);
+    void* ptr = SlubAllocator::get().allocate(size);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
 }
 
 void* operator new[](std::size_t size) {
-    return kmalloc(size);
+    void* ptr = SlubAllocator::get().allocate(size);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
 }
 
 void operator delete(void* ptr) {
@@ -19,20 +27,24 @@ void operator delete[](void* ptr) {
     kfree(ptr);
 }
 
-void operator delete(void* ptr, std::size_t) {
-    kfree(ptr);
+void operator delete(void* ptr, std::size_t size) {
+    kfree_sized(ptr, size);
 }
 
-void operator delete[](void* ptr, std::size_t) {
-    kfree(ptr);
+void operator delete[](void* ptr, std::size_t size) {
+    kfree_sized(ptr, size);
 }
 
 void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
-    return kmalloc(size);
+    void* ptr = SlubAllocator::get().allocate(size);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
 }
 
 void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
-    return kmalloc(size);
+    void* ptr = SlubAllocator::get().allocate(size);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
 }
 
 void operator delete(void* ptr, const std::nothrow_t&) noexcept {
@@ -44,19 +56,39 @@ void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
 }
 
 void* operator new(std::size_t size, std::align_val_t align) {
-    return aligned_kalloc(size, static_cast<size_t>(align));
+    void* ptr = SlubAllocator::get().allocate_aligned(size, static_cast<size_t>(align));
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
 }
 
 void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
-    return aligned_kalloc(size, static_cast<size_t>(align));
+    void* ptr = SlubAllocator::get().allocate_aligned(size, static_cast<size_t>(align));
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
 }
 
 void* operator new[](std::size_t size, std::align_val_t align) {
-    return aligned_kalloc(size, static_cast<size_t>(align));
+    void* ptr = SlubAllocator::get().allocate_aligned(size, static_cast<size_t>(align));
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
 }
 
 void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
-    return aligned_kalloc(size, static_cast<size_t>(align));
+    void* ptr = SlubAllocator::get().allocate_aligned(size, static_cast<size_t>(align));
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
+}
+
+void operator delete(void* ptr, std::align_val_t) {
+    aligned_kfree(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    aligned_kfree(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) {
+    aligned_kfree(ptr);
 }
 
 void operator delete[](void* ptr, std::align_val_t) {
@@ -66,3 +98,7 @@ void operator delete[](void* ptr, std::align_val_t) {
 void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
     aligned_kfree(ptr);
 }
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) {
+    aligned_kfree(ptr);
+}
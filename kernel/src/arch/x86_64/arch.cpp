@@ -49,6 +49,33 @@ void pause() {
     asm volatile("pause");
 }
 
+void wait_for_interrupt() {
+    asm volatile("hlt");
+}
+
+void zero_page_nt(void* page) {
+    uint64_t* ptr = static_cast<uint64_t*>(page);
+
+    // `movnti` only needs a GPR source, so this works under -mgeneral-regs-only.
+    for (size_t i = 0; i < 4096 / sizeof(uint64_t); i += 8) {
+        asm volatile(
+            "movnti %1, 0(%0)\n\t"
+            "movnti %1, 8(%0)\n\t"
+            "movnti %1, 16(%0)\n\t"
+            "movnti %1, 24(%0)\n\t"
+            "movnti %1, 32(%0)\n\t"
+            "movnti %1, 40(%0)\n\t"
+            "movnti %1, 48(%0)\n\t"
+            "movnti %1, 56(%0)"
+            :
+            : "r"(ptr + i), "r"(0ull)
+            : "memory");
+    }
+
+    // Non-temporal stores are weakly ordered; fence before the page is published.
+    asm volatile("sfence" ::: "memory");
+}
+
 void disable_interrupts() {
     asm volatile("cli");
 }
@@ -0,0 +1,186 @@
+#include "cpu/bitscan.hpp"
+#include "cpu/features.hpp"
+#include "cpu/registers.hpp"
+#include "cpu/simd.hpp"
+#include "libs/log.hpp"
+
+extern "C" size_t bitscan_find_word_avx2(const uint64_t* words, size_t start, size_t end,
+                                         uint64_t skip);
+extern "C" size_t bitscan_find_word_avx512(const uint64_t* words, size_t start, size_t end,
+                                           uint64_t skip);
+extern "C" size_t bitscan_popcount_avx2(const uint64_t* words, size_t blocks);
+extern "C" size_t bitscan_summarize_avx2(const uint64_t* words, size_t chunks,
+                                         uint64_t* summary);
+
+namespace kernel::cpu::arch {
+namespace {
+enum class ScanImpl : uint8_t {
+    Scalar,
+    AVX2,
+    AVX512,
+};
+
+ScanImpl scan_impl = ScanImpl::Scalar;
+
+// Below this many words the XSAVE/XRSTOR around a vector kernel costs more
+// than the scalar loop it replaces.
+constexpr size_t VECTOR_MIN_WORDS = 256;
+
+constexpr uint8_t bit_count = 64;
+
+// Claims the vector registers for one kernel call, if it is worth it.
+class VectorScope {
+   public:
+    explicit VectorScope(size_t words)
+        : active((scan_impl != ScanImpl::Scalar) && (words >= VECTOR_MIN_WORDS) &&
+                 SIMD::kernel_begin()) {}
+
+    ~VectorScope() {
+        if (this->active) {
+            SIMD::kernel_end();
+        }
+    }
+
+    VectorScope(const VectorScope&)            = delete;
+    VectorScope& operator=(const VectorScope&) = delete;
+
+    explicit operator bool() const {
+        return this->active;
+    }
+
+   private:
+    bool active;
+};
+}  // namespace
+
+void BitScan::init() {
+    using namespace kernel::arch;
+
+    if (!check_feature(FEATURE_AVX2)) {
+        LOG_INFO("BitScan: using scalar kernels");
+        return;
+    }
+
+    // The per-CPU bring-up repeats this later; PMM init just runs earlier.
+    SIMD::init();
+
+    if ((SIMD::get_mode() != AVX) && (SIMD::get_mode() != AVXOpt)) {
+        LOG_INFO("BitScan: AVX state not enabled, using scalar kernels");
+        return;
+    }
+
+    Xcr0 xcr0 = Xcr0::read();
+
+    if (check_feature(FEATURE_AVX512F) && xcr0.opmask && xcr0.zmm_hi256 && xcr0.hi16_zmm) {
+        scan_impl = ScanImpl::AVX512;
+        LOG_INFO("BitScan: using AVX-512 kernels");
+    } else {
+        scan_impl = ScanImpl::AVX2;
+        LOG_INFO("BitScan: using AVX2 kernels");
+    }
+}
+
+size_t BitScan::find_word(const uint64_t* words, size_t start, size_t end, uint64_t skip) {
+    if (start >= end) {
+        return end;
+    }
+
+    if (VectorScope scope{end - start}) {
+        if (scan_impl == ScanImpl::AVX512) {
+            return bitscan_find_word_avx512(words, start, end, skip);
+        }
+
+        return bitscan_find_word_avx2(words, start, end, skip);
+    }
+
+    while ((start < end) && (words[start] == skip)) {
+        start++;
+    }
+
+    return start;
+}
+
+size_t BitScan::find_first_zero(const uint64_t* words, size_t start, size_t end) {
+    while (start < end) {
+        size_t word = start / bit_count;
+        size_t bit  = start % bit_count;
+
+        // Partial word first; inverted so set bits mark free pages.
+        uint64_t bits = ~words[word] & (~0ull << bit);
+
+        if (bits != 0) {
+            size_t idx = (word * bit_count) + static_cast<size_t>(__builtin_ctzll(bits));
+            return (idx < end) ? idx : end;
+        }
+
+        // Then skip whole words that are all ones.
+        size_t end_word = (end + bit_count - 1) / bit_count;
+        word            = find_word(words, word + 1, end_word, ~0ull);
+        start           = word * bit_count;
+    }
+
+    return end;
+}
+
+size_t BitScan::find_first_set(const uint64_t* words, size_t start, size_t end) {
+    while (start < end) {
+        size_t word = start / bit_count;
+        size_t bit  = start % bit_count;
+
+        uint64_t bits = words[word] & (~0ull << bit);
+
+        if (bits != 0) {
+            size_t idx = (word * bit_count) + static_cast<size_t>(__builtin_ctzll(bits));
+            return (idx < end) ? idx : end;
+        }
+
+        size_t end_word = (end + bit_count - 1) / bit_count;
+        word            = find_word(words, word + 1, end_word, 0);
+        start           = word * bit_count;
+    }
+
+    return end;
+}
+
+size_t BitScan::popcount(const uint64_t* words, size_t count) {
+    size_t total = 0;
+    size_t done  = 0;
+
+    if (VectorScope scope{count}) {
+        done  = count & ~size_t{3};
+        total = bitscan_popcount_avx2(words, done / 4);
+    }
+
+    for (size_t i = done; i < count; ++i) {
+        total += static_cast<size_t>(__builtin_popcountll(words[i]));
+    }
+
+    return total;
+}
+
+size_t BitScan::summarize(const uint64_t* words, size_t count, uint64_t* summary) {
+    size_t total = 0;
+    size_t done  = 0;
+
+    // AVX-512F has no byte shuffle or popcount of its own, so the AVX2
+    // kernel serves both paths here.
+    if (VectorScope scope{count}) {
+        done  = count & ~size_t{bit_count - 1};
+        total = bitscan_summarize_avx2(words, done / bit_count, summary);
+    }
+
+    for (size_t i = done; i < count; ++i) {
+        if ((i % bit_count) == 0) {
+            summary[i / bit_count] = 0;
+        }
+
+        if (words[i] == ~0ull) {
+            summary[i / bit_count] |= (1ull << (i % bit_count));
+        }
+
+        total += static_cast<size_t>(__builtin_popcountll(words[i]));
+    }
+
+    return total;
+}
+}  // namespace kernel::cpu::arch
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <cstdint>
 #include "cpu/registers.hpp"
 #include "cpu/features.hpp"
+#include "hal/smp_manager.hpp"
 
 namespace kernel::cpu::arch {
 namespace {
@@ -30,6 +31,9 @@ inline void xsaveopt(void* buffer) {
     constexpr uint32_t high = 0xFFFFFFFF;
     asm volatile("xsaveopt (%0)" ::"r"(buffer), "a"(low), "d"(high) : "memory");
 }
+
+// Before GS is loaded there are no threads whose state could be clobbered.
+bool boot_claimed = false;
 }  // namespace
 
 FpuMode SIMD::mode       = None;
@@ -142,4 +146,48 @@ void SIMD::restore(void* buffer) {
             break;
     }
 }
+
+bool SIMD::kernel_begin() {
+    if ((mode != AVX) && (mode != AVXOpt)) {
+        return false;
+    }
+
+    if (!cpu::percpu_available) {
+        if (boot_claimed) {
+            return false;
+        }
+
+        boot_claimed = true;
+        return true;
+    }
+
+    cpu::preempt_disable();
+
+    CpuData& data = CpuCoreManager::get().get_current_core()->arch;
+
+    // Nested use (an interrupt landing inside another user) stays scalar.
+    if (data.simd_busy || (data.simd_area == nullptr)) {
+        cpu::preempt_enable();
+        return false;
+    }
+
+    data.simd_busy = true;
+    save(data.simd_area);
+
+    return true;
+}
+
+void SIMD::kernel_end() {
+    if (!cpu::percpu_available) {
+        boot_claimed = false;
+        return;
+    }
+
+    CpuData& data = CpuCoreManager::get().get_current_core()->arch;
+
+    restore(data.simd_area);
+    data.simd_busy = false;
+
+    cpu::preempt_enable();
+}
 }  // namespace kernel::cpu::arch
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "uacpi/status.h"
 #include "uacpi/tables.h"
 #include "hal/apic.hpp"
+#include "hal/numa.hpp"
 
 namespace kernel::hal {
 namespace {
@@ -121,6 +122,90 @@ void ACPI::parse_tables() {
     LOG_INFO("ACPI: MADT parse complete (lapic/ioapic/iso/x2apic lists built)");
 }
 
+void ACPI::parse_numa() {
+    uacpi_table out_table;
+
+    if (uacpi_table_find_by_signature(ACPI_SRAT_SIGNATURE, &out_table) != UACPI_STATUS_OK) {
+        LOG_INFO("ACPI: SRAT not found; treating system as a single NUMA node");
+        Numa::finalize();
+        return;
+    }
+
+    // SRAT is only needed during boot, so walk it in place instead of copying.
+    acpi_srat* srat       = static_cast<acpi_srat*>(out_table.ptr);
+    const uintptr_t start = reinterpret_cast<uintptr_t>(srat->entries);
+    const uintptr_t end   = reinterpret_cast<uintptr_t>(srat) + srat->hdr.length;
+
+    for (uintptr_t entry = start; entry < end;) {
+        auto* entry_hdr = reinterpret_cast<acpi_entry_hdr*>(entry);
+
+        if (entry_hdr->length == 0) {
+            LOG_WARN("ACPI: malformed SRAT entry at %p", reinterpret_cast<void*>(entry));
+            break;
+        }
+
+        switch (entry_hdr->type) {
+            case ACPI_SRAT_ENTRY_TYPE_PROCESSOR_AFFINITY: {
+                auto* cpu = reinterpret_cast<acpi_srat_processor_affinity*>(entry);
+
+                if (cpu->flags & ACPI_SRAT_PROCESSOR_ENABLED) {
+                    // The proximity domain is split across two fields in this entry type.
+                    uint32_t domain = cpu->proximity_domain_low |
+                                      (uint32_t(cpu->proximity_domain_high[0]) << 8) |
+                                      (uint32_t(cpu->proximity_domain_high[1]) << 16) |
+                                      (uint32_t(cpu->proximity_domain_high[2]) << 24);
+
+                    Numa::add_cpu(cpu->id, domain);
+                    LOG_DEBUG("ACPI: SRAT cpu apic_id=%u domain=%u", cpu->id, domain);
+                }
+                break;
+            }
+            case ACPI_SRAT_ENTRY_TYPE_X2APIC_AFFINITY: {
+                auto* x2 = reinterpret_cast<acpi_srat_x2apic_affinity*>(entry);
+
+                if (x2->flags & ACPI_SRAT_X2APIC_ENABLED) {
+                    Numa::add_cpu(x2->id, x2->proximity_domain);
+                    LOG_DEBUG("ACPI: SRAT x2apic id=%u domain=%u", x2->id, x2->proximity_domain);
+                }
+                break;
+            }
+            case ACPI_SRAT_ENTRY_TYPE_MEMORY_AFFINITY: {
+                auto* mem = reinterpret_cast<acpi_srat_memory_affinity*>(entry);
+
+                if ((mem->flags & ACPI_SRAT_MEMORY_ENABLED) && (mem->length != 0)) {
+                    Numa::add_memory(mem->proximity_domain, mem->address, mem->length);
+                    LOG_DEBUG("ACPI: SRAT memory base=0x%lx len=0x%lx domain=%u", mem->address,
+                              mem->length, mem->proximity_domain);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+
+        entry += entry_hdr->length;
+    }
+
+    uacpi_table_unref(&out_table);
+
+    // SLIT is optional; without it every remote node is equally far away.
+    if (uacpi_table_find_by_signature(ACPI_SLIT_SIGNATURE, &out_table) == UACPI_STATUS_OK) {
+        acpi_slit* slit   = static_cast<acpi_slit*>(out_table.ptr);
+        size_t localities = slit->num_localities;
+
+        for (size_t from = 0; from < localities; ++from) {
+            for (size_t to = 0; to < localities; ++to) {
+                Numa::set_distance(static_cast<uint32_t>(from), static_cast<uint32_t>(to),
+                                   slit->matrix[(from * localities) + to]);
+            }
+        }
+
+        uacpi_table_unref(&out_table);
+    }
+
+    Numa::finalize();
+}
+
 LapicInfo* LapicInfo::head() {
     return lapic_list;
 }
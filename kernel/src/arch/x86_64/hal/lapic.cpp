@@ -479,4 +479,12 @@ uint64_t Lapic::get_ticks_ns() {
     // Convert TSC ticks to nanoseconds using the per-ms calibration.
     return (now * 1000000) / ticks_per_ms;
 }
+
+uint64_t Lapic::tsc_to_ns(uint64_t tsc) {
+    if (tsc_per_ms < 1000) {
+        return 0;
+    }
+
+    return (tsc * 1000) / (tsc_per_ms / 1000);
+}
 }  // namespace kernel::hal
\ No newline at end of file
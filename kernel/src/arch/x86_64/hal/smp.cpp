@@ -10,6 +10,7 @@
 #include "libs/log.hpp"
 #include "memory/pagemap.hpp"
 #include "memory/paging.hpp"
+#include "memory/pmm.hpp"
 
 extern "C" void syscall_entry();
 
@@ -21,6 +22,14 @@ std::byte* df_stack  = nullptr;
 struct TLBRequest {
     uintptr_t start_addr;
     size_t page_count;
+    std::atomic<size_t> pending;  // Targets that haven't flushed yet
+};
+
+// One sender's request queued on one target. Each core owns a slot per
+// target, so it can post to all of them without any shared lock.
+struct TLBSlot {
+    TLBRequest* request;
+    TLBSlot* next;
 };
 
 struct FuncCallRequest {
@@ -29,12 +38,73 @@ struct FuncCallRequest {
     uint32_t target_apic_id;
 };
 
-volatile TLBRequest tlb_request_mailbox;
+// `TLBRequest::page_count` asking for a flush of every address space.
+constexpr size_t flush_all_pages = static_cast<size_t>(-1);
+
+// `FuncCallRequest::target_apic_id` addressing every core but the sender.
+constexpr uint32_t call_all_cores = static_cast<uint32_t>(-1);
+
+TLBRequest* tlb_requests           = nullptr;  // One per sender
+TLBSlot* tlb_slots                 = nullptr;  // [sender * tlb_cores + target]
+std::atomic<TLBSlot*>* tlb_inboxes = nullptr;  // Pending slots per target, LIFO
+size_t tlb_cores                   = 0;
+
 volatile FuncCallRequest call_request_mailbox;
 
 std::atomic<size_t> pending_acks(0);
 SpinLock smp_lock;
 
+void flush_all_contexts() {
+    // Without INVPCID a CR3 reload only drops the active PCID; toggling PGE
+    // drops them all.
+    if (memory::TLB::has_invpcid) {
+        memory::TLB::flush_all();
+    } else {
+        memory::TLB::flush_hard();
+    }
+}
+
+void flush_range(uintptr_t start, size_t count) {
+    if (count == flush_all_pages) {
+        flush_all_contexts();
+    } else if (count > memory::TLB::FLUSH_CEILING) {
+        // A CR3 reload only drops the current PCID, and keeps global entries
+        if (memory::PageMap::is_kernel_half(start)) {
+            memory::TLB::flush_hard();
+        } else {
+            kernel::arch::Cr3::read().write();
+        }
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            memory::TLB::flush(start + (i * memory::PAGE_SIZE_4K));
+        }
+    }
+}
+
+void post_tlb_slot(uint32_t target, TLBSlot* slot) {
+    TLBSlot* head = tlb_inboxes[target].load(std::memory_order_relaxed);
+
+    do {
+        slot->next = head;
+    } while (!tlb_inboxes[target].compare_exchange_weak(head, slot, std::memory_order_release,
+                                                        std::memory_order_relaxed));
+}
+
+void drain_tlb_inbox(uint32_t idx) {
+    TLBSlot* slot = tlb_inboxes[idx].exchange(nullptr, std::memory_order_acquire);
+
+    while (slot) {
+        TLBSlot* next       = slot->next;
+        TLBRequest* request = slot->request;
+
+        flush_range(request->start_addr, request->page_count);
+
+        // The sender may reuse the slot once this lands
+        request->pending.fetch_sub(1, std::memory_order_release);
+        slot = next;
+    }
+}
+
 class TlbShootDownHandler : public IInterruptHandler {
    public:
     const char* name() const {
@@ -42,15 +112,7 @@ class TlbShootDownHandler : public IInterruptHandler {
     }
 
     IrqStatus handle(arch::TrapFrame* frame) {
-        uintptr_t addr = tlb_request_mailbox.start_addr;
-        size_t count   = tlb_request_mailbox.page_count;
-
-        for (size_t i = 0; i < count; ++i) {
-            memory::TLB::flush(addr + (i * memory::PAGE_SIZE_4K));
-        }
-
-        pending_acks.fetch_sub(1, std::memory_order_release);
-
+        drain_tlb_inbox(current_core_idx());
         return IrqStatus::Handled;
     }
 };
@@ -64,7 +126,9 @@ class RemoteCallHandler : public IInterruptHandler {
     IrqStatus handle(arch::TrapFrame* frame) {
         uint32_t apic_id = cpu::CpuCoreManager::get().get_current_core()->apic_id;
 
-        if (call_request_mailbox.target_apic_id == apic_id) {
+        uint32_t target = call_request_mailbox.target_apic_id;
+
+        if ((target == apic_id) || (target == call_all_cores)) {
             if (call_request_mailbox.func) {
                 call_request_mailbox.func(call_request_mailbox.arg);
             }
@@ -106,26 +170,50 @@ void PerCpuData::arch_init() {
         PANIC("IST Stack Allocation failed!");
     }
 
+    if (tlb_inboxes == nullptr) {
+        tlb_cores = mp_request.response->cpu_count;
+
+        if (tlb_cores > CpuMask::MAX_CPUS) {
+            tlb_cores = CpuMask::MAX_CPUS;
+        }
+
+        tlb_requests = new TLBRequest[tlb_cores]();
+        tlb_slots    = new TLBSlot[tlb_cores * tlb_cores]();
+        tlb_inboxes  = new std::atomic<TLBSlot*>[tlb_cores]();
+
+        if (!tlb_requests || !tlb_slots || !tlb_inboxes) {
+            PANIC("TLB shootdown queue allocation failed!");
+        }
+    }
+
     this->arch.gdt->set_ist(0, reinterpret_cast<uintptr_t>(nmi_stack) + 0x1000);
     this->arch.gdt->set_ist(1, reinterpret_cast<uintptr_t>(df_stack) + 0x1000);
 
     this->arch.gdt->setup_gdt();
     this->arch.gdt->setup_tss(this->kstack_top);
+
+    // XSAVE needs a 64-byte aligned area.
+    this->arch.simd_area = new (std::align_val_t(64)) std::byte[arch::SIMD::get_save_size()];
 }
 
 void PerCpuData::commit() {
     this->arch.gdt->load_tables();
-    arch::IDTManager::load_table();
-
-    hal::Lapic::init();
-    hal::Lapic::calibrate();
-    arch::SIMD::init();
 
+    // Right after the segment reload (which clears it): LAPIC setup may
+    // already allocate through the per-CPU caches.
     kernel::arch::Msr msr;
     msr.index = MSR_GS_BASE;
     msr.value = reinterpret_cast<uintptr_t>(this);
     msr.write();
 
+    percpu_available = true;
+
+    arch::IDTManager::load_table();
+
+    hal::Lapic::init();
+    hal::Lapic::calibrate();
+    arch::SIMD::init();
+
     hal::Timer::init();
 
     kernel::arch::enable_interrupts();
@@ -137,17 +225,18 @@ void PerCpuData::commit() {
 
 void CpuCoreManager::ap_main(PerCpuData* data) {
     data->arch.gdt->load_tables();
-    arch::IDTManager::load_table();
-
-    hal::Lapic::init();
-    hal::Lapic::calibrate();
-    arch::SIMD::init();
 
     kernel::arch::Msr msr;
     msr.index = MSR_GS_BASE;
     msr.value = reinterpret_cast<uintptr_t>(data);
     msr.write();
 
+    arch::IDTManager::load_table();
+
+    hal::Lapic::init();
+    hal::Lapic::calibrate();
+    arch::SIMD::init();
+
     hal::Timer::init();
 
     data->is_online.store(true);
@@ -157,6 +246,10 @@ void CpuCoreManager::ap_main(PerCpuData* data) {
 
     LOG_INFO("AP Core %u (APIC %u) is online!", data->core_idx, data->apic_id);
 
+    // Help bring up the memory the PMM left for after SMP; the BSP joins
+    // in once every AP is online.
+    memory::PhysicalManager::init_deferred();
+
     kernel::arch::halt(true);
 }
 
@@ -182,7 +275,10 @@ PerCpuData::PerCpuData(uint32_t idx, limine_mp_info* info)
       core_idx(idx),
       apic_id(info->lapic_id),
       pcid_manager(new memory::PcidManager),
-      arch() {
+      arch(),
+      preempt_count(0),
+      active_proc(nullptr),
+      in_reclaim(false) {
     this->is_bsp = (info->lapic_id == mp_request.response->bsp_lapic_id);
     this->is_online.store(this->is_bsp);
 }
@@ -215,19 +311,78 @@ void CpuCoreManager::wait_for_acks() {
     }
 }
 
+void CpuCoreManager::tlb_shootdown(const CpuMask& targets, uintptr_t start, size_t count) {
+    CpuCoreManager& manager = get();
+
+    bool int_enabled = kernel::arch::interrupt_status();
+    kernel::arch::disable_interrupts();
+
+    uint32_t self       = manager.get_current_core()->core_idx;
+    TLBRequest& request = tlb_requests[self];
+    bool flush_self     = false;
+
+    request.start_addr = start;
+    request.page_count = count;
+    request.pending.store(0, std::memory_order_relaxed);
+
+    targets.for_each([&](uint32_t cpu) {
+        if (cpu == self) {
+            flush_self = true;
+            return;
+        }
+
+        if (cpu >= tlb_cores) {
+            return;
+        }
+
+        PerCpuData* core = manager.get_core_by_index(cpu);
+
+        if (!core->is_online.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        // Count it before posting, so the target can't ack below zero
+        request.pending.fetch_add(1, std::memory_order_relaxed);
+        TLBSlot* slot = &tlb_slots[(self * tlb_cores) + cpu];
+        slot->request = &request;
+
+        post_tlb_slot(cpu, slot);
+        manager.send_ipi(core->apic_id, IPI_TLB_SHOOTDOWN_VECTOR);
+    });
+
+    // Our own flush overlaps with the others'
+    if (flush_self) {
+        flush_range(start, count);
+    }
+
+    // Keep serving our inbox: a core shooting at us waits with interrupts
+    // off too, and would otherwise never see our IPI.
+    while (request.pending.load(std::memory_order_acquire) > 0) {
+        drain_tlb_inbox(self);
+        kernel::arch::pause();
+    }
+
+    if (int_enabled) {
+        kernel::arch::enable_interrupts();
+    }
+}
+
 void CpuCoreManager::tlb_shootdown(uintptr_t virt_addr) {
     tlb_shootdown(virt_addr, 1);
 }
 
-void CpuCoreManager::tlb_shootdown(uintptr_t virt_addr, size_t count) {
-    LockGuard guard(smp_lock);
+void CpuCoreManager::tlb_shootdown(uintptr_t start, size_t count) {
+    CpuMask targets;
+    targets.fill(get().get_total_cores());
+
+    tlb_shootdown(targets, start, count);
+}
 
-    tlb_request_mailbox.start_addr = virt_addr;
-    tlb_request_mailbox.page_count = count;
+void CpuCoreManager::tlb_shootdown_all() {
+    CpuMask targets;
+    targets.fill(get().get_total_cores());
 
-    if (send_ipi_to_others(IPI_TLB_SHOOTDOWN_VECTOR)) {
-        wait_for_acks();
-    }
+    tlb_shootdown(targets, 0, flush_all_pages);
 }
 
 void CpuCoreManager::call_on_core(uint32_t core_idx, void (*func)(void*), void* arg) {
@@ -260,6 +415,18 @@ void CpuCoreManager::call_on_core(uint32_t core_idx, void (*func)(void*), void*
     wait_for_acks();
 }
 
+void CpuCoreManager::call_on_others(void (*func)(void*), void* arg) {
+    LockGuard guard(smp_lock);
+
+    call_request_mailbox.func           = func;
+    call_request_mailbox.arg            = arg;
+    call_request_mailbox.target_apic_id = call_all_cores;
+
+    if (send_ipi_to_others(IPI_FUNCTION_CALL_VECTOR)) {
+        wait_for_acks();
+    }
+}
+
 void CpuCoreManager::stop_other_cores() {
     hal::Lapic::broadcast_ipi(IPI_PANIC_VECTOR, false);
 }
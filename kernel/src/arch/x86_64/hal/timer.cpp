@@ -91,6 +91,14 @@ size_t Timer::get_ticks_ns() {
     return 0;
 }
 
+size_t Timer::get_cycles() {
+    return Lapic::rdtsc();
+}
+
+size_t Timer::cycles_to_ns(size_t cycles) {
+    return Lapic::tsc_to_ns(cycles);
+}
+
 void Timer::stop() {
     Lapic::stop_timer();
 
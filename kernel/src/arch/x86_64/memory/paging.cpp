@@ -2,9 +2,12 @@
 #include "memory/pagemap.hpp"
 #include "memory/memory.hpp"
 #include "memory/paging.hpp"
+#include <algorithm>
 #include <cstdint>
+#include <string.h>
 #include "memory/pcid_manager.hpp"
 #include "memory/pmm.hpp"
+#include "memory/tlb_gather.hpp"
 #include "cpu/registers.hpp"
 #include "cpu/regs.h"
 #include "cpu/features.hpp"
@@ -27,6 +30,24 @@ bool support_1g_pages = false;
 bool support_nx       = false;
 bool pcid_supported   = false;
 
+// Keep `PageFrame::mapcount` in step with user leaf entries at `level`.
+// Kernel mappings and frames outside RAM aren't tracked.
+void account_mapping(uint64_t entry, int level, int32_t delta) {
+    if ((entry & (FlagPresent | FlagUser)) != (FlagPresent | FlagUser)) {
+        return;
+    }
+
+    // Bit 12 of a huge entry is the PAT bit, not part of the address.
+    uintptr_t phys = entry & page_mask;
+    if (level > 1) {
+        phys = align_down(phys, PAGE_SIZE_2M);
+    }
+
+    if (PageFrame* frame = PhysicalManager::frame(phys)) {
+        frame->mapcount.fetch_add(static_cast<uint32_t>(delta), std::memory_order_relaxed);
+    }
+}
+
 int get_target_level(PageSize size) {
     switch (size) {
         case PageSize::Size4K:
@@ -40,6 +61,42 @@ int get_target_level(PageSize size) {
     }
 }
 
+// `PageMap::walk` over the [start, end) part of the table at `table_phys`,
+// which sits at `level`. Returns false once `fn` asked to stop.
+bool walk_table(uintptr_t table_phys, int level, uintptr_t start, uintptr_t end,
+                PageMap::LeafFn fn, void* ctx) {
+    uintptr_t* table = reinterpret_cast<uintptr_t*>(to_higher_half(table_phys));
+    int shift        = 12 + (level - 1) * 9;
+    size_t span      = 1ul << shift;
+    uintptr_t virt   = start;
+
+    while (virt < end) {
+        uintptr_t base = align_down(virt, span);
+        uintptr_t next = base + span;
+        uint64_t entry = table[(virt >> shift) & 0x1FF];
+
+        if (!(entry & FlagPresent)) {
+            // Nothing mapped anywhere under this entry
+        } else if ((level == 1) || (entry & FlagHuge)) {
+            if (!fn(ctx, base, align_down(entry & page_mask, span), span)) {
+                return false;
+            }
+        } else if (!walk_table(entry & page_mask, level - 1, virt, std::min(next, end), fn,
+                               ctx)) {
+            return false;
+        }
+
+        // The last entry of the address space
+        if (next == 0) {
+            break;
+        }
+
+        virt = next;
+    }
+
+    return true;
+}
+
 size_t convert_generic_flags(uint8_t flags, CacheType cache, PageSize size) {
     size_t ret       = 0;
     const size_t pat = (size == PageSize::Size4K) ? FlagPAT : FlagLPAT;
@@ -264,17 +321,16 @@ uintptr_t* PageMap::get_pte(uintptr_t virt_addr, int target_level, bool allocate
 
             // Lazily allocate the next page-table level only when needed;
             // this keeps paging structures sparse and reduces memory usage.
-            uintptr_t new_table_phys = reinterpret_cast<uintptr_t>(PhysicalManager::alloc());
+            // The clean pool usually has a pre-zeroed page ready.
+            uintptr_t new_table_phys =
+                reinterpret_cast<uintptr_t>(PhysicalManager::alloc_clear());
             if (new_table_phys == 0) {
                 LOG_ERROR("PageMap: failed to allocate page table at level=%d", level);
                 return nullptr;
             }
 
-            uintptr_t* new_table_virt =
-                reinterpret_cast<uintptr_t*>(to_higher_half(new_table_phys));
-
-            for (int i = 0; i < 512; ++i) {
-                new_table_virt[i] = 0;
+            if (PageFrame* frame = PhysicalManager::frame(new_table_phys)) {
+                frame->flags |= FramePageTable;
             }
 
             uint64_t new_entry = new_table_phys | FlagPresent | FlagWrite | FlagUser;
@@ -325,51 +381,44 @@ bool PageMap::map(uintptr_t virt_addr, uintptr_t phys_addr, uint8_t flags, Cache
 
     // Apply PKEY (Bits 59-62)
     entry |= (static_cast<uint64_t>(pkey & 0xF) << 59);
+
+    uint64_t old = *pte;
+
+    account_mapping(old, target_level, -1);
+    account_mapping(entry, target_level, 1);
     *pte = entry;
 
-    if (this->is_active()) {
-        if (do_flush) {
-            TLB::flush(virt_addr);
-        }
-    } else {
-        if (do_flush) {
-            uint16_t pcid = this->get_root_phys() & 0xFFF;
-            TLB::flush_specific(virt_addr, pcid);
-        }
+    // Only a present entry can be cached, here or on any core using the map
+    if (do_flush && (old & FlagPresent)) {
+        this->flush_tlb(virt_addr, 1);
     }
 
     return true;
 }
 
 bool PageMap::map(uintptr_t virt_addr, uint8_t flags, CacheType cache, PageSize size,
-                  bool do_flush) {
-    size_t frames_needed = 0;
-    uintptr_t phys_addr  = 0;
+                  bool do_flush, bool use_reserve) {
+    uintptr_t phys_addr = 0;
 
     switch (size) {
         case PageSize::Size4K:
-            phys_addr     = reinterpret_cast<uintptr_t>(PhysicalManager::alloc());
-            frames_needed = 1;
+            phys_addr = reinterpret_cast<uintptr_t>(PhysicalManager::alloc());
             break;
 
         case PageSize::Size2M:
-            // 2 MiB = 512 * 4 KiB pages
-            // Must be aligned to 2 MiB (0x200000)
-            frames_needed = 512ull;
-            phys_addr     = reinterpret_cast<uintptr_t>(
-                PhysicalManager::alloc_aligned(frames_needed, PAGE_SIZE_2M));
+            // 2 MiB frame, aligned to 2 MiB (0x200000). An explicit request
+            // takes it from the huge reserve, so it still works once 4 KiB
+            // refills fragment memory.
+            phys_addr = reinterpret_cast<uintptr_t>(PhysicalManager::alloc_huge(size, use_reserve));
             break;
 
         case PageSize::Size1G:
-            // 1 GiB = 512 * 512 * 4 KiB pages
-            // Must be aligned to 1 GiB (0x40000000)
+            // 1 GiB frame, aligned to 1 GiB (0x40000000)
             if (!support_1g_pages) {
                 return false;
             }
 
-            frames_needed = 512ull * 512ull;
-            phys_addr     = reinterpret_cast<uintptr_t>(
-                PhysicalManager::alloc_aligned(frames_needed, PAGE_SIZE_1G));
+            phys_addr = reinterpret_cast<uintptr_t>(PhysicalManager::alloc_huge(size, use_reserve));
             break;
     }
 
@@ -378,7 +427,7 @@ bool PageMap::map(uintptr_t virt_addr, uint8_t flags, CacheType cache, PageSize
     }
 
     if (!this->map(virt_addr, phys_addr, flags, cache, size, 0, do_flush)) {
-        PhysicalManager::free(reinterpret_cast<void*>(phys_addr), frames_needed);
+        PhysicalManager::free_huge(reinterpret_cast<void*>(phys_addr), size);
         return false;
     }
 
@@ -395,12 +444,83 @@ bool PageMap::is_table_empty(uintptr_t* table) {
     return true;
 }
 
-void PageMap::unmap(uintptr_t virt_addr, uint16_t owner_pcid, bool free_phys) {
+size_t PageMap::unmap(uintptr_t virt_addr, bool free_phys) {
+    TlbGather gather(this);
+    return this->unmap(virt_addr, gather, free_phys);
+}
+
+size_t PageMap::unmap(uintptr_t virt_addr, TlbGather& gather, bool free_phys) {
+    size_t span = 0;
+    return this->unmap_entry(virt_addr, gather, free_phys, true, span);
+}
+
+void PageMap::unmap_range(uintptr_t start, size_t length, TlbGather& gather, bool free_phys) {
+    uintptr_t curr = start;
+    uintptr_t end  = start + length;
+
+    while (curr < end) {
+        size_t span    = PAGE_SIZE_4K;
+        uintptr_t* pte = this->get_pte(curr, 1, false);
+
+        if (pte) {
+            // Clear this page table's share of the range in one pass
+            size_t index = (curr >> 12) & 0x1FF;
+            size_t count = std::min(512 - index, div_roundup(end - curr, PAGE_SIZE_4K));
+
+            size_t first = count;
+            size_t last  = 0;
+
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t entry = pte[i];
+
+                if (!(entry & FlagPresent)) {
+                    continue;
+                }
+
+                pte[i] = 0;
+                account_mapping(entry, 1, -1);
+
+                if (free_phys) {
+                    gather.add_frame(entry & page_mask, PageSize::Size4K);
+                }
+
+                first = std::min(first, i);
+                last  = i;
+            }
+
+            if (first < count) {
+                gather.add_range(curr + (first * PAGE_SIZE_4K), PAGE_SIZE_4K);
+                gather.add_range(curr + (last * PAGE_SIZE_4K), PAGE_SIZE_4K);
+            }
+
+            span = count * PAGE_SIZE_4K;
+        } else {
+            // A huge leaf or a hole higher up
+            this->unmap_entry(curr, gather, free_phys, false, span);
+            span = (align_down(curr, span) + span) - curr;
+        }
+
+        // Emptied tables are only looked for once we leave a page table's 2M,
+        // rather than after every page; the second walk stops at the slot
+        // just cleared and prunes upwards from there.
+        uintptr_t next = curr + span;
+
+        if ((next >= end) || is_aligned(next, PAGE_SIZE_2M)) {
+            this->unmap_entry(curr, gather, false, true, span);
+        }
+
+        curr = next;
+    }
+}
+
+size_t PageMap::unmap_entry(uintptr_t virt_addr, TlbGather& gather, bool free_phys, bool prune,
+                            size_t& span) {
     uint64_t curr_tbl_phys = this->phys_root_addr;
     int level              = max_levels;
+    size_t unmapped        = 0;
 
-    uintptr_t* path_tables[5] = {nullptr};
-    int path_indices[5]       = {0};
+    uintptr_t* path_tables[6] = {nullptr};
+    int path_indices[6]       = {0};
 
     while (level >= 1) {
         uintptr_t* table_virt = reinterpret_cast<uintptr_t*>(to_higher_half(curr_tbl_phys));
@@ -413,10 +533,11 @@ void PageMap::unmap(uintptr_t virt_addr, uint16_t owner_pcid, bool free_phys) {
         path_indices[level] = index;
 
         uint64_t entry = table_virt[index];
+        span           = 1ul << shift;
 
-        // If not present, nothing to unmap
+        // If not present, nothing is mapped anywhere in `span`
         if (!(entry & FlagPresent)) {
-            return;
+            break;
         }
 
         bool is_huge = (level > 1) && (entry & FlagHuge);
@@ -425,57 +546,96 @@ void PageMap::unmap(uintptr_t virt_addr, uint16_t owner_pcid, bool free_phys) {
         if (is_huge || is_leaf) {
             uintptr_t phys_addr = entry & page_mask;
 
-            // Remove the mapping before flushing
+            // Remove the mapping; the gather flushes it before anything
+            // behind it is freed.
             table_virt[index] = 0;
-
-            uint64_t curr_cr3_phys = arch::Cr3::read().raw & ~0xFFFull;
-            uint64_t root_phys     = this->phys_root_addr & ~0xFFFull;
-
-            if (curr_cr3_phys == root_phys) {
-                // We're modifying the current address space.
-                TLB::flush(virt_addr);
-            } else {
-                // Modifying inactive address space.
-                // Target the specific PCID owner.
-                TLB::flush_specific(virt_addr, owner_pcid);
-            }
+            account_mapping(entry, level, -1);
+            gather.add_range(virt_addr, span);
 
             if (free_phys) {
                 if (level == 1) {
-                    PhysicalManager::free(reinterpret_cast<void*>(phys_addr));
+                    gather.add_frame(phys_addr, PageSize::Size4K);
                 } else if (level == 2) {
-                    PhysicalManager::free(reinterpret_cast<void*>(phys_addr), 512);
+                    gather.add_frame(align_down(phys_addr, PAGE_SIZE_2M), PageSize::Size2M);
                 } else if (level == 3) {
-                    PhysicalManager::free(reinterpret_cast<void*>(phys_addr), 512ull * 512ull);
+                    gather.add_frame(align_down(phys_addr, PAGE_SIZE_1G), PageSize::Size1G);
                 }
             }
 
-            // We loop from the current level UP to the root (exclusive of root)
-            // If we are at level 1, we check PT. If empty, free it and update table 2.
-            for (int l = level; l < max_levels; l++) {
-                uintptr_t* curr_table = path_tables[l];
+            unmapped = span;
+            break;
+        }
 
-                // If this table is not empty, no upper table
-                if (!is_table_empty(curr_table)) {
-                    break;
-                }
+        curr_tbl_phys = entry & page_mask;
+        --level;
+    }
 
-                uintptr_t* parent_table = path_tables[l + 1];
-                int parent_idx          = path_indices[l + 1];
+    if (!prune) {
+        return unmapped;
+    }
 
-                uint64_t parent_entry = parent_table[parent_idx];
-                uintptr_t table_phys  = parent_entry & page_mask;
+    // Every address space shares the kernel half's top-level entries; the
+    // tables under them must stay even once empty.
+    int top = is_kernel_half(virt_addr) ? max_levels - 1 : max_levels;
 
-                parent_table[parent_idx] = 0;
+    // We loop from the current level UP to the root (exclusive of root)
+    // If we are at level 1, we check PT. If empty, free it and update table 2.
+    for (int l = level; l < top; l++) {
+        uintptr_t* curr_table = path_tables[l];
 
-                PhysicalManager::free(reinterpret_cast<void*>(table_phys));
-            }
+        // If this table is not empty, no upper table
+        if (!is_table_empty(curr_table)) {
+            break;
+        }
 
-            return;
+        uintptr_t* parent_table = path_tables[l + 1];
+        int parent_idx          = path_indices[l + 1];
+
+        uint64_t parent_entry = parent_table[parent_idx];
+        uintptr_t table_phys  = parent_entry & page_mask;
+
+        parent_table[parent_idx] = 0;
+
+        // A table with no stale (non-present) bits left is all zeroes;
+        // recycle it as a clean page so it never needs zeroing again.
+        bool all_zero = true;
+        for (int i = 0; (i < 512) && all_zero; ++i) {
+            all_zero = (curr_table[i] == 0);
         }
 
-        curr_tbl_phys = entry & page_mask;
-        --level;
+        // Cores may still hold the table in their paging-structure caches,
+        // so it goes with the gather too.
+        gather.add_range(virt_addr, PAGE_SIZE_4K);
+        gather.add_table(table_phys, all_zero);
+    }
+
+    return unmapped;
+}
+
+uintptr_t PageMap::detach(uintptr_t virt_addr, uintptr_t& entry) {
+    uintptr_t* pte = this->get_pte(virt_addr, 1, false);
+
+    if (!pte || !(*pte & FlagPresent)) {
+        entry = 0;
+        return 0;
+    }
+
+    // Atomic so an Accessed/Dirty update racing with us lands in `entry`.
+    entry = __atomic_exchange_n(pte, 0, __ATOMIC_ACQ_REL);
+    account_mapping(entry, 1, -1);
+
+    return entry & page_mask;
+}
+
+void PageMap::reattach(uintptr_t virt_addr, uintptr_t entry, uintptr_t phys_addr) {
+    uintptr_t* pte = this->get_pte(virt_addr, 1, false);
+
+    // The entry was not present, so no TLB can hold it; no flush needed.
+    if (pte) {
+        uint64_t new_entry = (entry & ~page_mask) | (phys_addr & page_mask);
+
+        account_mapping(new_entry, 1, 1);
+        __atomic_store_n(pte, new_entry, __ATOMIC_RELEASE);
     }
 }
 
@@ -498,6 +658,10 @@ uintptr_t PageMap::translate(uintptr_t virt_addr) {
 
         uint64_t entry = table_virt[index];
 
+        if (!(entry & FlagPresent)) {
+            return 0;
+        }
+
         if (level > 1 && (entry & FlagHuge)) {
             uint64_t offset_mask = (1ull << shift) - 1;
             uint64_t offset      = virt_addr & offset_mask;
@@ -526,8 +690,14 @@ uintptr_t PageMap::translate(uintptr_t virt_addr) {
     return 0;
 }
 
+void PageMap::walk(uintptr_t start, size_t length, LeafFn fn, void* ctx) {
+    if (length > 0) {
+        walk_table(this->phys_root_addr, max_levels, start, start + length, fn, ctx);
+    }
+}
+
 size_t PageMap::set_page_flags(uintptr_t virt_addr, uint8_t flags, CacheType cache,
-                               uint16_t owner_pcid) {
+                               bool do_flush) {
     uintptr_t curr_table_phys = this->phys_root_addr;
     size_t new_flags          = convert_generic_flags(flags, cache, PageSize::Size4K);
 
@@ -570,12 +740,12 @@ size_t PageMap::set_page_flags(uintptr_t virt_addr, uint8_t flags, CacheType cac
                 }
             }
 
+            account_mapping(entry, level, -1);
+            account_mapping(new_entry, level, 1);
             table_virt[index] = new_entry;
 
-            if (this->is_active()) {
-                TLB::flush(virt_addr);
-            } else {
-                TLB::flush_specific(virt_addr, owner_pcid);
+            if (do_flush) {
+                this->flush_tlb(virt_addr, 1);
             }
 
             return 1ul << shift;
@@ -587,20 +757,263 @@ size_t PageMap::set_page_flags(uintptr_t virt_addr, uint8_t flags, CacheType cac
     return 0;
 }
 
+size_t PageMap::leaf_size(uintptr_t virt_addr) {
+    uintptr_t curr_table_phys = this->phys_root_addr;
+
+    for (int level = max_levels; level >= 1; --level) {
+        uintptr_t* table_virt = reinterpret_cast<uintptr_t*>(to_higher_half(curr_table_phys));
+
+        int shift = 12 + (level - 1) * 9;
+        int index = static_cast<int>((virt_addr >> shift) & 0x1FF);
+
+        uint64_t entry = table_virt[index];
+
+        if (!(entry & FlagPresent)) {
+            return 0;
+        }
+
+        if ((level == 1) || (entry & FlagHuge)) {
+            return 1ul << shift;
+        }
+
+        curr_table_phys = entry & page_mask;
+    }
+
+    return 0;
+}
+
+bool PageMap::split(uintptr_t virt_addr) {
+    uintptr_t curr_table_phys = this->phys_root_addr;
+    uintptr_t* pte            = nullptr;
+    int level                 = max_levels;
+
+    for (; level > 1; --level) {
+        uintptr_t* table_virt = reinterpret_cast<uintptr_t*>(to_higher_half(curr_table_phys));
+
+        int shift = 12 + (level - 1) * 9;
+        int index = static_cast<int>((virt_addr >> shift) & 0x1FF);
+
+        uint64_t entry = table_virt[index];
+
+        if (!(entry & FlagPresent)) {
+            return false;
+        }
+
+        if (entry & FlagHuge) {
+            pte = &table_virt[index];
+            break;
+        }
+
+        curr_table_phys = entry & page_mask;
+    }
+
+    if (!pte) {
+        return false;
+    }
+
+    uintptr_t table_phys = reinterpret_cast<uintptr_t>(PhysicalManager::alloc());
+
+    if (table_phys == 0) {
+        LOG_ERROR("PageMap::split: failed to allocate page table at level=%d", level - 1);
+        return false;
+    }
+
+    if (PageFrame* frame = PhysicalManager::frame(table_phys)) {
+        frame->flags |= FramePageTable;
+    }
+
+    uintptr_t* table = reinterpret_cast<uintptr_t*>(to_higher_half(table_phys));
+    size_t size      = 1ul << (12 + (level - 1) * 9);
+    size_t child     = size / 512;
+    uint64_t entry   = __atomic_load_n(pte, __ATOMIC_ACQUIRE);
+    uint64_t parent  = table_phys | FlagPresent | FlagWrite | FlagUser;
+
+    // The CPU may set Accessed/Dirty on the huge entry while we build the
+    // table; retry until the children carry what the entry had when swapped.
+    do {
+        uintptr_t base = align_down(entry & page_mask, size);
+        uint64_t attrs = entry & ~page_mask;
+
+        // Bit 12 is the PAT bit of a huge entry; a 4K entry has it at bit 7
+        if (level == 2) {
+            attrs &= ~FlagHuge;
+            attrs |= (entry & FlagLPAT) ? FlagPAT : 0;
+        } else {
+            attrs |= entry & FlagLPAT;
+        }
+
+        for (size_t i = 0; i < 512; ++i) {
+            table[i] = (base + (i * child)) | attrs;
+        }
+    } while (!__atomic_compare_exchange_n(pte, &entry, parent, false, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE));
+
+    // The same memory is mapped the same way, but no core may keep the huge
+    // translation alongside the new ones.
+    this->flush_tlb(align_down(virt_addr, size), 1);
+
+    account_mapping(entry, level, -1);
+    PhysicalManager::split_huge(align_down(entry & page_mask, size),
+                                (level == 3) ? PageSize::Size1G : PageSize::Size2M);
+
+    for (size_t i = 0; i < 512; ++i) {
+        account_mapping(table[i], level - 1, 1);
+    }
+
+    return true;
+}
+
+bool PageMap::collapse(uintptr_t virt_addr, bool allow_copy) {
+    uintptr_t base            = align_down(virt_addr, PAGE_SIZE_2M);
+    uintptr_t curr_table_phys = this->phys_root_addr;
+    uintptr_t* pde            = nullptr;
+
+    for (int level = max_levels; level >= 2; --level) {
+        uintptr_t* table_virt = reinterpret_cast<uintptr_t*>(to_higher_half(curr_table_phys));
+
+        int shift = 12 + (level - 1) * 9;
+        int index = static_cast<int>((base >> shift) & 0x1FF);
+
+        uint64_t entry = table_virt[index];
+
+        if (!(entry & FlagPresent) || (entry & FlagHuge)) {
+            return false;
+        }
+
+        if (level == 2) {
+            pde = &table_virt[index];
+        }
+
+        curr_table_phys = entry & page_mask;
+    }
+
+    uintptr_t pt_phys = *pde & page_mask;
+    uintptr_t* pt     = reinterpret_cast<uintptr_t*>(to_higher_half(pt_phys));
+
+    // Accessed/Dirty may differ between the pages; everything else must not
+    constexpr uint64_t ad_bits = FlagAccessed | FlagDirty;
+
+    uint64_t attrs  = pt[0] & ~page_mask & ~ad_bits;
+    uintptr_t first = pt[0] & page_mask;
+
+    if (!(attrs & FlagPresent) || !(attrs & FlagUser) || (attrs & FlagGlobal)) {
+        return false;
+    }
+
+    // Every page mapped like the first and by this table alone; `contiguous`
+    // tells whether they already form an aligned 2MB run.
+    auto collapsible = [&](bool& contiguous) {
+        contiguous = is_aligned(first, PAGE_SIZE_2M);
+
+        for (size_t i = 0; i < 512; ++i) {
+            uintptr_t phys   = pt[i] & page_mask;
+            PageFrame* frame = PhysicalManager::frame(phys);
+
+            if ((pt[i] & ~page_mask & ~ad_bits) != attrs) {
+                return false;
+            }
+
+            // A shared page can't be folded into a private huge frame
+            if (!frame || (frame->refcount.load(std::memory_order_relaxed) != 1) ||
+                (frame->mapcount.load(std::memory_order_relaxed) != 1)) {
+                return false;
+            }
+
+            contiguous = contiguous && (phys == (first + (i * PAGE_SIZE_4K)));
+        }
+
+        return true;
+    };
+
+    bool contiguous = false;
+
+    if (!collapsible(contiguous) || (!contiguous && !allow_copy)) {
+        return false;
+    }
+
+    // Take the range away and flush it: after that no core can write through
+    // the old entries, and faults wait on the caller's address space lock.
+    uint64_t old_pde = __atomic_exchange_n(pde, 0, __ATOMIC_ACQ_REL);
+    this->flush_tlb(base, 512);
+
+    // Recheck now that nothing can change the table: an entry edited before
+    // the flush by a path not holding the caller's lock must not have its
+    // page folded in or freed under it.
+    bool still_contiguous = false;
+
+    if (!collapsible(still_contiguous) || (contiguous && !still_contiguous)) {
+        __atomic_store_n(pde, old_pde, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    // Pages that already form an aligned 2MB run just become one frame
+    contiguous          = contiguous && PhysicalManager::merge_huge(first);
+    uintptr_t huge_phys = first;
+
+    if (!contiguous) {
+        // Promotion is opportunistic: leave the huge reserve to explicit
+        // huge mappings and take the frame from the buddy lists.
+        void* frame = allow_copy ? PhysicalManager::alloc_huge(PageSize::Size2M, false) : nullptr;
+        huge_phys   = reinterpret_cast<uintptr_t>(frame);
+
+        if (huge_phys == 0) {
+            __atomic_store_n(pde, old_pde, __ATOMIC_RELEASE);
+            return false;
+        }
+    }
+
+    uint64_t ad = 0;
+
+    for (size_t i = 0; i < 512; ++i) {
+        ad |= pt[i] & ad_bits;
+        account_mapping(pt[i], 1, -1);
+    }
+
+    if (!contiguous) {
+        for (size_t i = 0; i < 512; ++i) {
+            memcpy(reinterpret_cast<void*>(to_higher_half(huge_phys + (i * PAGE_SIZE_4K))),
+                   reinterpret_cast<void*>(to_higher_half(pt[i] & page_mask)), PAGE_SIZE_4K);
+        }
+    }
+
+    uint64_t leaf = huge_phys | (attrs & ~FlagPAT) | ad | FlagHuge;
+
+    if (attrs & FlagPAT) {
+        leaf |= FlagLPAT;
+    }
+
+    account_mapping(leaf, 2, 1);
+    __atomic_store_n(pde, leaf, __ATOMIC_RELEASE);
+
+    // The old pages were flushed above; the table page holds their
+    // addresses until it goes too.
+    if (!contiguous) {
+        for (size_t i = 0; i < 512; ++i) {
+            pt[i] &= page_mask;
+        }
+
+        PhysicalManager::put_batch(pt, 512);
+    }
+
+    PhysicalManager::free(reinterpret_cast<void*>(pt_phys));
+    return true;
+}
+
 void PageMap::create_new(PageMap* map) {
     static bool kernel_initialized = false;
-    uintptr_t* root_phys           = static_cast<uintptr_t*>(PhysicalManager::alloc());
+    uintptr_t* root_phys           = static_cast<uintptr_t*>(PhysicalManager::alloc_clear());
 
     if (!root_phys) {
         LOG_ERROR("PageMap::create_new: failed to allocate root table");
         return;
     }
 
-    uint64_t* root_virt = to_higher_half(root_phys);
-    for (int i = 0; i < 512; ++i) {
-        root_virt[i] = 0;
+    if (PageFrame* frame = PhysicalManager::frame(reinterpret_cast<uintptr_t>(root_phys))) {
+        frame->flags |= FramePageTable;
     }
 
+    uint64_t* root_virt = to_higher_half(root_phys);
+
     // After the first initialization, new address spaces inherit the kernel
     // half of the address space by copying upper-level entries.
     if (kernel_initialized) {
@@ -638,63 +1051,215 @@ void PageMap::load(uint16_t pcid, bool flush) {
     cr3.write();
 }
 
+void PageMap::activate(PageMap* prev, uint16_t pcid, bool flush) {
+    uint32_t cpu = cpu::current_core_idx();
+
+    if (prev) {
+        prev->active_cpus.clear(cpu);
+    }
+
+    this->active_cpus.set(cpu);
+    this->used_cpus.set(cpu);
+
+    // Pairs with the fence in `flush_tlb`: either the shooter sees us in
+    // `active_cpus`, or we see its stale mark here.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (this->stale_cpus.test_and_clear(cpu)) {
+        flush = true;
+    }
+
+    this->load(pcid, flush);
+}
+
+void PageMap::flush_tlb(uintptr_t start, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    bool kernel_half             = is_kernel_half(start);
+    cpu::CpuCoreManager& manager = cpu::CpuCoreManager::get();
+
+    if (!manager.initialized()) {
+        // Single core; whatever we load later is loaded with a flush
+        if (kernel_half || this->is_active()) {
+            for (size_t i = 0; i < count; ++i) {
+                TLB::flush(start + (i * PAGE_SIZE_4K));
+            }
+        }
+
+        return;
+    }
+
+    CpuMask targets;
+
+    if (kernel_half) {
+        targets.fill(manager.get_total_cores());
+    } else {
+        // Cores that ran this map but aren't running it now flush when they
+        // switch back; only the ones running it need an IPI.
+        this->stale_cpus.merge(this->used_cpus);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        targets.merge(this->active_cpus);
+    }
+
+    cpu::CpuCoreManager::tlb_shootdown(targets, start, count);
+}
+
 void PageMap::map_range(uintptr_t virt_start, uintptr_t phys_start, size_t length, uint8_t flags,
                         CacheType cache) {
-    // Greedy mapping: pick the largest page size that satisfies alignment
-    // and size constraints, to reduce TLB pressure and page-table depth.
-    uintptr_t virt   = virt_start;
-    uintptr_t phys   = phys_start;
-    size_t remaining = length;
-
-    while (remaining > 0) {
-        PageSize size = PageSize::Size4K;
-        size_t step   = PAGE_SIZE_4K;
-
-        if (support_1g_pages && is_aligned(virt, PAGE_SIZE_1G) && is_aligned(phys, PAGE_SIZE_1G) &&
-            (remaining >= PAGE_SIZE_1G)) {
-            size = PageSize::Size1G;
-            step = PAGE_SIZE_1G;
-        } else if (is_aligned(virt, PAGE_SIZE_2M) && is_aligned(phys, PAGE_SIZE_2M) &&
-                   (remaining >= PAGE_SIZE_2M)) {
-            size = PageSize::Size2M;
-            step = PAGE_SIZE_2M;
-        } else {
-            size = PageSize::Size4K;
-            step = PAGE_SIZE_4K;
+    bool replaced = false;
+    size_t mapped = this->map_run(virt_start, phys_start, length, flags, cache, PageSize::Size1G,
+                                  false, replaced);
+
+    if (mapped < length) {
+        PANIC("Failed to map range at virt: 0x%lx phys: 0x%lx", virt_start + mapped,
+              phys_start + mapped);
+    }
+
+    // Fresh entries need no flush; only overwritten ones might be cached
+    if (replaced) {
+        this->flush_tlb(virt_start, div_roundup(length, PAGE_SIZE_4K));
+    }
+}
+
+bool PageMap::populate_range(uintptr_t virt_start, size_t length, uint8_t flags, CacheType cache,
+                             PageSize max_size, bool use_reserve) {
+    bool replaced = false;
+    return this->map_run(virt_start, ALLOC_FRAMES, length, flags, cache, max_size, use_reserve,
+                         replaced) >= length;
+}
+
+size_t PageMap::map_run(uintptr_t virt_start, uintptr_t phys_start, size_t length, uint8_t flags,
+                        CacheType cache, PageSize max_size, bool use_reserve, bool& replaced) {
+    bool alloc     = (phys_start == ALLOC_FRAMES);
+    uintptr_t virt = virt_start;
+    uintptr_t end  = virt_start + align_up(length, PAGE_SIZE_4K);
+    int max_level  = get_target_level(max_size);
+
+    if ((max_level == 3) && !support_1g_pages) {
+        max_level = 2;
+    }
+
+    replaced = false;
+
+    while (virt < end) {
+        uintptr_t phys = alloc ? 0 : phys_start + (virt - virt_start);
+        int level      = max_level;
+
+        // Largest page size both addresses are aligned to that still fits
+        while (level > 1) {
+            size_t size = 1ul << (12 + (level - 1) * 9);
+
+            if (is_aligned(virt, size) && is_aligned(phys, size) && ((end - virt) >= size)) {
+                break;
+            }
+
+            --level;
         }
 
-        if (remaining >= PAGE_SIZE_2M) {
-            bool v_align = is_aligned(virt, PAGE_SIZE_2M);
-            bool p_align = is_aligned(phys, PAGE_SIZE_2M);
+        uintptr_t* pte = nullptr;
+
+        // A table under the slot means part of the range is mapped already;
+        // go down to a size that fits around it.
+        while (true) {
+            pte = this->get_pte(virt, level, true);
 
-            if (v_align && !p_align) {
-                LOG_WARN("Virt aligned but phys unaligned! Virt: 0x%lx Phys: 0x%lx\n", virt, phys);
+            if (!pte || (level == 1) || !(*pte & FlagPresent) || (*pte & FlagHuge)) {
+                break;
             }
+
+            --level;
         }
 
-        phys = align_down(phys, step);
-        virt = align_up(virt, step);
+        if (!pte) {
+            // Either out of memory for a table, or a huge leaf is in the way
+            size_t leaf = this->leaf_size(virt);
+
+            if (!alloc || (leaf == 0)) {
+                return virt - virt_start;
+            }
 
-        if (!this->map(virt, phys, flags, cache, size, 0, false)) {
-            PANIC("Failed to map range at virt: 0x%lx phys: 0x%lx", virt, phys);
+            virt = align_down(virt, leaf) + leaf;
+            continue;
         }
 
-        virt += step;
-        phys += step;
-        remaining -= step;
-    }
+        int shift           = 12 + (level - 1) * 9;
+        size_t size         = 1ul << shift;
+        size_t index        = (virt >> shift) & 0x1FF;
+        size_t count        = std::min(512 - index, (end - virt) / size);
+        PageSize page_size  = (level == 3)   ? PageSize::Size1G
+                              : (level == 2) ? PageSize::Size2M
+                                             : PageSize::Size4K;
+        uint64_t arch_flags = convert_generic_flags(flags, cache, page_size);
+
+        // Stop short of the next table; the next round goes down into it
+        if (level > 1) {
+            for (size_t i = 1; i < count; ++i) {
+                if ((pte[i] & FlagPresent) && !(pte[i] & FlagHuge)) {
+                    count = i;
+                    break;
+                }
+            }
+        }
+
+        if (alloc) {
+            // Populating: what's mapped stays, the holes get new frames
+            for (size_t i = 0; i < count; ++i) {
+                if (pte[i] & FlagPresent) {
+                    continue;
+                }
+
+                uintptr_t frame = reinterpret_cast<uintptr_t>(
+                    PhysicalManager::alloc_huge(page_size, use_reserve));
+
+                if (frame == 0) {
+                    if (level == 1) {
+                        return (virt - virt_start) + (i * size);
+                    }
+
+                    // No huge frame left; the rest goes with smaller pages
+                    count     = i;
+                    max_level = level - 1;
+                    break;
+                }
 
-    // If range is huge, it's often faster to just reload the CR3 than to issue >512 `invlpg`
-    if (this->is_active()) {
-        if (length >= PAGE_SIZE_2M) {
-            this->load();
+                pte[i] = frame | arch_flags;
+                account_mapping(pte[i], level, 1);
+            }
         } else {
-            // Flush all addresses individually
-            for (uintptr_t v = virt_start; v < virt_start + length; v += PAGE_SIZE_4K) {
-                TLB::flush(v);
+            uint64_t entry = (phys & page_mask) | arch_flags;
+            uint64_t old   = 0;
+
+            for (size_t i = 0; i < count; ++i) {
+                old |= pte[i];
             }
+
+            if ((old & (FlagPresent | FlagUser)) == (FlagPresent | FlagUser)) {
+                for (size_t i = 0; i < count; ++i) {
+                    account_mapping(pte[i], level, -1);
+                }
+            }
+
+            // Consecutive entries differ only in the address: a plain store
+            // loop the compiler can unroll
+            for (size_t i = 0; i < count; ++i) {
+                pte[i] = entry + (i * size);
+            }
+
+            if (entry & FlagUser) {
+                for (size_t i = 0; i < count; ++i) {
+                    account_mapping(pte[i], level, 1);
+                }
+            }
+
+            replaced = replaced || (old & FlagPresent);
         }
+
+        virt += count * size;
     }
+
+    return length;
 }
 
 void PageMap::global_init() {
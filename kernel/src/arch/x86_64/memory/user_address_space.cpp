@@ -71,7 +71,10 @@ bool UserAddressSpace::handle_page_fault(uintptr_t fault_addr, size_t error_code
         return true;
     }
 
-    if (!this->page_map->map(page_base, region->flags, region->cache, region->page_size)) {
+    // The region's page size was asked for explicitly, which is what the
+    // huge reserve is kept for
+    if (!this->page_map->map(page_base, region->flags, region->cache, region->page_size, true,
+                             true)) {
         LOG_ERROR("Out of memory!");
         return false;
     }
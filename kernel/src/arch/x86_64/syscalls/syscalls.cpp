@@ -2,6 +2,7 @@
 #include "arch.hpp"
 #include "cpu/exception.hpp"
 #include "libs/log.hpp"
+#include "memory/heap_profile.hpp"
 
 namespace kernel {
 using namespace cpu::arch;
@@ -15,6 +16,12 @@ extern "C" void syscall_handler(uint64_t syscall_num, TrapFrame* frame) {
             frame->rax = 0;
             break;
         }
+        case 1: {
+            // Heap profile to the log; fails unless built with HEAP_PROFILE
+            bool dumped = memory::HeapProfiler::dump();
+            frame->rax  = dumped ? 0 : static_cast<uint64_t>(-1);
+            break;
+        }
         default: {
             LOG_ERROR("Unknown Syscall Number %lu", syscall_num);
             frame->rax = static_cast<uint64_t>(-1);
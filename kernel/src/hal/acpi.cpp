@@ -33,5 +33,8 @@ void ACPI::bootstrap() {
 
     // Populate internal structures from MADT and other tables.
     parse_tables();
+
+    // Memory/CPU affinity (SRAT) and node distances (SLIT), if present.
+    parse_numa();
 }
 }  // namespace kernel::hal
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include "hal/numa.hpp"
+#include "libs/log.hpp"
+
+namespace kernel::hal {
+namespace {
+struct CpuAffinity {
+    uint32_t apic_id;
+    uint32_t node;
+};
+
+struct {
+    uint32_t domains[MAX_NUMA_NODES] = {};  // ACPI proximity domain of each node.
+    size_t node_count                = 0;
+
+    NumaMemoryRange ranges[MAX_NUMA_RANGES] = {};
+    size_t range_count                      = 0;
+
+    CpuAffinity cpus[MAX_NUMA_CPUS] = {};
+    size_t cpu_count                = 0;
+
+    uint8_t distances[MAX_NUMA_NODES][MAX_NUMA_NODES] = {};
+    bool has_distances                                = false;
+
+    uint32_t fallback[MAX_NUMA_NODES][MAX_NUMA_NODES] = {};
+} numa_state;
+
+// Used before `finalize()` and on machines without SRAT.
+const uint32_t single_node_order[1] = {0};
+}  // namespace
+
+uint32_t Numa::node_of_domain(uint32_t domain, bool create) {
+    for (size_t i = 0; i < numa_state.node_count; ++i) {
+        if (numa_state.domains[i] == domain) {
+            return static_cast<uint32_t>(i);
+        }
+    }
+
+    if (!create) {
+        return 0;
+    }
+
+    if (numa_state.node_count >= MAX_NUMA_NODES) {
+        LOG_WARN("NUMA: too many proximity domains, folding domain %u into node 0", domain);
+        return 0;
+    }
+
+    numa_state.domains[numa_state.node_count] = domain;
+    return static_cast<uint32_t>(numa_state.node_count++);
+}
+
+void Numa::add_memory(uint32_t domain, uintptr_t base, size_t length) {
+    if (numa_state.range_count >= MAX_NUMA_RANGES) {
+        LOG_WARN("NUMA: dropping memory range base=0x%lx len=0x%zx (table full)", base, length);
+        return;
+    }
+
+    NumaMemoryRange& range = numa_state.ranges[numa_state.range_count++];
+    range.base             = base;
+    range.length           = length;
+    range.node             = node_of_domain(domain, true);
+}
+
+void Numa::add_cpu(uint32_t apic_id, uint32_t domain) {
+    if (numa_state.cpu_count >= MAX_NUMA_CPUS) {
+        LOG_WARN("NUMA: dropping affinity for apic_id=%u (table full)", apic_id);
+        return;
+    }
+
+    numa_state.cpus[numa_state.cpu_count++] = {apic_id, node_of_domain(domain, true)};
+}
+
+void Numa::set_distance(uint32_t from_domain, uint32_t to_domain, uint8_t distance) {
+    // SLIT may list localities that own neither CPUs nor memory; skip those.
+    bool from_known = false;
+    bool to_known   = false;
+
+    for (size_t i = 0; i < numa_state.node_count; ++i) {
+        from_known |= (numa_state.domains[i] == from_domain);
+        to_known |= (numa_state.domains[i] == to_domain);
+    }
+
+    if (!from_known || !to_known) {
+        return;
+    }
+
+    uint32_t from = node_of_domain(from_domain, false);
+    uint32_t to   = node_of_domain(to_domain, false);
+
+    numa_state.distances[from][to] = distance;
+    numa_state.has_distances       = true;
+}
+
+void Numa::finalize() {
+    if (numa_state.node_count == 0) {
+        numa_state.node_count = 1;
+    }
+
+    // Keep ranges sorted by base address so lookups can stop early.
+    for (size_t i = 1; i < numa_state.range_count; ++i) {
+        NumaMemoryRange key = numa_state.ranges[i];
+        size_t j            = i;
+
+        while ((j > 0) && (numa_state.ranges[j - 1].base > key.base)) {
+            numa_state.ranges[j] = numa_state.ranges[j - 1];
+            j--;
+        }
+
+        numa_state.ranges[j] = key;
+    }
+
+    // Without a SLIT, assume the usual local/remote split.
+    if (!numa_state.has_distances) {
+        for (size_t i = 0; i < numa_state.node_count; ++i) {
+            for (size_t j = 0; j < numa_state.node_count; ++j) {
+                numa_state.distances[i][j] = (i == j) ? NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+            }
+        }
+    }
+
+    // Fallback order per node: insertion sort by distance, ties broken by id.
+    for (size_t node = 0; node < numa_state.node_count; ++node) {
+        uint32_t* order = numa_state.fallback[node];
+
+        for (size_t i = 0; i < numa_state.node_count; ++i) {
+            uint32_t candidate = static_cast<uint32_t>(i);
+            size_t j           = i;
+
+            while ((j > 0) && (numa_state.distances[node][order[j - 1]] >
+                               numa_state.distances[node][candidate])) {
+                order[j] = order[j - 1];
+                j--;
+            }
+
+            order[j] = candidate;
+        }
+    }
+
+    LOG_INFO("NUMA: %zu node(s), %zu memory range(s), %zu cpu affinity entries",
+             numa_state.node_count, numa_state.range_count, numa_state.cpu_count);
+
+    for (size_t i = 0; i < numa_state.range_count; ++i) {
+        const NumaMemoryRange& range = numa_state.ranges[i];
+        LOG_DEBUG("NUMA: node %u owns [0x%lx - 0x%lx)", range.node, range.base,
+                  range.base + range.length);
+    }
+}
+
+size_t Numa::node_count() {
+    return (numa_state.node_count == 0) ? 1 : numa_state.node_count;
+}
+
+uint32_t Numa::node_of_cpu(uint32_t apic_id) {
+    for (size_t i = 0; i < numa_state.cpu_count; ++i) {
+        if (numa_state.cpus[i].apic_id == apic_id) {
+            return numa_state.cpus[i].node;
+        }
+    }
+
+    return 0;
+}
+
+uint32_t Numa::node_of_addr(uintptr_t phys_addr) {
+    for (size_t i = 0; i < numa_state.range_count; ++i) {
+        const NumaMemoryRange& range = numa_state.ranges[i];
+
+        if (phys_addr < range.base) {
+            break;
+        }
+
+        if (phys_addr < (range.base + range.length)) {
+            return range.node;
+        }
+    }
+
+    return 0;
+}
+
+uint8_t Numa::distance(uint32_t from, uint32_t to) {
+    if ((from >= node_count()) || (to >= node_count())) {
+        return NUMA_REMOTE_DISTANCE;
+    }
+
+    if (numa_state.node_count == 0) {
+        return NUMA_LOCAL_DISTANCE;
+    }
+
+    return numa_state.distances[from][to];
+}
+
+const uint32_t* Numa::fallback_order(uint32_t node) {
+    if (numa_state.node_count == 0) {
+        return single_node_order;
+    }
+
+    return numa_state.fallback[(node < numa_state.node_count) ? node : 0];
+}
+
+size_t Numa::memory_range_count() {
+    return numa_state.range_count;
+}
+
+const NumaMemoryRange& Numa::memory_range(size_t idx) {
+    return numa_state.ranges[idx];
+}
+}  // namespace kernel::hal
\ No newline at end of file
@@ -1,12 +1,24 @@
 #include "boot/boot.h"
 #include "hal/smp_manager.hpp"
+#include "hal/numa.hpp"
+#include "memory/memory.hpp"
+#include "memory/pmm.hpp"
 #include "libs/log.hpp"
 #include "task/process.hpp"
 
 namespace kernel::cpu {
 namespace {
+// Pages zeroed per pass, so a thread woken while idle waits at most one batch.
+constexpr size_t ZERO_REFILL_BATCH = 16;
+
 void idle_worker(void*) {
-    kernel::arch::halt(true);
+    while (true) {
+        // Spend idle time pre-zeroing pages for `alloc_clear`; sleep once the
+        // clean pool is full.
+        if (memory::PhysicalManager::refill_zero_pool(ZERO_REFILL_BATCH) == 0) {
+            kernel::arch::wait_for_interrupt();
+        }
+    }
 }
 
 void worker(void* arg) {
@@ -20,15 +32,22 @@ void worker(void* arg) {
 }
 }  // namespace
 
+bool percpu_available = false;
+
 void PerCpuData::init(void* stack_top) {
     if (!stack_top) {
-        std::byte* stack_base = new std::byte[KSTACK_SIZE];
+        // Take the AP's kernel stack from its own node; the BSP runs this, so
+        // a plain heap allocation would land on the BSP's node instead.
+        uint32_t node = hal::Numa::node_of_cpu(this->apic_id);
+        void* stack_base =
+            memory::PhysicalManager::alloc_on_node(node, KSTACK_SIZE / memory::PAGE_SIZE_4K);
 
         if (!stack_base) {
             PANIC("Cannot allocate stack for AP core idx %u", this->core_idx);
         }
 
-        this->kstack_top = reinterpret_cast<uintptr_t>(stack_base) + KSTACK_SIZE;
+        this->kstack_top =
+            memory::to_higher_half(reinterpret_cast<uintptr_t>(stack_base)) + KSTACK_SIZE;
     } else {
         this->kstack_top = reinterpret_cast<uintptr_t>(stack_top);
     }
@@ -63,6 +82,13 @@ void CpuCoreManager::init(void* bsp_stack_top) {
     }
 
     size_t cpu_count = mp_request.response->cpu_count;
+
+    if (cpu_count > CpuMask::MAX_CPUS) {
+        LOG_WARN("SMP: %zu cores found, only the first %zu are used", cpu_count,
+                 CpuMask::MAX_CPUS);
+        cpu_count = CpuMask::MAX_CPUS;
+    }
+
     this->cores.reserve(cpu_count);
 
     for (size_t i = 0; i < cpu_count; ++i) {
@@ -124,12 +150,22 @@ CpuCoreManager& CpuCoreManager::get() {
 extern "C" void check_reschedule() {
     PerCpuData* cpu = CpuCoreManager::get().get_current_core();
 
-    // Check if a reschedule is needed
-    if (cpu->reschedule_needed) {
+    // Check if a reschedule is needed; the tick re-arms it while preemption is off.
+    if (cpu->reschedule_needed && (cpu->preempt_count == 0)) {
         cpu->reschedule_needed = false;
 
         // This will save the current context and jump to the next thread.
         cpu->sched.schedule();
     }
 }
+
+void preempt_resched() {
+    PerCpuData* cpu = CpuCoreManager::get().get_current_core();
+
+    if (cpu->reschedule_needed && kernel::arch::interrupt_status()) {
+        kernel::arch::disable_interrupts();
+        check_reschedule();
+        kernel::arch::enable_interrupts();
+    }
+}
 }  // namespace kernel::cpu
\ No newline at end of file
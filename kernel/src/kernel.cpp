@@ -1,6 +1,11 @@
 #include "hal/acpi.hpp"
 #include "hal/smp_manager.hpp"
 #include "libs/log.hpp"
+#include "memory/boot_bench.hpp"
+#include "memory/compaction.hpp"
+#include "memory/pmm.hpp"
+#include "memory/promotion.hpp"
+#include "memory/reclaim.hpp"
 #include "task/process.hpp"
 
 extern "C" uint8_t kernel_stack[KSTACK_SIZE] = {};
@@ -13,11 +18,18 @@ extern "C" void kmain() {
 
     memory::init();
     hal::ACPI::bootstrap();
+    memory::PhysicalManager::init_numa();
     task::Process::init();
     arch::init();
 
     LOG_INFO("Hello, World!");
 
     cpu::CpuCoreManager::get().init(bsp_stack_top);
+    memory::PhysicalManager::init_deferred();
+    memory::BootBench::run();
+
+    memory::Compactor::start();
+    memory::Reclaimer::start();
+    memory::Promoter::start();
 }
 }  // namespace kernel
\ No newline at end of file
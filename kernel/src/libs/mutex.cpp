@@ -88,7 +88,7 @@ bool Mutex::lock_slow(size_t ms) {
 void Mutex::add_waiter(task::Thread* t) {
     LockGuard guard(this->queue_lock);
 
-    WaitNode* node = new WaitNode(t, nullptr);
+    WaitNode* node = new WaitNode(t);
 
     if (!this->wait_head) {
         this->wait_head = node;
@@ -0,0 +1,237 @@
+#include "memory/boot_bench.hpp"
+#include "hal/timer.hpp"
+#include "libs/log.hpp"
+#include "memory/heap.hpp"
+#include "memory/pagemap.hpp"
+#include "memory/pmm.hpp"
+#include "memory/tlb_gather.hpp"
+#include <cstdint>
+#include <iterator>
+#include <utility>
+
+namespace kernel::memory {
+#if BOOT_BENCH
+namespace {
+constexpr size_t BENCH_OBJECTS = 4096;
+constexpr size_t BENCH_ROUNDS  = 16;
+constexpr size_t BULK_MAX      = 256;
+
+// 1GB of the scratch map's lower half. The physical side is off 2MB
+// alignment so the range engine can't use huge pages; it's never touched,
+// and kernel-only entries leave the frames' map counts alone.
+constexpr uintptr_t MAP_VIRT = 0x100000000000;
+constexpr uintptr_t MAP_PHYS = PAGE_SIZE_4K;
+constexpr size_t MAP_LENGTH  = PAGE_SIZE_1G;
+constexpr uint8_t MAP_FLAGS  = Read | Write;
+
+// Fixed seed so runs of different builds free in the same order
+void shuffle(void** ptrs, size_t count) {
+    uint64_t state = 0x9e3779b97f4a7c15;
+
+    for (size_t i = count; i > 1; --i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        std::swap(ptrs[i - 1], ptrs[state % i]);
+    }
+}
+
+// Fill `ptrs` with up to BENCH_OBJECTS allocations of `size`. Returns how many.
+size_t fill(void** ptrs, size_t size) {
+    size_t n = 0;
+
+    while ((n < BENCH_OBJECTS) && (ptrs[n] = kmalloc(size))) {
+        n++;
+    }
+
+    return n;
+}
+
+size_t ops_per_sec(size_t ops, size_t cycles) {
+    size_t ns = hal::Timer::cycles_to_ns(cycles);
+
+    // Zero until a time source is calibrated
+    if (ns == 0) {
+        return 0;
+    }
+
+    return static_cast<size_t>((static_cast<__uint128_t>(ops) * 1000000000) / ns);
+}
+}  // namespace
+
+void BootBench::run() {
+    LOG_INFO("bench: running boot benchmarks");
+
+    kfree_lookup();
+    bulk();
+    map_ranges();
+}
+
+void BootBench::report(const char* what, size_t ops, size_t cycles) {
+    LOG_INFO("bench: %s: %zu ops/s, %zu cycles/op", what, ops_per_sec(ops, cycles),
+             ops ? (cycles / ops) : 0);
+}
+
+void BootBench::kfree_lookup() {
+    static constexpr size_t SIZES[]       = {32, 256, 2048};
+    static constexpr const char* LABELS[] = {
+        "kfree 32B in order",   "kfree 32B shuffled",   "kfree 256B in order",
+        "kfree 256B shuffled",  "kfree 2048B in order", "kfree 2048B shuffled",
+    };
+
+    void** ptrs = static_cast<void**>(kmalloc(BENCH_OBJECTS * sizeof(void*)));
+
+    if (!ptrs) {
+        LOG_ERROR("bench: no memory for the pointer array");
+        return;
+    }
+
+    for (size_t s = 0; s < std::size(SIZES); ++s) {
+        for (size_t shuffled = 0; shuffled < 2; ++shuffled) {
+            size_t ops    = 0;
+            size_t cycles = 0;
+
+            for (size_t round = 0; round < BENCH_ROUNDS; ++round) {
+                size_t n = fill(ptrs, SIZES[s]);
+
+                if (shuffled) {
+                    shuffle(ptrs, n);
+                }
+
+                size_t start = hal::Timer::get_cycles();
+
+                for (size_t i = 0; i < n; ++i) {
+                    kfree(ptrs[i]);
+                }
+
+                cycles += hal::Timer::get_cycles() - start;
+                ops    += n;
+            }
+
+            report(LABELS[(s * 2) + shuffled], ops, cycles);
+        }
+    }
+
+    // The lookup kfree starts with, without the free behind it
+    size_t n = fill(ptrs, 256);
+    shuffle(ptrs, n);
+
+    size_t misses = 0;
+    size_t start  = hal::Timer::get_cycles();
+
+    for (size_t round = 0; round < BENCH_ROUNDS; ++round) {
+        for (size_t i = 0; i < n; ++i) {
+            misses += (SlabMap::get(ptrs[i]) == nullptr);
+        }
+    }
+
+    report("slab lookup", n * BENCH_ROUNDS, hal::Timer::get_cycles() - start);
+
+    if (misses) {
+        LOG_ERROR("bench: %zu heap pointers had no slab", misses);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        kfree(ptrs[i]);
+    }
+
+    kfree(ptrs);
+}
+
+void BootBench::bulk() {
+    static constexpr size_t SIZE = 64;
+
+    void* ptrs[BULK_MAX];
+
+    for (size_t batch = 1; batch <= BULK_MAX; batch *= 2) {
+        // The same number of objects for every batch size
+        size_t batches = (BENCH_OBJECTS * BENCH_ROUNDS) / batch;
+        size_t single  = 0;
+        size_t bulk    = 0;
+
+        for (size_t b = 0; b < batches; ++b) {
+            size_t start = hal::Timer::get_cycles();
+
+            for (size_t i = 0; i < batch; ++i) {
+                ptrs[i] = kmalloc(SIZE);
+            }
+
+            for (size_t i = 0; i < batch; ++i) {
+                kfree(ptrs[i]);
+            }
+
+            single += hal::Timer::get_cycles() - start;
+            start   = hal::Timer::get_cycles();
+
+            if (!kmalloc_bulk(SIZE, batch, ptrs)) {
+                LOG_ERROR("bench: kmalloc_bulk of %zu failed", batch);
+                return;
+            }
+
+            kfree_bulk(ptrs, batch);
+            bulk += hal::Timer::get_cycles() - start;
+        }
+
+        size_t ops = batches * batch;
+
+        LOG_INFO("bench: %zu-object batches: kmalloc/kfree %zu ops/s, bulk %zu ops/s", batch,
+                 ops_per_sec(ops, single), ops_per_sec(ops, bulk));
+    }
+}
+
+void BootBench::map_ranges() {
+    PageMap map = PageMap();
+    PageMap::create_new(&map);
+
+    if (map.get_root_phys() == 0) {
+        LOG_ERROR("bench: no memory for a scratch page map");
+        return;
+    }
+
+    size_t pages = MAP_LENGTH / PAGE_SIZE_4K;
+    size_t start = hal::Timer::get_cycles();
+
+    for (size_t off = 0; off < MAP_LENGTH; off += PAGE_SIZE_4K) {
+        if (!map.map(MAP_VIRT + off, MAP_PHYS + off, MAP_FLAGS, CacheType::WriteBack,
+                     PageSize::Size4K, 0, false)) {
+            LOG_ERROR("bench: map failed at 0x%lx", MAP_VIRT + off);
+            break;
+        }
+    }
+
+    report("map 1GB per page", pages, hal::Timer::get_cycles() - start);
+
+    {
+        TlbGather gather(&map);
+        start = hal::Timer::get_cycles();
+
+        for (size_t off = 0; off < MAP_LENGTH; off += PAGE_SIZE_4K) {
+            map.unmap(MAP_VIRT + off, gather);
+        }
+
+        gather.finish();
+        report("unmap 1GB per page", pages, hal::Timer::get_cycles() - start);
+    }
+
+    start = hal::Timer::get_cycles();
+    map.map_range(MAP_VIRT, MAP_PHYS, MAP_LENGTH, MAP_FLAGS, CacheType::WriteBack);
+    report("map_range 1GB", pages, hal::Timer::get_cycles() - start);
+
+    {
+        TlbGather gather(&map);
+        start = hal::Timer::get_cycles();
+
+        map.unmap_range(MAP_VIRT, MAP_LENGTH, gather);
+        gather.finish();
+        report("unmap_range 1GB", pages, hal::Timer::get_cycles() - start);
+    }
+
+    // The tables below the root were pruned by the unmaps; the root's upper
+    // half is the shared kernel one, so only the root page itself is ours.
+    PhysicalManager::free(reinterpret_cast<void*>(map.get_root_phys()));
+}
+#else
+void BootBench::run() {}
+#endif
+}  // namespace kernel::memory
\ No newline at end of file
@@ -0,0 +1,273 @@
+#include "memory/compaction.hpp"
+#include "hal/numa.hpp"
+#include "hal/smp_manager.hpp"
+#include "hal/timer.hpp"
+#include "libs/log.hpp"
+#include "memory/memory.hpp"
+#include "memory/pmm.hpp"
+#include "memory/user_address_space.hpp"
+#include "task/process.hpp"
+#include "task/scheduler.hpp"
+#include <algorithm>
+#include <string.h>
+
+namespace kernel::memory {
+namespace {
+// A 2MB block is a candidate while at most this many of its pages are used.
+constexpr size_t COMPACT_MAX_USED = 64;
+
+// Address spaces that may share one block; more than that and we skip it.
+constexpr size_t COMPACT_MAX_SPACES = 16;
+
+// The thread wakes every COMPACT_INTERVAL_MS and tries up to COMPACT_BATCH
+// blocks, as long as fewer than COMPACT_LOW_WATER free 2MB blocks are left.
+constexpr size_t COMPACT_INTERVAL_MS = 1000;
+constexpr size_t COMPACT_BATCH       = 8;
+constexpr size_t COMPACT_LOW_WATER   = 32;
+
+struct Migration {
+    UserAddressSpace* space;
+    uintptr_t virt;
+    uintptr_t old_phys;
+    uintptr_t new_phys;
+    uintptr_t entry;  // PTE saved by `PageMap::detach`
+};
+
+// Only the caller holding the isolated block (see `isolate_block`) uses the
+// scratch arrays, so they need no lock of their own.
+struct {
+    Migration pages[COMPACT_MAX_USED];
+    size_t page_count;
+
+    UserAddressSpace* locked[COMPACT_MAX_SPACES];
+    size_t locked_count;
+
+    uintptr_t new_frames[COMPACT_MAX_USED];
+    uintptr_t old_frames[COMPACT_MAX_USED];
+
+    CompactionStats stats;
+} compact_state;
+
+struct CollectCtx {
+    UserAddressSpace* space;
+    uintptr_t base;
+    bool overflow;
+};
+
+bool collect_leaf(void* arg, uintptr_t virt_addr, uintptr_t phys_addr, size_t size) {
+    CollectCtx* ctx = static_cast<CollectCtx*>(arg);
+
+    // Huge frames never sit in a mostly-free block
+    if ((size != PAGE_SIZE_4K) || (phys_addr < ctx->base) ||
+        (phys_addr >= (ctx->base + PAGE_SIZE_2M))) {
+        return true;
+    }
+
+    if (compact_state.page_count == COMPACT_MAX_USED) {
+        ctx->overflow = true;
+        return false;
+    }
+
+    compact_state.pages[compact_state.page_count++] = {ctx->space, virt_addr, phys_addr, 0, 0};
+    return true;
+}
+}  // namespace
+
+bool Compactor::collect(UserAddressSpace& space, uintptr_t base) {
+    CollectCtx ctx = {&space, base, false};
+
+    UserVmRegion* region = space.root;
+
+    while (region && region->left) {
+        region = region->left;
+    }
+
+    // Only present entries are visited, so unpopulated lazy regions cost a
+    // few table reads rather than a walk per page.
+    for (; region && !ctx.overflow; region = space.successor(region)) {
+        space.page_map->walk(region->start, region->size, collect_leaf, &ctx);
+    }
+
+    return !ctx.overflow;
+}
+
+bool Compactor::migrate(uintptr_t base, size_t used) {
+    compact_state.page_count   = 0;
+    compact_state.locked_count = 0;
+
+    // Take every destination frame before any lock, so allocating (which
+    // may reclaim) never runs under an address-space mutex, and running out
+    // of memory can't leave a block half moved.
+    uint32_t node    = hal::Numa::node_of_addr(base);
+    size_t allocated = 0;
+
+    while (allocated < used) {
+        void* frame = PhysicalManager::alloc_on_node(node);
+
+        if (frame == nullptr) {
+            break;
+        }
+
+        compact_state.new_frames[allocated++] = reinterpret_cast<uintptr_t>(frame);
+    }
+
+    bool ok = (allocated == used);
+
+    if (ok) {
+        UserAddressSpace::Registry& registry = UserAddressSpace::registry();
+        LockGuard guard(registry.lock);
+
+        ok = move_pages(base, used);
+    }
+
+    if (!ok) {
+        for (size_t i = 0; i < allocated; ++i) {
+            PhysicalManager::free(reinterpret_cast<void*>(compact_state.new_frames[i]));
+        }
+    }
+
+    return ok;
+}
+
+bool Compactor::move_pages(uintptr_t base, size_t used) {
+    UserAddressSpace::Registry& registry = UserAddressSpace::registry();
+    bool ok                              = true;
+
+    // Find the mapping of every page in use. A space mapping any of them
+    // stays locked until its PTEs point at the new frames, which holds off
+    // its page faults and unmaps for the duration.
+    for (UserAddressSpace& space : registry.spaces) {
+        space.mutex.lock();
+
+        size_t before = compact_state.page_count;
+        ok            = collect(space, base);
+
+        if (compact_state.page_count == before) {
+            space.mutex.unlock();
+        } else if (compact_state.locked_count == COMPACT_MAX_SPACES) {
+            space.mutex.unlock();
+            ok = false;
+        } else {
+            compact_state.locked[compact_state.locked_count++] = &space;
+        }
+
+        if (!ok) {
+            break;
+        }
+    }
+
+    // A page nobody maps is kernel memory, and a page mapped more than once
+    // can't be copied without breaking the sharing. Either pins the block,
+    // as does a reference held by anyone but the one mapping.
+    ok = ok && (compact_state.page_count == used);
+
+    for (size_t i = 0; ok && (i < compact_state.page_count); ++i) {
+        PageFrame* frame = PhysicalManager::frame(compact_state.pages[i].old_phys);
+
+        ok = (frame != nullptr) && (frame->refcount.load(std::memory_order_relaxed) == 1) &&
+             (frame->mapcount.load(std::memory_order_relaxed) == 1);
+    }
+
+    if (ok) {
+        // Unmap the whole block, then one flush per address space: after it
+        // no CPU can still be writing through an old translation.
+        for (size_t i = 0; i < compact_state.page_count; ++i) {
+            Migration& page = compact_state.pages[i];
+
+            page.new_phys = compact_state.new_frames[i];
+            page.space->page_map->detach(page.virt, page.entry);
+        }
+
+        for (size_t s = 0; s < compact_state.locked_count; ++s) {
+            UserAddressSpace* space = compact_state.locked[s];
+            uintptr_t lo            = UINTPTR_MAX;
+            uintptr_t hi            = 0;
+
+            for (size_t i = 0; i < compact_state.page_count; ++i) {
+                if (compact_state.pages[i].space == space) {
+                    lo = std::min(lo, compact_state.pages[i].virt);
+                    hi = std::max(hi, compact_state.pages[i].virt);
+                }
+            }
+
+            space->page_map->flush_tlb(lo, ((hi - lo) / PAGE_SIZE_4K) + 1);
+            compact_state.stats.shootdowns++;
+        }
+
+        for (size_t i = 0; i < compact_state.page_count; ++i) {
+            Migration& page = compact_state.pages[i];
+
+            memcpy(reinterpret_cast<void*>(to_higher_half(page.new_phys)),
+                   reinterpret_cast<void*>(to_higher_half(page.old_phys)), PAGE_SIZE_4K);
+
+            page.space->page_map->reattach(page.virt, page.entry, page.new_phys);
+            compact_state.old_frames[i] = page.old_phys;
+        }
+    }
+
+    for (size_t i = 0; i < compact_state.locked_count; ++i) {
+        compact_state.locked[i]->mutex.unlock();
+    }
+
+    return ok;
+}
+
+bool Compactor::compact_block() {
+    size_t used    = 0;
+    uintptr_t base = PhysicalManager::isolate_block(COMPACT_MAX_USED, used);
+
+    if (base == 0) {
+        return false;
+    }
+
+    size_t start = hal::Timer::get_ticks_ns();
+    bool moved   = migrate(base, used);
+
+    // On failure nothing was moved and only the isolated pages go back.
+    PhysicalManager::release_block(base, compact_state.old_frames,
+                                   moved ? compact_state.page_count : 0);
+
+    CompactionStats& stats = compact_state.stats;
+    stats.blocks_scanned++;
+    stats.migrate_ns += hal::Timer::get_ticks_ns() - start;
+
+    if (moved) {
+        stats.blocks_compacted++;
+        stats.pages_migrated += compact_state.page_count;
+
+        LOG_DEBUG("Compactor: freed 2MB block 0x%lx (%zu pages moved)", base,
+                  compact_state.page_count);
+    } else {
+        stats.blocks_skipped++;
+    }
+
+    return true;
+}
+
+CompactionStats Compactor::get_stats() {
+    return compact_state.stats;
+}
+
+void Compactor::worker(void*) {
+    while (true) {
+        task::Scheduler::get().sleep(COMPACT_INTERVAL_MS);
+
+        for (size_t i = 0; i < COMPACT_BATCH; ++i) {
+            if (PhysicalManager::free_huge_blocks() >= COMPACT_LOW_WATER) {
+                break;
+            }
+
+            if (!compact_block()) {
+                break;
+            }
+        }
+    }
+}
+
+void Compactor::start() {
+    task::Thread* thread = new task::Thread(task::Process::kernel_proc, worker, nullptr);
+    cpu::CpuCoreManager::get().get_current_core()->sched.add_thread(thread);
+
+    LOG_INFO("Compactor: started (low water %zu free 2MB blocks)", COMPACT_LOW_WATER);
+}
+}  // namespace kernel::memory
\ No newline at end of file
@@ -1,173 +1,179 @@
 #include "memory/heap.hpp"
 #include "boot/boot.h"
+#include "memory/heap_profile.hpp"
+#include "memory/kmem_cache.hpp"
 #include "hal/smp_manager.hpp"
 #include "libs/log.hpp"
 #include "memory/memory.hpp"
+#include "memory/pagemap.hpp"
+#include "memory/pmm.hpp"
+#include "memory/reclaim.hpp"
 #include "memory/vmm.hpp"
 #include "libs/math.hpp"
 #include <string.h>
+#include <algorithm>
 #include <atomic>
 
 namespace kernel::memory {
-std::atomic<HeapMap::Node*> HeapMap::root = nullptr;
-SpinLock HeapMap::lock;
+namespace {
+Shrinker slab_shrinker;
+}  // namespace
 
-Slab* MetadataAllocator::alloc() {
-    LockGuard guard(this->lock);
-
-    // If we have a free slab available, use it
-    if (this->free_pool) {
-        Slab* s         = this->free_pool;
-        this->free_pool = s->next;
+void MetadataAllocator::link(Page* page) {
+    page->prev = nullptr;
+    page->next = this->avail;
 
-        return new (s) Slab();
+    if (this->avail) {
+        this->avail->prev = page;
     }
 
-    if (!this->head || (offset + sizeof(Slab) > sizeof(Page::data))) {
-        // need a new page
-        void* ptr = VirtualManager::allocate(1);
+    this->avail = page;
+    this->avail_count++;
+}
 
-        if (!ptr) {
-            return nullptr;
-        }
+void MetadataAllocator::unlink(Page* page) {
+    if (page->prev) {
+        page->prev->next = page->next;
+    } else {
+        this->avail = page->next;
+    }
 
-        Page* pg     = reinterpret_cast<Page*>(ptr);
-        pg->next     = this->head;
-        this->head   = pg;
-        this->offset = 0;
+    if (page->next) {
+        page->next->prev = page->prev;
     }
 
-    Slab* s = reinterpret_cast<Slab*>(&this->head->data[offset]);
-    this->offset += sizeof(Slab);
-    return new (s) Slab();
+    this->avail_count--;
 }
 
-void MetadataAllocator::free(Slab* s) {
-    LockGuard guard(this->lock);
-    s->next         = this->free_pool;
-    this->free_pool = s;
-}
+Slab* MetadataAllocator::alloc() {
+    this->lock.lock();
 
-MetadataAllocator& MetadataAllocator::get() {
-    static MetadataAllocator allocator;
-    return allocator;
-}
+    Page* page = this->avail;
 
-void HeapMap::set(void* ptr, Slab* meta) {
-    LockGuard guard(lock);
-    uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+    if (!page) {
+        // Getting a page may run reclaim, and the slab shrinker frees
+        // structs back here, so it must happen with the lock dropped.
+        this->lock.unlock();
+        page = static_cast<Page*>(alloc_slab_pages(1));
 
-    Node* l4 = root.load(std::memory_order_relaxed);
+        if (!page) {
+            return nullptr;
+        }
 
-    if (!l4) {
-        l4 = reinterpret_cast<Node*>(VirtualManager::allocate(1));
-        memset(l4, 0, PAGE_SIZE_4K);
+        page->free_list = nullptr;
+        page->carved    = 0;
+        page->live      = 0;
 
-        root.store(l4, std::memory_order_release);
+        this->lock.lock();
+        this->link(page);
     }
 
-    // Level 4 -> Level 3
-    uintptr_t i4 = (addr >> 39) & MASK;
-    Node* l3     = static_cast<Node*>(l4->entries[i4].load(std::memory_order_relaxed));
-    if (!l3) {
-        l3 = reinterpret_cast<Node*>(VirtualManager::allocate(1));
-        memset(l3, 0, PAGE_SIZE_4K);
+    Slab* s;
 
-        l4->entries[i4].store(l3, std::memory_order_release);
+    // Reuse a released struct before carving a new one
+    if (page->free_list) {
+        s               = page->free_list;
+        page->free_list = s->next;
+    } else {
+        s = reinterpret_cast<Slab*>(page + 1) + page->carved++;
     }
 
-    // Level 3 -> Level 2
-    uintptr_t i3 = (addr >> 30) & MASK;
-    Node* l2     = static_cast<Node*>(l3->entries[i3].load(std::memory_order_relaxed));
-    if (!l2) {
-        l2 = reinterpret_cast<Node*>(VirtualManager::allocate(1));
-        memset(l2, 0, PAGE_SIZE_4K);
+    page->live++;
 
-        l3->entries[i3].store(l2, std::memory_order_release);
+    if (!page->free_list && (page->carved == SLABS_PER_PAGE)) {
+        this->unlink(page);
     }
 
-    // Level 2 -> Level 1
-    uintptr_t i2 = (addr >> 21) & MASK;
-    Node* l1     = static_cast<Node*>(l2->entries[i2].load(std::memory_order_relaxed));
-    if (!l1) {
-        l1 = reinterpret_cast<Node*>(VirtualManager::allocate(1));
-        memset(l1, 0, PAGE_SIZE_4K);
+    this->lock.unlock();
+    return new (s) Slab();
+}
 
-        l2->entries[i2].store(l1, std::memory_order_release);
-    }
+void MetadataAllocator::free(Slab* s) {
+    LockGuard guard(this->lock);
 
-    uintptr_t i1 = (addr >> 12) & MASK;
-    l1->entries[i1].store(meta, std::memory_order_release);
-}
+    uintptr_t base = align_down(reinterpret_cast<uintptr_t>(s), PAGE_SIZE_4K);
+    Page* page     = reinterpret_cast<Page*>(base);
+    bool had_room  = page->free_list || (page->carved < SLABS_PER_PAGE);
 
-Slab* HeapMap::get(void* ptr) {
-    uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+    s->next         = page->free_list;
+    page->free_list = s;
+    page->live--;
 
-    Node* l4 = root.load(std::memory_order_acquire);
-    if (!l4) {
-        return nullptr;
+    if (!had_room) {
+        this->link(page);
     }
 
-    uintptr_t i4 = (addr >> 39) & MASK;
-    Node* l3     = static_cast<Node*>(l4->entries[i4].load(std::memory_order_acquire));
-    if (!l3) {
-        return nullptr;
+    // Keep one page with room around so a lone alloc/free pair doesn't
+    // bounce a page through the PMM every time.
+    if ((page->live == 0) && (this->avail_count > 1)) {
+        this->unlink(page);
+        free_slab_pages(page, 1);
     }
+}
 
-    uintptr_t i3 = (addr >> 30) & MASK;
-    Node* l2     = static_cast<Node*>(l3->entries[i3].load(std::memory_order_acquire));
-    if (!l2) {
-        return nullptr;
-    }
+MetadataAllocator& MetadataAllocator::get() {
+    static MetadataAllocator allocator;
+    return allocator;
+}
 
-    uintptr_t i2 = (addr >> 21) & MASK;
-    Node* l1     = static_cast<Node*>(l2->entries[i2].load(std::memory_order_acquire));
-    if (!l1) {
-        return nullptr;
+PageFrame* SlabMap::frame_of(void* ptr) {
+    uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+
+    // Past the end of RAM means the VMM heap, above the HHDM
+    if (PageFrame* frame = PhysicalManager::frame(from_higher_half(addr))) {
+        return frame;
     }
 
-    uintptr_t i1 = (addr >> 12) & MASK;
-    return static_cast<Slab*>(l1->entries[i1].load(std::memory_order_acquire));
+    return PhysicalManager::frame(PageMap::get_kernel_map()->translate(addr));
 }
 
-void HeapTLB::init() {
-    memset(this->entries, 0, sizeof(this->entries));
-}
+void SlabMap::set(void* ptr, size_t pages, Slab* meta) {
+    for (size_t i = 0; i < pages; ++i) {
+        PageFrame* frame = frame_of(static_cast<char*>(ptr) + (i * PAGE_SIZE_4K));
 
-Slab* HeapTLB::lookup(void* ptr) {
-    uintptr_t addr      = reinterpret_cast<uintptr_t>(ptr);
-    uintptr_t page_base = align_down(addr, PAGE_SIZE_4K);
+        if (!frame) {
+            continue;
+        }
 
-    // Use bits 12-18 of the address as mask
-    size_t idx = (page_base >> 12) & TLB_MASK;
+        frame->slab = meta;
 
-    if (this->entries[idx].page_base == page_base) {
-        // TLB Hit!
-        return this->entries[idx].slab;
+        if (meta) {
+            frame->flags |= FrameSlab;
+        } else {
+            frame->flags &= ~FrameSlab;
+        }
     }
-
-    return nullptr;
 }
 
-void HeapTLB::insert(void* ptr, Slab* s) {
-    uintptr_t addr      = reinterpret_cast<uintptr_t>(ptr);
-    uintptr_t page_base = align_down(addr, PAGE_SIZE_4K);
+Slab* SlabMap::get(void* ptr) {
+    PageFrame* frame = frame_of(ptr);
 
-    size_t idx = (page_base >> 12) & TLB_MASK;
+    if (!frame || !(frame->flags & FrameSlab)) {
+        return nullptr;
+    }
 
-    this->entries[idx].page_base = page_base;
-    this->entries[idx].slab      = s;
+    return frame->slab;
 }
 
-SlubAllocator::SlubAllocator() {
-    size_t s = 16;
+void* alloc_slab_pages(size_t pages) {
+    void* phys = PhysicalManager::alloc(pages);
+    return phys ? to_higher_half(phys) : nullptr;
+}
+
+void free_slab_pages(void* base, size_t pages) {
+    PhysicalManager::free(from_higher_half(base), pages);
+}
 
+SlubAllocator::SlubAllocator() {
     for (int i = 0; i < NUM_CLASSES; ++i) {
-        this->size_classes[i].size    = s;
+        this->size_classes[i].size    = CLASS_SIZES[i];
+        this->size_classes[i].pages   = slab_pages(CLASS_SIZES[i]);
         this->size_classes[i].partial = nullptr;
         this->size_classes[i].empty   = nullptr;
 
-        s *= 2;
+        this->size_classes[i].nr_active  = 0;
+        this->size_classes[i].nr_partial = 0;
+        this->size_classes[i].nr_empty   = 0;
     }
 }
 
@@ -183,6 +189,15 @@ void SlubAllocator::init() {
 
     memset(this->cpu_caches, 0, pages * PAGE_SIZE_4K);
 
+    slab_shrinker.name  = "slab-empty";
+    slab_shrinker.count = shrink_count;
+    slab_shrinker.scan  = shrink_scan;
+
+    slab_shrinker.reenters_heap = true;
+    Reclaimer::register_shrinker(slab_shrinker);
+
+    HeapProfiler::init(this->num_cpus);
+
     this->initialized = true;
 }
 
@@ -210,67 +225,159 @@ void* SlubAllocator::allocate(size_t size) {
         return this->take_object(cache.active);
     }
 
-    Slab* new_slab = this->refill_slab(idx);
+    Slab* s = this->ready_slab(cache, idx);
+    return s ? this->take_object(s) : nullptr;
+}
 
-    if (new_slab) {
-        cache.active = new_slab;
-        return this->take_object(new_slab);
+void* SlubAllocator::reallocate(void* ptr, size_t size) {
+    if (!ptr) {
+        return this->allocate(size);
     }
 
-    return nullptr;
+    if (size == 0) {
+        this->free(ptr);
+        return nullptr;
+    }
+
+    Slab* s = SlabMap::get(ptr);
+
+    if (unlikely(!s)) {
+        PANIC("Realloc of an invalid pointer!");
+        return nullptr;
+    }
+
+    if (s->cache) {
+        LOG_WARN("Heap: can't resize %p, it belongs to cache %s", ptr, s->cache->get_name());
+        return nullptr;
+    }
+
+    size_t capacity = 0;
+
+    if (!s->is_large) {
+        capacity = CLASS_SIZES[s->size_class];
+    } else {
+        capacity = static_cast<size_t>(s->in_use) * PAGE_SIZE_4K;
+
+        // A mapped allocation can take over the free virtual space after it
+        if ((size > capacity) && (s->is_large == LARGE_MAPPED)) {
+            size_t pages = div_roundup(size, PAGE_SIZE_4K);
+
+            if ((pages <= UINT16_MAX) && VirtualManager::grow(ptr, pages)) {
+                s->in_use = static_cast<uint16_t>(pages);
+                return ptr;
+            }
+        }
+    }
+
+    if (size <= capacity) {
+        return ptr;
+    }
+
+    void* new_ptr = this->allocate(size);
+
+    if (!new_ptr) {
+        return nullptr;
+    }
+
+    memcpy(new_ptr, ptr, capacity);
+    this->free(ptr);
+    return new_ptr;
 }
 
-void SlubAllocator::free_slow(void* ptr, CpuCache& cache) {
-    Slab* s = cache.tlb.lookup(ptr);
+bool SlubAllocator::allocate_bulk(size_t size, size_t count, void** out) {
+    if (!this->initialized) {
+        return false;
+    }
+
+    int idx    = this->get_size_idx(size);
+    size_t got = 0;
 
-    if (!s) {
-        uintptr_t page_base = align_down(reinterpret_cast<uintptr_t>(ptr), PAGE_SIZE_4K);
+    if (idx == -1) {
+        while ((got < count) && (out[got] = this->alloc_large(size))) {
+            got++;
+        }
+    } else {
+        LockGuard guard(this->irq_lock);
+
+        uint32_t cpu_id = 0;
 
-        // Check the 8 active slabs currently loaded in L1 cache
-        for (int i = 0; i < NUM_CLASSES; ++i) {
-            Slab* active = cache.classes[i].active;
+        if (cpu::CpuCoreManager::get().initialized()) {
+            cpu_id = cpu::CpuCoreManager::get().get_current_core()->core_idx;
+        }
+
+        auto& cache = this->cpu_caches[cpu_id].classes[idx];
 
-            if (active && (reinterpret_cast<uintptr_t>(active->page_addr) == page_base)) {
-                s = active;
+        while (got < count) {
+            Slab* s = this->ready_slab(cache, idx);
 
-                // Update the TLB
-                cache.tlb.insert(ptr, s);
+            if (!s) {
                 break;
             }
-        }
 
-        // Check the radix tree
-        if (!s) {
-            s = HeapMap::get(ptr);
+            // Hand out as much of the freelist as the caller still wants
+            void* obj  = s->freelist;
+            size_t run = 0;
 
-            if (unlikely(!s)) {
-                PANIC("Double free or invalid pointer!");
-                return;
+            while (obj && ((got + run) < count)) {
+                out[got + run++] = obj;
+                obj              = *reinterpret_cast<void**>(obj);
             }
 
-            cache.tlb.insert(ptr, s);
+            s->freelist = obj;
+            s->in_use += run;
+            got += run;
         }
     }
 
+    if (got < count) {
+        this->free_bulk(out, got);
+        return false;
+    }
+
+    return true;
+}
+
+void SlubAllocator::free(void* ptr) {
+    if (unlikely(!ptr)) {
+        return;
+    }
+
+    Slab* s = SlabMap::get(ptr);
+
+    if (unlikely(!s)) {
+        PANIC("Double free or invalid pointer!");
+        return;
+    }
+
+    // An object of a typed cache goes back there
+    if (s->cache) {
+        s->cache->free(ptr);
+        return;
+    }
+
     if (unlikely(s->is_large)) {
         this->free_large(s, ptr);
         return;
     }
 
-    auto& class_cache = cache.classes[s->size_class];
+    LockGuard guard(this->irq_lock);
 
-    if (unlikely(class_cache.free_count >= FREE_BATCH_SIZE)) {
-        this->flush(s->size_class, class_cache);
+    uint32_t cpu_id = 0;
+
+    if (cpu::CpuCoreManager::get().initialized()) {
+        cpu_id = cpu::CpuCoreManager::get().get_current_core()->core_idx;
     }
 
-    class_cache.free_buf[class_cache.free_count++] = ptr;
-}
+    auto& cache = this->cpu_caches[cpu_id];
 
-void SlubAllocator::free(void* ptr) {
-    if (unlikely(!ptr)) {
-        return;
+    if (cache.classes[s->size_class].active == s) {
+        this->put_object(s, ptr);
+    } else {
+        this->remote_free(s, ptr, ptr, 1);
     }
+}
 
+void SlubAllocator::free_bulk(void** ptrs, size_t count) {
     LockGuard guard(this->irq_lock);
 
     uint32_t cpu_id = 0;
@@ -280,20 +387,131 @@ void SlubAllocator::free(void* ptr) {
     }
 
     auto& cache = this->cpu_caches[cpu_id];
+    size_t i    = 0;
+    Slab* next  = nullptr;  // Slab of ptrs[i], when already looked up
+
+    while (i < count) {
+        void* head = ptrs[i];
 
-    Slab* s = cache.tlb.lookup(ptr);
+        if (unlikely(!head)) {
+            next = nullptr;
+            i++;
+            continue;
+        }
 
-    if (likely(s)) {
-        auto& class_cache = cache.classes[s->size_class];
+        Slab* s = next ? next : SlabMap::get(head);
+        next    = nullptr;
 
-        if (likely(class_cache.free_count < FREE_BATCH_SIZE)) {
-            class_cache.free_buf[class_cache.free_count++] = ptr;
+        if (unlikely(!s)) {
+            PANIC("Double free or invalid pointer!");
             return;
         }
+
+        if (s->cache) {
+            s->cache->free(head);
+            i++;
+            continue;
+        }
+
+        if (unlikely(s->is_large)) {
+            this->free_large(s, head);
+            i++;
+            continue;
+        }
+
+        // Chain up the objects that follow from the same slab, so the whole
+        // run goes back with one splice or one remote push.
+        void* tail = head;
+        size_t run = 1;
+
+        while ((i + run) < count) {
+            void* ptr = ptrs[i + run];
+
+            if (!ptr) {
+                break;
+            }
+
+            if ((next = SlabMap::get(ptr)) != s) {
+                break;
+            }
+
+            *reinterpret_cast<void**>(tail) = ptr;
+            tail                            = ptr;
+            run++;
+        }
+
+        if (cache.classes[s->size_class].active == s) {
+            *reinterpret_cast<void**>(tail) = s->freelist;
+            s->freelist                     = head;
+            s->in_use -= run;
+        } else {
+            this->remote_free(s, head, tail, run);
+        }
+
+        i += run;
+    }
+}
+
+void SlubAllocator::free_sized(void* ptr, size_t size) {
+    if (unlikely(!ptr)) {
+        return;
+    }
+
+    int idx = this->get_size_idx(size);
+
+    // The size names the class. An object of this CPU's active slab of that
+    // class goes straight back without looking its slab up at all.
+    if (idx != -1) {
+        LockGuard guard(this->irq_lock);
+
+        uint32_t cpu_id = 0;
+
+        if (cpu::CpuCoreManager::get().initialized()) {
+            cpu_id = cpu::CpuCoreManager::get().get_current_core()->core_idx;
+        }
+
+        Slab* active   = this->cpu_caches[cpu_id].classes[idx].active;
+        uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+
+        if (active && ((addr - reinterpret_cast<uintptr_t>(active->page_addr)) <
+                       (this->size_classes[idx].pages * PAGE_SIZE_4K))) {
+            this->put_object(active, ptr);
+            return;
+        }
+    }
+
+    this->free(ptr);
+}
+
+Slab* SlubAllocator::ready_slab(CpuCache::ClassCache& cache, int idx) {
+    if (Slab* active = cache.active) {
+        if (active->freelist || this->drain_remote(active, SLAB_FROZEN)) {
+            return active;
+        }
+
+        // Fully allocated. A remote free may still slip in before we let go,
+        // in which case the slab stays ours.
+        if (!this->retire_slab(active)) {
+            this->drain_remote(active, SLAB_FROZEN);
+            return active;
+        }
+
+        cache.active = nullptr;
+    }
+
+    Slab* new_slab = this->refill_slab(idx);
+
+    if (!new_slab) {
+        return nullptr;
     }
 
-    // Could be anything: TLB Miss, Buffer Full, Large Page
-    this->free_slow(ptr, cache);
+    cache.active = new_slab;
+
+    if (new_slab->freelist || this->drain_remote(new_slab, SLAB_FROZEN)) {
+        return new_slab;
+    }
+
+    return nullptr;
 }
 
 void* SlubAllocator::take_object(Slab* s) {
@@ -304,24 +522,154 @@ void* SlubAllocator::take_object(Slab* s) {
     return obj;
 }
 
+void SlubAllocator::put_object(Slab* s, void* ptr) {
+    *reinterpret_cast<void**>(ptr) = s->freelist;
+    s->freelist                    = ptr;
+    s->in_use--;
+}
+
+void SlubAllocator::remote_free(Slab* s, void* head, void* tail, size_t count) {
+    uintptr_t old = s->remote.load(std::memory_order_relaxed);
+    uintptr_t desired;
+
+    // Push the chain onto the remote list. FROZEN stays, FLOATING is
+    // consumed, and an unowned slab counts down its allocated objects.
+    do {
+        *reinterpret_cast<void**>(tail) = remote_head(old);
+        desired = (reinterpret_cast<uintptr_t>(head) & SLAB_HEAD_MASK) | (old & SLAB_FROZEN);
+
+        if (!(old & SLAB_FROZEN)) {
+            desired |= (old & ~(SLAB_COUNT_ONE - 1)) - (count * SLAB_COUNT_ONE);
+        }
+    } while (!s->remote.compare_exchange_weak(old, desired, std::memory_order_acq_rel,
+                                              std::memory_order_relaxed));
+
+    // The owner picks it up on its next refill
+    if (old & SLAB_FROZEN) {
+        return;
+    }
+
+    bool was_floating = (old & SLAB_FLOATING) != 0;
+    bool now_empty    = (desired >> SLAB_COUNT_SHIFT) == 0;
+
+    if (!was_floating && !now_empty) {
+        return;
+    }
+
+    SizeClass& sc   = this->size_classes[s->size_class];
+    bool to_release = false;
+
+    {
+        LockGuard guard(sc.lock);
+
+        // First free into a floating slab: nobody else knows it has room again
+        if (was_floating) {
+            slab_list_add(sc.partial, s);
+            s->list = SlabList::Partial;
+            sc.nr_partial++;
+        }
+
+        to_release = this->settle_slab(sc, s);
+    }
+
+    if (to_release) {
+        this->release_slab(s);
+    }
+}
+
+size_t SlubAllocator::drain_remote(Slab* s, uintptr_t state) {
+    uintptr_t head = s->remote.exchange(state, std::memory_order_acquire);
+    void* first    = remote_head(head);
+
+    if (!first) {
+        return 0;
+    }
+
+    void* last   = first;
+    size_t count = 1;
+
+    while (void* next = *reinterpret_cast<void**>(last)) {
+        last = next;
+        count++;
+    }
+
+    *reinterpret_cast<void**>(last) = s->freelist;
+    s->freelist                     = first;
+    s->in_use -= count;
+    return count;
+}
+
+bool SlubAllocator::retire_slab(Slab* s) {
+    uintptr_t expected = SLAB_FROZEN;
+    uintptr_t floating = SLAB_FLOATING | (static_cast<uintptr_t>(s->in_use) << SLAB_COUNT_SHIFT);
+
+    if (!s->remote.compare_exchange_strong(expected, floating, std::memory_order_acq_rel)) {
+        return false;
+    }
+
+    __atomic_fetch_sub(&this->size_classes[s->size_class].nr_active, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+bool SlubAllocator::settle_slab(SizeClass& sc, Slab* s) {
+    // Only an unowned slab with every object back; a slab on `partial` can't
+    // be frozen while we hold the lock, and nothing can be freed into it.
+    if ((s->list != SlabList::Partial) ||
+        ((s->remote.load(std::memory_order_acquire) >> SLAB_COUNT_SHIFT) != 0)) {
+        return false;
+    }
+
+    this->drain_remote(s, 0);
+
+    slab_list_remove(sc.partial, s);
+    sc.nr_partial--;
+
+    if (sc.nr_empty < MAX_EMPTY_SLABS) {
+        slab_list_add(sc.empty, s);
+        s->list = SlabList::Empty;
+        sc.nr_empty++;
+        return false;
+    }
+
+    s->list = SlabList::None;
+    return true;
+}
+
+void SlubAllocator::release_slab(Slab* s) {
+    size_t pages = this->size_classes[s->size_class].pages;
+
+    SlabMap::set(s->page_addr, pages, nullptr);
+    free_slab_pages(s->page_addr, pages);
+    MetadataAllocator::get().free(s);
+}
+
 Slab* SlubAllocator::refill_slab(int idx) {
     SizeClass& sc = this->size_classes[idx];
-    LockGuard guard(sc.lock);
 
-    if (sc.partial) {
+    {
+        LockGuard guard(sc.lock);
+
         Slab* s = sc.partial;
-        this->list_remove(sc.partial, s);
-        s->next = s->prev = nullptr;
-        return s;
-    }
 
-    if (sc.empty) {
-        Slab* s = sc.empty;
-        this->list_remove(sc.empty, s);
-        return s;
+        if (s) {
+            slab_list_remove(sc.partial, s);
+            sc.nr_partial--;
+        } else if ((s = sc.empty)) {
+            slab_list_remove(sc.empty, s);
+            sc.nr_empty--;
+        }
+
+        if (s) {
+            s->list = SlabList::None;
+            s->remote.fetch_or(SLAB_FROZEN, std::memory_order_acquire);
+            __atomic_fetch_add(&sc.nr_active, 1, __ATOMIC_RELAXED);
+            return s;
+        }
     }
 
-    void* page = VirtualManager::allocate(1);
+    // A new slab is ours alone until it's returned, so it's built unlocked:
+    // getting pages may run reclaim, which takes the size class locks.
+    void* page = alloc_slab_pages(sc.pages);
 
     if (!page) {
         return nullptr;
@@ -330,15 +678,16 @@ Slab* SlubAllocator::refill_slab(int idx) {
     Slab* s = MetadataAllocator::get().alloc();
 
     if (!s) {
-        VirtualManager::free(page);
+        free_slab_pages(page, sc.pages);
         return nullptr;
     }
 
     s->page_addr  = page;
     s->size_class = static_cast<uint16_t>(idx);
-    s->total      = PAGE_SIZE_4K / sc.size;
+    s->total      = (sc.pages * PAGE_SIZE_4K) / sc.size;
     s->in_use     = 0;
     s->is_large   = 0;
+    s->remote.store(SLAB_FROZEN, std::memory_order_relaxed);
 
     char* base = reinterpret_cast<char*>(page);
 
@@ -350,60 +699,86 @@ Slab* SlubAllocator::refill_slab(int idx) {
     *reinterpret_cast<void**>(base + (s->total - 1) * sc.size) = nullptr;
     s->freelist                                                = base;
 
-    HeapMap::set(page, s);
+    // Every page of the slab maps back to it
+    SlabMap::set(base, sc.pages, s);
+
+    __atomic_fetch_add(&sc.nr_active, 1, __ATOMIC_RELAXED);
     return s;
 }
 
-void SlubAllocator::flush(int idx, CpuCache::ClassCache& cache) {
-    SizeClass& sc = this->size_classes[idx];
-    LockGuard guard(sc.lock);
+size_t SlubAllocator::shrink(size_t nr_pages) {
+    size_t freed = 0;
 
-    Slab* last_slab          = nullptr;
-    uintptr_t last_page_base = 0;
+    for (int i = 0; (i < NUM_CLASSES) && (freed < nr_pages); ++i) {
+        SizeClass& sc = this->size_classes[i];
 
-    // Process all pointers in the batch
-    for (int i = 0; i < cache.free_count; ++i) {
-        void* ptr = cache.free_buf[i];
+        while (freed < nr_pages) {
+            Slab* s;
 
-        if ((i + 1) < cache.free_count) {
-            // 0 -> Read
-            // 3 - > High temporal locality
-            __builtin_prefetch(cache.free_buf[i + 1], 0, 3);
-        }
+            {
+                LockGuard guard(sc.lock);
+                s = sc.empty;
 
-        Slab* s;
-        uintptr_t curr_page_base = align_down(reinterpret_cast<uintptr_t>(ptr), PAGE_SIZE_4K);
+                if (!s) {
+                    break;
+                }
 
-        if (curr_page_base == last_page_base) {
-            s = last_slab;
-        } else {
-            s              = HeapMap::get(ptr);
-            last_slab      = s;
-            last_page_base = curr_page_base;
-        }
+                slab_list_remove(sc.empty, s);
+                s->list = SlabList::None;
+                sc.nr_empty--;
+            }
 
-        // Return to freelist
-        *reinterpret_cast<void**>(ptr) = s->freelist;
-        s->freelist                    = ptr;
-        s->in_use--;
-
-        if (s->in_use == s->total - 1) {
-            // Transition: Full -> Partial
-            this->list_add(sc.partial, s);
-        } else if (s->in_use == 0) {
-            // Transition: Partial -> Empty
-            this->list_remove(sc.partial, s);
-            this->list_add(sc.empty, s);
+            this->release_slab(s);
+            freed += sc.pages;
         }
-        // If it remains partial -> do nothing
     }
 
-    cache.free_count = 0;
+    return freed;
+}
+
+size_t SlubAllocator::get_stats(HeapClassStats* out, size_t max) {
+    size_t count = (max < NUM_CLASSES) ? max : NUM_CLASSES;
+
+    for (size_t i = 0; i < count; ++i) {
+        SizeClass& sc = this->size_classes[i];
+        LockGuard guard(sc.lock);
+
+        out[i].object_size = sc.size;
+        out[i].slab_pages  = sc.pages;
+        out[i].active      = __atomic_load_n(&sc.nr_active, __ATOMIC_RELAXED);
+        out[i].partial     = sc.nr_partial;
+        out[i].empty       = sc.nr_empty;
+    }
+
+    return count;
+}
+
+size_t SlubAllocator::shrink_count(void*) {
+    SlubAllocator& slub = get();
+    size_t pages        = 0;
+
+    // Unlocked snapshot; it only decides whether a scan is worth it.
+    for (const SizeClass& sc : slub.size_classes) {
+        pages += __atomic_load_n(&sc.nr_empty, __ATOMIC_RELAXED) * sc.pages;
+    }
+
+    return pages;
+}
+
+size_t SlubAllocator::shrink_scan(void*, size_t nr_pages) {
+    return get().shrink(nr_pages);
 }
 
 void* SlubAllocator::alloc_large(size_t size) {
     size_t pages = div_roundup(size, PAGE_SIZE_4K);
-    void* ptr    = VirtualManager::allocate(pages);
+
+    // The page count has to fit `in_use` for krealloc
+    if (pages > UINT16_MAX) {
+        LOG_WARN("Heap: allocation of %zu bytes is too large", size);
+        return nullptr;
+    }
+
+    void* ptr = VirtualManager::allocate(pages);
 
     if (!ptr) {
         return nullptr;
@@ -417,20 +792,79 @@ void* SlubAllocator::alloc_large(size_t size) {
     }
 
     s->page_addr = ptr;
-    s->is_large  = 1;
+    s->is_large  = LARGE_MAPPED;
     s->in_use    = static_cast<uint16_t>(pages);
 
-    HeapMap::set(ptr, s);
+    // kfree only ever sees the first page
+    SlabMap::set(ptr, 1, s);
+    return ptr;
+}
+
+void* SlubAllocator::alloc_contig(size_t size, size_t alignment) {
+    size_t pages = div_roundup(size, PAGE_SIZE_4K);
+
+    // The page count has to fit `in_use` for the free
+    if (pages > UINT16_MAX) {
+        LOG_WARN("Heap: aligned allocation of %zu bytes is too large", size);
+        return nullptr;
+    }
+
+    void* phys = PhysicalManager::alloc_aligned(pages, alignment);
+
+    if (!phys) {
+        return nullptr;
+    }
+
+    Slab* s = MetadataAllocator::get().alloc();
+
+    if (!s) {
+        PhysicalManager::free(phys, pages);
+        return nullptr;
+    }
+
+    void* ptr = to_higher_half(phys);
+
+    s->page_addr = ptr;
+    s->is_large  = LARGE_CONTIG;
+    s->in_use    = static_cast<uint16_t>(pages);
+
+    SlabMap::set(ptr, 1, s);
     return ptr;
 }
 
 void SlubAllocator::free_large(Slab* s, void* ptr) {
-    size_t pages = s->in_use;
-    HeapMap::set(ptr, nullptr);
-    VirtualManager::free(ptr);
+    SlabMap::set(ptr, 1, nullptr);
+
+    if (s->is_large == LARGE_CONTIG) {
+        PhysicalManager::free(from_higher_half(ptr), s->in_use);
+    } else {
+        VirtualManager::free(ptr);
+    }
+
     MetadataAllocator::get().free(s);
 }
 
+void* SlubAllocator::allocate_aligned(size_t size, size_t alignment) {
+    if (alignment > PAGE_SIZE_4K) {
+        return this->alloc_contig(size, alignment);
+    }
+
+    int idx = this->get_size_idx(std::max(size, alignment));
+
+    // Large allocations start on a page boundary already
+    if (idx == -1) {
+        return this->alloc_large(size);
+    }
+
+    // A 3 * 2^k class is short of alignments above 2^k; the class after it
+    // is the next power of two, and the last class is a whole page.
+    while (class_align(idx) < alignment) {
+        idx++;
+    }
+
+    return this->allocate(CLASS_SIZES[idx]);
+}
+
 SlubAllocator& SlubAllocator::get() {
     static SlubAllocator allocator;
     return allocator;
@@ -438,51 +872,80 @@ SlubAllocator& SlubAllocator::get() {
 
 void kfree(void* ptr) {
     SlubAllocator& slub = SlubAllocator::get();
+    HEAP_PROFILE_FREE(ptr);
     slub.free(ptr);
 }
 
+void kfree_sized(void* ptr, size_t size) {
+    SlubAllocator& slub = SlubAllocator::get();
+    HEAP_PROFILE_FREE(ptr);
+    slub.free_sized(ptr, size);
+}
+
 void* kmalloc(size_t size) {
     SlubAllocator& slub = SlubAllocator::get();
-    return slub.allocate(size);
+    void* ptr           = slub.allocate(size);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
 }
 
-void* aligned_kalloc(size_t size, size_t alignment) {
-    if (alignment == 0 || !is_aligned(alignment, alignment)) {
-        return nullptr;
-    }
+void* krealloc(void* ptr, size_t size) {
+    SlubAllocator& slub = SlubAllocator::get();
 
-    size_t overhead = alignment + sizeof(void*);
+    void* new_ptr = slub.reallocate(ptr, size);
 
-    if (size > SIZE_MAX - overhead) {
-        return nullptr;
+    // A failed resize leaves `ptr` allocated and charged as it was; a size of
+    // 0 frees it and returns nullptr by design.
+    if (new_ptr || (size == 0)) {
+        HEAP_PROFILE_FREE(ptr);
+        HEAP_PROFILE_ALLOC(new_ptr, size);
     }
 
+    return new_ptr;
+}
+
+bool kmalloc_bulk(size_t size, size_t count, void** out) {
     SlubAllocator& slub = SlubAllocator::get();
-    void* raw_ptr       = slub.allocate(size + overhead);
-    if (!raw_ptr) {
-        return nullptr;
+
+    if (!slub.allocate_bulk(size, count, out)) {
+        return false;
     }
 
-    uintptr_t start_addr   = reinterpret_cast<uintptr_t>(raw_ptr) + sizeof(void*);
-    uintptr_t aligned_addr = align_up(start_addr, alignment);
+#if HEAP_PROFILE
+    for (size_t i = 0; i < count; ++i) {
+        HEAP_PROFILE_ALLOC(out[i], size);
+    }
+#endif
+
+    return true;
+}
+
+void kfree_bulk(void** ptrs, size_t count) {
+    SlubAllocator& slub = SlubAllocator::get();
 
-    void** stash_location = reinterpret_cast<void**>(aligned_addr - sizeof(void*));
-    *stash_location       = raw_ptr;
+#if HEAP_PROFILE
+    for (size_t i = 0; i < count; ++i) {
+        HEAP_PROFILE_FREE(ptrs[i]);
+    }
+#endif
 
-    return reinterpret_cast<void*>(aligned_addr);
+    slub.free_bulk(ptrs, count);
 }
 
-void aligned_kfree(void* ptr) {
-    if (!ptr) {
-        return;
+void* aligned_kalloc(size_t size, size_t alignment) {
+    if (!std::has_single_bit(alignment)) {
+        return nullptr;
     }
 
     SlubAllocator& slub = SlubAllocator::get();
+    void* ptr           = slub.allocate_aligned(size, alignment);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
+}
 
-    uintptr_t addr        = reinterpret_cast<uintptr_t>(ptr);
-    void** stash_location = reinterpret_cast<void**>(addr - sizeof(void*));
-    void* raw_ptr         = *stash_location;
-
-    slub.free(raw_ptr);
+void aligned_kfree(void* ptr) {
+    SlubAllocator& slub = SlubAllocator::get();
+    HEAP_PROFILE_FREE(ptr);
+    slub.free(ptr);
 }
 }  // namespace kernel::memory
\ No newline at end of file
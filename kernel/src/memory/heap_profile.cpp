@@ -0,0 +1,260 @@
+#include "memory/heap_profile.hpp"
+#include "hal/smp_manager.hpp"
+#include "libs/log.hpp"
+#include "libs/math.hpp"
+#include "memory/memory.hpp"
+#include "memory/vmm.hpp"
+#include <string.h>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+namespace kernel::memory {
+#if HEAP_PROFILE
+namespace {
+constexpr size_t SITES_PER_CPU = 1024;
+constexpr size_t LIVE_OBJECTS  = 65536;
+constexpr size_t MAX_PROBE     = 64;  // Give up past this many occupied slots
+
+static_assert(std::has_single_bit(SITES_PER_CPU) && std::has_single_bit(LIVE_OBJECTS));
+
+// Counters of one site on one CPU. Any CPU may free into it.
+struct SiteEntry {
+    std::atomic<uintptr_t> site;
+    std::atomic<size_t> allocs;
+    std::atomic<size_t> frees;
+    std::atomic<size_t> live_bytes;
+    std::atomic<size_t> peak_bytes;
+};
+
+// A pointer handed out while profiling, and what it was charged to
+struct LiveObject {
+    std::atomic<uintptr_t> ptr;  // 0 if never used, LIVE_TOMBSTONE once freed
+    SiteEntry* entry;
+    size_t size;
+};
+
+constexpr uintptr_t LIVE_TOMBSTONE = 1;
+
+SiteEntry* site_tables = nullptr;  // SITES_PER_CPU entries per CPU
+LiveObject* live_table = nullptr;
+size_t profiled_cpus   = 0;
+
+std::atomic<size_t> dropped_allocs  = 0;  // No room for the site or the pointer
+std::atomic<size_t> untracked_frees = 0;  // Allocated before init, or dropped
+
+size_t hash_of(uintptr_t key) {
+    // Fibonacci hashing; allocation addresses have their low bits in common
+    return static_cast<size_t>((key * 0x9e3779b97f4a7c15ul) >> 32);
+}
+
+SiteEntry* site_table(size_t cpu) {
+    return site_tables + (cpu * SITES_PER_CPU);
+}
+
+SiteEntry* find_site(SiteEntry* table, uintptr_t site, bool insert) {
+    size_t idx = hash_of(site);
+
+    for (size_t probe = 0; probe < MAX_PROBE; ++probe) {
+        SiteEntry& e  = table[(idx + probe) & (SITES_PER_CPU - 1)];
+        uintptr_t cur = e.site.load(std::memory_order_acquire);
+
+        if (cur == site) {
+            return &e;
+        }
+
+        if (cur == 0) {
+            if (!insert) {
+                return nullptr;
+            }
+
+            // Another CPU migrating mid-call may claim the same slot
+            if (e.site.compare_exchange_strong(cur, site, std::memory_order_acq_rel) ||
+                (cur == site)) {
+                return &e;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+uint32_t current_cpu() {
+    if (cpu::CpuCoreManager::get().initialized()) {
+        return cpu::CpuCoreManager::get().get_current_core()->core_idx;
+    }
+
+    return 0;
+}
+}  // namespace
+
+void HeapProfiler::init(size_t num_cpus) {
+    if (site_tables) {
+        return;
+    }
+
+    size_t site_pages = div_roundup(sizeof(SiteEntry) * SITES_PER_CPU * num_cpus, PAGE_SIZE_4K);
+    size_t live_pages = div_roundup(sizeof(LiveObject) * LIVE_OBJECTS, PAGE_SIZE_4K);
+
+    auto* sites = reinterpret_cast<SiteEntry*>(VirtualManager::allocate(site_pages));
+    auto* live  = reinterpret_cast<LiveObject*>(VirtualManager::allocate(live_pages));
+
+    if (!sites || !live) {
+        LOG_ERROR("heapprof: no memory for the profile tables, profiling is off");
+        return;
+    }
+
+    memset(sites, 0, site_pages * PAGE_SIZE_4K);
+    memset(live, 0, live_pages * PAGE_SIZE_4K);
+
+    profiled_cpus = num_cpus;
+    live_table    = live;
+    site_tables   = sites;
+
+    LOG_INFO("heapprof: tracking %zu sites per CPU, %zu live objects", SITES_PER_CPU,
+             LIVE_OBJECTS);
+}
+
+void HeapProfiler::record_alloc(void* site, void* ptr, size_t size) {
+    if (!ptr || !site_tables) {
+        return;
+    }
+
+    SiteEntry* e = find_site(site_table(current_cpu()), reinterpret_cast<uintptr_t>(site), true);
+
+    if (!e) {
+        dropped_allocs.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uintptr_t key = reinterpret_cast<uintptr_t>(ptr);
+    size_t idx    = hash_of(key);
+
+    for (size_t probe = 0; probe < MAX_PROBE; ++probe) {
+        LiveObject& obj = live_table[(idx + probe) & (LIVE_OBJECTS - 1)];
+        uintptr_t cur   = obj.ptr.load(std::memory_order_relaxed);
+
+        if ((cur != 0) && (cur != LIVE_TOMBSTONE)) {
+            continue;
+        }
+
+        if (!obj.ptr.compare_exchange_strong(cur, key, std::memory_order_acquire)) {
+            continue;
+        }
+
+        // Nobody can free `ptr` before we return it, so these need no ordering
+        obj.entry = e;
+        obj.size  = size;
+
+        e->allocs.fetch_add(1, std::memory_order_relaxed);
+        size_t live = e->live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+        size_t peak = e->peak_bytes.load(std::memory_order_relaxed);
+
+        while ((live > peak) &&
+               !e->peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+
+        return;
+    }
+
+    dropped_allocs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HeapProfiler::record_free(void* ptr) {
+    if (!ptr || !site_tables) {
+        return;
+    }
+
+    uintptr_t key = reinterpret_cast<uintptr_t>(ptr);
+    size_t idx    = hash_of(key);
+
+    for (size_t probe = 0; probe < MAX_PROBE; ++probe) {
+        LiveObject& obj = live_table[(idx + probe) & (LIVE_OBJECTS - 1)];
+        uintptr_t cur   = obj.ptr.load(std::memory_order_acquire);
+
+        if (cur == 0) {
+            break;
+        }
+
+        if (cur != key) {
+            continue;
+        }
+
+        SiteEntry* e = obj.entry;
+
+        e->frees.fetch_add(1, std::memory_order_relaxed);
+        e->live_bytes.fetch_sub(obj.size, std::memory_order_relaxed);
+
+        obj.ptr.store(LIVE_TOMBSTONE, std::memory_order_release);
+        return;
+    }
+
+    untracked_frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool HeapProfiler::dump() {
+    if (!site_tables) {
+        return false;
+    }
+
+    LOG_INFO("heapprof: begin dropped=%zu untracked=%zu",
+             dropped_allocs.load(std::memory_order_relaxed),
+             untracked_frees.load(std::memory_order_relaxed));
+
+    // A site shows up in the table of every CPU it allocated on; print it
+    // once, when it's first seen, with the counters of all CPUs added up.
+    // The peak is the sum of the per-CPU peaks, so an upper bound.
+    for (size_t cpu = 0; cpu < profiled_cpus; ++cpu) {
+        for (size_t i = 0; i < SITES_PER_CPU; ++i) {
+            uintptr_t site = site_table(cpu)[i].site.load(std::memory_order_acquire);
+
+            if (site == 0) {
+                continue;
+            }
+
+            bool seen = false;
+
+            for (size_t other = 0; (other < cpu) && !seen; ++other) {
+                seen = find_site(site_table(other), site, false) != nullptr;
+            }
+
+            if (seen) {
+                continue;
+            }
+
+            size_t allocs = 0;
+            size_t frees  = 0;
+            size_t live   = 0;
+            size_t peak   = 0;
+
+            for (size_t other = cpu; other < profiled_cpus; ++other) {
+                SiteEntry* e = find_site(site_table(other), site, false);
+
+                if (e) {
+                    allocs += e->allocs.load(std::memory_order_relaxed);
+                    frees += e->frees.load(std::memory_order_relaxed);
+                    live += e->live_bytes.load(std::memory_order_relaxed);
+                    peak += e->peak_bytes.load(std::memory_order_relaxed);
+                }
+            }
+
+            LOG_INFO("heapprof: site=0x%lx allocs=%zu frees=%zu live=%zu peak=%zu", site, allocs,
+                     frees, live, peak);
+        }
+    }
+
+    LOG_INFO("heapprof: end");
+    return true;
+}
+#else
+void HeapProfiler::init(size_t) {}
+
+void HeapProfiler::record_alloc(void*, void*, size_t) {}
+
+void HeapProfiler::record_free(void*) {}
+
+bool HeapProfiler::dump() {
+    return false;
+}
+#endif
+}  // namespace kernel::memory
\ No newline at end of file
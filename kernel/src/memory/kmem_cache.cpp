@@ -0,0 +1,307 @@
+#include "memory/kmem_cache.hpp"
+#include "libs/log.hpp"
+#include "libs/math.hpp"
+#include "memory/heap.hpp"
+#include "memory/reclaim.hpp"
+#include <algorithm>
+#include <bit>
+
+namespace kernel::memory {
+namespace {
+// A slab grows a page at a time until at most 1/KMEM_WASTE_FRACTION of it
+// is left over, but never past KMEM_MAX_SLAB_PAGES.
+constexpr size_t KMEM_WASTE_FRACTION = 8;
+constexpr size_t KMEM_MAX_SLAB_PAGES = 16;
+
+Shrinker kmem_shrinker;
+}  // namespace
+
+KmemCache::Registry& KmemCache::registry() {
+    static Registry registry;
+    return registry;
+}
+
+KmemCache* KmemCache::create(const char* name, size_t size, size_t align, Constructor ctor) {
+    if (align == 0) {
+        align = sizeof(void*);
+    }
+
+    if ((size == 0) || !std::has_single_bit(align) || (align > PAGE_SIZE_4K)) {
+        LOG_WARN("kmem: bad cache %s (size=%zu align=%zu)", name, size, align);
+        return nullptr;
+    }
+
+    KmemCache* cache = new KmemCache();
+
+    if (!cache) {
+        return nullptr;
+    }
+
+    align = std::max(align, sizeof(void*));
+
+    cache->name        = name;
+    cache->object_size = size;
+    cache->ctor        = ctor;
+
+    // A constructed object keeps its state while free, so the link can't
+    // overlay it and goes right behind it instead.
+    cache->link_offset = ctor ? align_up(size, sizeof(void*)) : 0;
+    cache->stride      = align_up(std::max(size, cache->link_offset + sizeof(void*)), align);
+
+    size_t pages = div_roundup(cache->stride, PAGE_SIZE_4K);
+
+    while (pages < KMEM_MAX_SLAB_PAGES) {
+        size_t bytes = pages * PAGE_SIZE_4K;
+
+        if (((bytes % cache->stride) * KMEM_WASTE_FRACTION) <= bytes) {
+            break;
+        }
+
+        pages++;
+    }
+
+    size_t bytes       = pages * PAGE_SIZE_4K;
+    cache->slab_pages  = pages;
+    cache->objects     = bytes / cache->stride;
+    cache->color_unit  = std::max(align, static_cast<size_t>(CACHE_LINE_SIZE));
+    cache->color_count = ((bytes - (cache->objects * cache->stride)) / cache->color_unit) + 1;
+
+    bool first = false;
+
+    {
+        LockGuard guard(registry().lock);
+        registry().caches.push_back(*cache);
+
+        first                     = !registry().shrinker_added;
+        registry().shrinker_added = true;
+    }
+
+    // Outside our lock: the reclaimer calls the shrinker with its own held
+    if (first) {
+        kmem_shrinker.name  = "kmem-empty";
+        kmem_shrinker.count = shrink_count;
+        kmem_shrinker.scan  = shrink_scan;
+
+        kmem_shrinker.reenters_heap = true;
+        Reclaimer::register_shrinker(kmem_shrinker);
+    }
+
+    LOG_DEBUG("kmem: cache %s: %zu-byte objects (%zu-byte stride), %zu per %zu-page slab, "
+              "%zu color(s)",
+              name, cache->object_size, cache->stride, cache->objects, cache->slab_pages,
+              cache->color_count);
+
+    return cache;
+}
+
+void KmemCache::destroy(KmemCache* cache) {
+    if (!cache) {
+        return;
+    }
+
+    if (cache->partial || cache->full) {
+        LOG_ERROR("kmem: cache %s still has objects in use, not destroying it", cache->name);
+        return;
+    }
+
+    {
+        LockGuard guard(registry().lock);
+        registry().caches.remove(*cache);
+    }
+
+    while (Slab* s = cache->empty) {
+        slab_list_remove(cache->empty, s);
+        cache->release_slab(s);
+    }
+
+    delete cache;
+}
+
+void KmemCache::release_slab(Slab* s) {
+    SlabMap::set(s->page_addr, this->slab_pages, nullptr);
+    free_slab_pages(s->page_addr, this->slab_pages);
+    MetadataAllocator::get().free(s);
+}
+
+size_t KmemCache::shrink(size_t nr_pages) {
+    size_t freed = 0;
+
+    while (freed < nr_pages) {
+        Slab* s;
+
+        {
+            LockGuard guard(this->lock);
+            s = this->empty;
+
+            if (!s) {
+                break;
+            }
+
+            slab_list_remove(this->empty, s);
+            this->nr_empty--;
+        }
+
+        this->release_slab(s);
+        freed += this->slab_pages;
+    }
+
+    return freed;
+}
+
+size_t KmemCache::shrink_count(void*) {
+    LockGuard guard(registry().lock);
+    size_t pages = 0;
+
+    // Unlocked per cache; it only decides whether a scan is worth it.
+    for (const KmemCache& cache : registry().caches) {
+        pages += __atomic_load_n(&cache.nr_empty, __ATOMIC_RELAXED) * cache.slab_pages;
+    }
+
+    return pages;
+}
+
+size_t KmemCache::shrink_scan(void*, size_t nr_pages) {
+    LockGuard guard(registry().lock);
+    size_t freed = 0;
+
+    for (KmemCache& cache : registry().caches) {
+        if (freed >= nr_pages) {
+            break;
+        }
+
+        freed += cache.shrink(nr_pages - freed);
+    }
+
+    return freed;
+}
+
+Slab* KmemCache::grow() {
+    void* base = alloc_slab_pages(this->slab_pages);
+
+    if (!base) {
+        return nullptr;
+    }
+
+    Slab* s = MetadataAllocator::get().alloc();
+
+    if (!s) {
+        free_slab_pages(base, this->slab_pages);
+        return nullptr;
+    }
+
+    s->page_addr = base;
+    s->cache     = this;
+    s->total     = static_cast<uint16_t>(this->objects);
+    s->in_use    = 0;
+
+    // Each new slab starts its objects one color further into the slack.
+    size_t color = __atomic_fetch_add(&this->color_next, 1, __ATOMIC_RELAXED) % this->color_count;
+    char* first  = static_cast<char*>(base) + (color * this->color_unit);
+
+    for (size_t i = 0; i < this->objects; ++i) {
+        char* obj  = first + (i * this->stride);
+        char* next = ((i + 1) < this->objects) ? (obj + this->stride) : nullptr;
+
+        if (this->ctor) {
+            this->ctor(obj);
+        }
+
+        *this->link_of(obj) = next;
+    }
+
+    s->freelist = first;
+
+    // Objects may sit on any page of the slab; each one must lead back here.
+    SlabMap::set(base, this->slab_pages, s);
+
+    return s;
+}
+
+void* KmemCache::allocate() {
+    this->lock.lock();
+
+    if (!this->partial && !this->empty) {
+        // A new slab is ours alone until it's listed, so it's built unlocked:
+        // getting pages may run reclaim, and the kmem shrinker takes this lock.
+        this->lock.unlock();
+        Slab* fresh = this->grow();
+
+        if (!fresh) {
+            return nullptr;
+        }
+
+        // Someone may have refilled the cache meanwhile; it joins the others
+        this->lock.lock();
+        slab_list_add(this->empty, fresh);
+        this->nr_empty++;
+    }
+
+    Slab* s = this->partial;
+
+    if (!s) {
+        s = this->empty;
+        slab_list_remove(this->empty, s);
+        this->nr_empty--;
+
+        slab_list_add(this->partial, s);
+    }
+
+    void* obj   = s->freelist;
+    s->freelist = *this->link_of(obj);
+    s->in_use++;
+
+    if (s->in_use == s->total) {
+        slab_list_remove(this->partial, s);
+        slab_list_add(this->full, s);
+    }
+
+    this->lock.unlock();
+    return obj;
+}
+
+void KmemCache::free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    Slab* s = SlabMap::get(ptr);
+
+    if (!s || (s->cache != this)) {
+        PANIC("kmem: %p was not allocated from cache %s", ptr, this->name);
+    }
+
+    LockGuard guard(this->lock);
+
+    if (s->in_use == s->total) {
+        slab_list_remove(this->full, s);
+        slab_list_add(this->partial, s);
+    }
+
+    *this->link_of(ptr) = s->freelist;
+    s->freelist         = ptr;
+    s->in_use--;
+
+    if (s->in_use == 0) {
+        slab_list_remove(this->partial, s);
+        slab_list_add(this->empty, s);
+        this->nr_empty++;
+    }
+}
+
+KmemCache* kmem_cache_create(const char* name, size_t size, size_t align,
+                             KmemCache::Constructor ctor) {
+    return KmemCache::create(name, size, align, ctor);
+}
+
+void kmem_cache_destroy(KmemCache* cache) {
+    KmemCache::destroy(cache);
+}
+
+void* kmem_cache_alloc(KmemCache* cache) {
+    return cache->allocate();
+}
+
+void kmem_cache_free(KmemCache* cache, void* ptr) {
+    cache->free(ptr);
+}
+}  // namespace kernel::memory
\ No newline at end of file
@@ -5,40 +5,586 @@
 #include "hal/smp_manager.hpp"
 #include "libs/spinlock.hpp"
 #include "libs/math.hpp"
+#include "hal/numa.hpp"
+#include "arch.hpp"
+#include "cpu/bitscan.hpp"
+#include "memory/reclaim.hpp"
+#include "hal/timer.hpp"
 #include <stdlib.h>
 #include <string.h>
 #include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <bit>
 
 namespace kernel::memory {
+// A fixed-size stack of free pages (Bonwick's magazine). CPUs exchange whole
+// magazines with the depot, so the per-page cost never touches shared state.
+struct PhysicalManager::Magazine {
+    uint32_t next;   // Depot link: index + 1 of the next magazine, 0 ends the list
+    uint32_t count;  // Number of pages in `pages`
+    uintptr_t pages[MAGAZINE_SIZE];
+};
+
 struct alignas(CACHE_LINE_SIZE) PhysicalManager::PerCPUCache {
-    uintptr_t* stack;  // Pointer to the stack memroy for this CPU
-    size_t count;      // Number of pages in stack
-    size_t capacity;   // Max Capacity (CACHE_SIZE)
+    Magazine* loaded;    // Magazine single-page alloc/free operate on
+    Magazine* previous;  // Spare magazine, swapped in when `loaded` runs empty or full
+    uint32_t node;       // NUMA node this CPU belongs to; refills prefer it
+    bool busy;           // This core is inside a cache operation (see `CacheGuard`)
+
+    uintptr_t* zero_stack;  // Pre-zeroed pages, refilled by the idle thread
+    size_t zero_count;      // Number of pages in zero_stack
 };
 
 namespace {
-// Global PMM state (bitmap, summary bitmap, stack cache, statistics, lock).
+// Buddy free-list node. It lives in the first bytes of every free block and is
+// reached through the HHDM, so free memory tracks itself at no metadata cost.
+struct FreeBlock {
+    FreeBlock* next;
+    FreeBlock* prev;
+};
+
+// A contiguous range of page frames on one node with its own buddy free
+// lists. Blocks never straddle zone boundaries, so a merge can't leak pages
+// between zones (or nodes).
+struct Zone {
+    size_t start_pfn  = 0;      // First page owned by this zone.
+    size_t end_pfn    = 0;      // One past the last page owned by this zone.
+    size_t free_pages = 0;      // Pages currently sitting on the free lists.
+    uint32_t node     = 0;      // NUMA node owning this range.
+    bool dma32        = false;  // Range lies below 4GB.
+
+    FreeBlock* free_lists[MAX_ORDER + 1] = {};
+    size_t free_count[MAX_ORDER + 1]     = {};
+};
+
+// Every node gets at most a DMA32 and a Normal zone per SRAT range.
+constexpr size_t MAX_ZONES = 2 * hal::MAX_NUMA_RANGES + 2;
+
+// The min watermark is 1/512 of managed memory (8MB per 4GB) within these
+// bounds; low and high sit 25% and 50% above it.
+constexpr size_t WATERMARK_MIN_FLOOR = 64;     // 256KB
+constexpr size_t WATERMARK_MIN_CEIL  = 16384;  // 64MB
+
+// `init` sets up the first 4GB on the BSP. Memory above that waits for SMP
+// and comes up in slices of one max-order block, so a free block never spans
+// two slices and each can go onto the buddy lists on its own.
+constexpr size_t BOOT_INIT_PAGES      = (PAGE_SIZE_1G * 4) / PAGE_SIZE_4K;
+constexpr size_t DEFERRED_SLICE_PAGES = 1ul << MAX_ORDER;
+
+enum SliceState : uint8_t {
+    SlicePending,  // Still all used in the bitmap, frames not initialized
+    SliceBusy,     // A core is setting it up
+    SliceReady,    // Frames valid; free pages on (or about to be on) the buddy lists
+};
+
+// Bitmap words covering one 2MB block.
+constexpr size_t HUGE_2M_WORDS = (1ul << HUGE_2M_ORDER) / 64;
+
+// Huge-frame reserve, one pool per size: [0] = 2MB, [1] = 1GB.
+constexpr size_t HUGE_POOLS                      = 2;
+constexpr size_t huge_pool_order[HUGE_POOLS]     = {HUGE_2M_ORDER, HUGE_1G_ORDER};
+constexpr size_t huge_pool_target[HUGE_POOLS]    = {HUGE_POOL_2M, HUGE_POOL_1G};
+constexpr const char* huge_pool_name[HUGE_POOLS] = {"2MB", "1GB"};
+
+// Lock-free LIFO of magazines. `head` packs a generation tag above the index
+// (+1) of the top magazine, so a pop that races with a pop+push of the same
+// magazine (ABA) fails its CAS instead of corrupting the list.
+struct MagazineDepot {
+    uint64_t head = 0;
+    size_t pages  = 0;  // Pages held by the magazines in this depot.
+};
+
+// Global PMM state (bitmap, summary bitmap, buddy lists, stack cache, statistics, lock).
 struct {
     uint_least64_t* bitmap         = nullptr;  // Allocation bitmap (1 bit per page).
     uint_least64_t* summary_bitmap = nullptr;  // Summary bitmap (1 bit per 64 pages).
+    uint8_t* block_order           = nullptr;  // Order of the free block headed by a page.
+    uint_least64_t* clean_bitmap   = nullptr;  // 1 bit per page, set while known to be zero.
+    PageFrame* frames              = nullptr;  // Frame database (one entry per page).
 
     size_t total_pages           = 0;  // Total number of managed pages.
     size_t summary_entries       = 0;  // Number of 64-bit entries in the summary bitmap.
     size_t bitmap_entries        = 0;  // Number of 64-bit entries in the bitmap.
     size_t used_pages            = 0;  // Number of currently used pages.
+    size_t free_pages            = 0;  // Pages on the buddy lists of all zones.
     size_t low_mem_threshold_idx = 0;  // page at which phys_addr >= 4GB
-    size_t free_idx_hint         = 0;  // Hint for next free-page search (small allocations)
-    size_t aligned_index_hint    = 0;  // Hint for next free-page search (huge allocations)
+
+    Zone zones[MAX_ZONES] = {};
+    size_t zone_count     = 0;
+
+    size_t watermarks[3] = {};  // In pages, indexed by `Watermark`.
+
+    // Deferred init (see `init_deferred`): pages from `boot_pages` on belong
+    // to slices, each with a `SliceState` byte in `slices`.
+    size_t boot_pages  = 0;
+    uint8_t* slices    = nullptr;
+    size_t slice_count = 0;
+    size_t slices_left = 0;  // Slices whose pages are not on the buddy lists yet.
+
+    size_t meta_start = 0;  // PMM metadata pages; usable RAM never handed out.
+    size_t meta_end   = 0;
+
+    // Boot timings. `init` runs before any time source is up, so its phases
+    // are kept in cycles: frame database, bitmap, free lists.
+    size_t boot_cycles[3]   = {};
+    size_t deferred_start   = 0;  // Cycle count when the first core started on a slice.
+    size_t deferred_pages   = 0;  // Usable pages brought in by the slices.
+    uint32_t deferred_cores = 0;  // Cores that set up at least one slice.
 
     PhysicalManager::PerCPUCache* cpus = nullptr;
     size_t num_cpus                    = 1;
 
-    IrqLock lock;  // Protects PMM state.
-    InterruptLock interrupt_lock;
+    PhysicalManager::Magazine* magazines = nullptr;  // MAGAZINES_PER_CPU per CPU.
+    MagazineDepot full_magazines[hal::MAX_NUMA_NODES];
+    MagazineDepot empty_magazines;
+
+    // Reserved huge frames, linked through their first bytes like buddy
+    // blocks. They stay marked used, so the buddy lists never see them.
+    FreeBlock* huge_pool[HUGE_POOLS]   = {};
+    size_t huge_pool_count[HUGE_POOLS] = {};
+
+    // Compaction: the 2MB block currently isolated (0 if none), which of its
+    // pages were free at isolation, and where the next candidate search starts.
+    uintptr_t isolated_base                = 0;
+    uint_least64_t isolated[HUGE_2M_WORDS] = {};
+    size_t compact_cursor                  = 0;
+
+    IrqLock lock;  // Protects the bitmaps, buddy lists and zones.
 } pmm_state;
 
 // Number of bits in one bitmap entry.
 constexpr uint8_t bit_count = sizeof(uint_least64_t) * 8;
+
+// `block_order` value for pages that don't head a free block.
+constexpr uint8_t no_order = 0xFF;
+
+// Returned by `buddy_alloc` when a zone has no block large enough.
+constexpr size_t no_page = static_cast<size_t>(-1);
+
+// Index of the executing core, or 0 before the BSP has loaded GS_BASE.
+size_t current_core() {
+    return cpu::percpu_available ? cpu::current_core_idx() : 0;
+}
+
+uint32_t local_node() {
+    size_t core_id = current_core();
+
+    if ((pmm_state.cpus == nullptr) || (core_id >= pmm_state.num_cpus)) {
+        return 0;
+    }
+
+    return pmm_state.cpus[core_id].node;
+}
+
+// Claims the executing core's cache for the guard's lifetime. Preemption is
+// held off with the per-CPU counter rather than by masking interrupts; an
+// interrupt handler that lands mid-operation finds `busy` set, gets no cache
+// and falls back to the locked global path.
+class CacheGuard {
+   public:
+    CacheGuard() {
+        if (pmm_state.cpus == nullptr) {
+            return;
+        }
+
+        // Before GS is loaded only the BSP runs and there is no scheduler.
+        if (cpu::percpu_available) {
+            cpu::preempt_disable();
+            this->preempted = true;
+        }
+
+        size_t core_id = current_core();
+
+        if ((core_id >= pmm_state.num_cpus) || pmm_state.cpus[core_id].busy) {
+            return;
+        }
+
+        this->cache       = &pmm_state.cpus[core_id];
+        this->cache->busy = true;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+
+    ~CacheGuard() {
+        if (this->cache) {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            this->cache->busy = false;
+        }
+
+        if (this->preempted) {
+            cpu::preempt_enable();
+        }
+    }
+
+    CacheGuard(const CacheGuard&)            = delete;
+    CacheGuard& operator=(const CacheGuard&) = delete;
+
+    PhysicalManager::PerCPUCache* get() const {
+        return this->cache;
+    }
+
+   private:
+    PhysicalManager::PerCPUCache* cache = nullptr;
+    bool preempted                      = false;
+};
+
+void depot_push(MagazineDepot& depot, PhysicalManager::Magazine* mag) {
+    uint64_t idx  = static_cast<uint64_t>(mag - pmm_state.magazines) + 1;
+    uint64_t head = __atomic_load_n(&depot.head, __ATOMIC_RELAXED);
+    uint64_t next = 0;
+
+    // Account first so concurrent readers never see the counter underflow.
+    __atomic_fetch_add(&depot.pages, mag->count, __ATOMIC_RELAXED);
+
+    do {
+        __atomic_store_n(&mag->next, static_cast<uint32_t>(head), __ATOMIC_RELAXED);
+        next = (((head >> 32) + 1) << 32) | idx;
+    } while (!__atomic_compare_exchange_n(&depot.head, &head, next, true, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
+
+PhysicalManager::Magazine* depot_pop(MagazineDepot& depot) {
+    uint64_t head                  = __atomic_load_n(&depot.head, __ATOMIC_ACQUIRE);
+    uint64_t next                  = 0;
+    PhysicalManager::Magazine* mag = nullptr;
+
+    do {
+        uint32_t idx = static_cast<uint32_t>(head);
+
+        if (idx == 0) {
+            return nullptr;
+        }
+
+        // Magazines live in PMM metadata and are never freed, so reading a
+        // stale `next` is harmless: the tag makes the CAS fail in that case.
+        mag  = &pmm_state.magazines[idx - 1];
+        next = (((head >> 32) + 1) << 32) | __atomic_load_n(&mag->next, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&depot.head, &head, next, true, __ATOMIC_ACQUIRE,
+                                          __ATOMIC_ACQUIRE));
+
+    __atomic_fetch_sub(&depot.pages, mag->count, __ATOMIC_RELAXED);
+    return mag;
+}
+
+// The clean bitmap is touched from the lockless cache paths, so every update
+// is an atomic RMW on the containing word.
+inline void mark_clean(size_t idx) {
+    __atomic_fetch_or(&pmm_state.clean_bitmap[idx / bit_count], 1ull << (idx % bit_count),
+                      __ATOMIC_RELAXED);
+}
+
+inline void clear_clean(size_t idx) {
+    __atomic_fetch_and(&pmm_state.clean_bitmap[idx / bit_count], ~(1ull << (idx % bit_count)),
+                       __ATOMIC_RELAXED);
+}
+
+inline bool test_clean(size_t idx) {
+    return __atomic_load_n(&pmm_state.clean_bitmap[idx / bit_count], __ATOMIC_RELAXED) &
+           (1ull << (idx % bit_count));
+}
+
+void clear_clean_range(size_t idx, size_t count) {
+    size_t end = idx + count;
+
+    while (idx < end) {
+        size_t bit = idx % bit_count;
+        size_t n   = std::min<size_t>(bit_count - bit, end - idx);
+
+        uint_least64_t mask = (n == bit_count) ? ~0ull : (((1ull << n) - 1) << bit);
+        __atomic_fetch_and(&pmm_state.clean_bitmap[idx / bit_count], ~mask, __ATOMIC_RELAXED);
+
+        idx += n;
+    }
+}
+
+inline FreeBlock* block_at(size_t page_idx) {
+    return reinterpret_cast<FreeBlock*>(to_higher_half(page_idx * PAGE_SIZE_4K));
+}
+
+inline size_t block_index(FreeBlock* block) {
+    return from_higher_half(reinterpret_cast<uintptr_t>(block)) / PAGE_SIZE_4K;
+}
+
+// Smallest order whose block holds `count` pages.
+inline size_t order_for(size_t count) {
+    return (count <= 1) ? 0 : static_cast<size_t>(std::bit_width(count - 1));
+}
+
+inline size_t huge_pool_of(PageSize size) {
+    return (size == PageSize::Size1G) ? 1 : 0;
+}
+
+// Reset the frame of a page being handed out; the caller holds the only reference.
+inline void claim_frame(size_t page_idx, uint16_t flags = 0, uint8_t order = 0) {
+    PageFrame& frame = pmm_state.frames[page_idx];
+
+    frame.refcount.store(1, std::memory_order_relaxed);
+    frame.mapcount.store(0, std::memory_order_relaxed);
+    frame.slab  = nullptr;
+    frame.flags = flags;
+    frame.order = order;
+}
+
+inline void release_frame(size_t page_idx) {
+    if (page_idx < pmm_state.total_pages) {
+        pmm_state.frames[page_idx].refcount.store(0, std::memory_order_relaxed);
+    }
+}
+
+inline size_t slice_start(size_t slice) {
+    return pmm_state.boot_pages + (slice * DEFERRED_SLICE_PAGES);
+}
+
+// Call `fn(run_start, run_len)` for every run of usable pages in
+// [start_pfn, end_pfn), lowest first. Page 0 and the PMM metadata are left out.
+template <typename Fn>
+void for_each_usable(size_t start_pfn, size_t end_pfn, Fn fn) {
+    limine_memmap_entry** memmaps = memmap_request.response->entries;
+    size_t memmap_count           = memmap_request.response->entry_count;
+
+    for (size_t i = 0; i < memmap_count; ++i) {
+        limine_memmap_entry* entry = memmaps[i];
+
+        if (entry->type != LIMINE_MEMMAP_USABLE) {
+            continue;
+        }
+
+        size_t first = std::max({entry->base / PAGE_SIZE_4K, start_pfn, size_t{1}});
+        size_t last  = std::min((entry->base + entry->length) / PAGE_SIZE_4K, end_pfn);
+
+        if (first >= last) {
+            continue;
+        }
+
+        // The metadata was carved out of a usable entry; skip over it.
+        size_t hole_start = std::clamp(pmm_state.meta_start, first, last);
+        size_t hole_end   = std::clamp(pmm_state.meta_end, hole_start, last);
+
+        if (hole_start > first) {
+            fn(first, hole_start - first);
+        }
+
+        if (last > hole_end) {
+            fn(hole_end, last - hole_end);
+        }
+    }
+}
+
+// Reset the frames of [start_pfn, end_pfn). Pages outside the usable runs
+// were never ours to hand out and stay reserved for good.
+void init_frames(size_t start_pfn, size_t end_pfn) {
+    memset(&pmm_state.frames[start_pfn], 0, (end_pfn - start_pfn) * sizeof(PageFrame));
+
+    auto reserve = [](size_t from, size_t to) {
+        for (size_t pfn = from; pfn < to; ++pfn) {
+            pmm_state.frames[pfn].refcount.store(1, std::memory_order_relaxed);
+            pmm_state.frames[pfn].flags = FrameReserved;
+        }
+    };
+
+    size_t curr = start_pfn;
+
+    for_each_usable(start_pfn, end_pfn, [&](size_t run_start, size_t run_len) {
+        reserve(curr, run_start);
+        curr = run_start + run_len;
+    });
+
+    reserve(curr, end_pfn);
+}
+
+// Zones are sorted and contiguous, so a binary search finds the owner.
+Zone* zone_of(size_t page_idx) {
+    size_t lo = 0;
+    size_t hi = pmm_state.zone_count;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        Zone& zone = pmm_state.zones[mid];
+
+        if (page_idx < zone.start_pfn) {
+            hi = mid;
+        } else if (page_idx >= zone.end_pfn) {
+            lo = mid + 1;
+        } else {
+            return &zone;
+        }
+    }
+
+    return nullptr;
+}
+
+void add_zone(size_t start_pfn, size_t end_pfn, uint32_t node) {
+    // Split at 4GB so DMA32 callers have zones of their own.
+    size_t split = pmm_state.low_mem_threshold_idx;
+
+    if ((start_pfn < split) && (end_pfn > split)) {
+        add_zone(start_pfn, split, node);
+        add_zone(split, end_pfn, node);
+        return;
+    }
+
+    if (start_pfn >= end_pfn) {
+        return;
+    }
+
+    bool dma32 = start_pfn < split;
+
+    // Extend the previous zone instead of fragmenting the search space.
+    if (pmm_state.zone_count > 0) {
+        Zone& prev = pmm_state.zones[pmm_state.zone_count - 1];
+
+        if ((prev.end_pfn == start_pfn) && (prev.node == node) && (prev.dma32 == dma32)) {
+            prev.end_pfn = end_pfn;
+            return;
+        }
+    }
+
+    if (pmm_state.zone_count >= MAX_ZONES) {
+        // Out of slots: fold the range into the previous zone. Only locality
+        // is lost, allocation correctness doesn't depend on it.
+        pmm_state.zones[pmm_state.zone_count - 1].end_pfn = end_pfn;
+        return;
+    }
+
+    Zone& zone     = pmm_state.zones[pmm_state.zone_count++];
+    zone           = {};
+    zone.start_pfn = start_pfn;
+    zone.end_pfn   = end_pfn;
+    zone.node      = node;
+    zone.dma32     = dma32;
+}
+
+// Record the owner of every page in [start_pfn, end_pfn) in the frame database.
+void assign_zones(size_t start_pfn, size_t end_pfn) {
+    for (size_t z = 0; z < pmm_state.zone_count; ++z) {
+        const Zone& zone = pmm_state.zones[z];
+
+        size_t first = std::max(zone.start_pfn, start_pfn);
+        size_t last  = std::min(zone.end_pfn, end_pfn);
+
+        for (size_t pfn = first; pfn < last; ++pfn) {
+            pmm_state.frames[pfn].zone = static_cast<uint8_t>(z);
+            pmm_state.frames[pfn].node = static_cast<uint16_t>(zone.node);
+        }
+    }
+}
+
+// Cover [0, total_pages) with zones following the NUMA memory ranges. Holes
+// between SRAT ranges belong to the node of the range before them.
+void setup_zones() {
+    pmm_state.zone_count = 0;
+    pmm_state.free_pages = 0;
+
+    size_t curr        = 0;
+    uint32_t last_node = 0;
+
+    for (size_t i = 0; i < hal::Numa::memory_range_count(); ++i) {
+        const hal::NumaMemoryRange& range = hal::Numa::memory_range(i);
+
+        size_t start = std::min(range.base / PAGE_SIZE_4K, pmm_state.total_pages);
+        size_t end   = std::min(div_roundup(range.base + range.length, PAGE_SIZE_4K),
+                                pmm_state.total_pages);
+
+        if (end <= curr) {
+            continue;
+        }
+
+        start = std::max(start, curr);
+
+        add_zone(curr, start, last_node);
+        add_zone(start, end, range.node);
+
+        curr      = end;
+        last_node = range.node;
+    }
+
+    add_zone(curr, pmm_state.total_pages, last_node);
+
+    // Deferred slices only come up after the last re-zone and record their
+    // owners themselves.
+    assign_zones(0, pmm_state.boot_pages);
+}
+
+// Take a pending slice, preferring one on `node`. Returns `no_page` once
+// every slice is taken.
+size_t claim_slice(uint32_t node) {
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t i = 0; i < pmm_state.slice_count; ++i) {
+            uint8_t expected = SlicePending;
+
+            if (__atomic_load_n(&pmm_state.slices[i], __ATOMIC_RELAXED) != SlicePending) {
+                continue;
+            }
+
+            if ((pass == 0) && (zone_of(slice_start(i))->node != node)) {
+                continue;
+            }
+
+            if (__atomic_compare_exchange_n(&pmm_state.slices[i], &expected, SliceBusy, false,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                return i;
+            }
+        }
+    }
+
+    return no_page;
+}
+
+void push_block(Zone& zone, size_t page_idx, size_t order) {
+    FreeBlock* block = block_at(page_idx);
+
+    block->prev = nullptr;
+    block->next = zone.free_lists[order];
+
+    if (block->next) {
+        block->next->prev = block;
+    }
+
+    zone.free_lists[order] = block;
+    zone.free_count[order]++;
+    zone.free_pages += (1ul << order);
+    pmm_state.free_pages += (1ul << order);
+
+    pmm_state.block_order[page_idx] = static_cast<uint8_t>(order);
+}
+
+void remove_block(Zone& zone, size_t page_idx, size_t order) {
+    FreeBlock* block = block_at(page_idx);
+
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        zone.free_lists[order] = block->next;
+    }
+
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+
+    zone.free_count[order]--;
+    zone.free_pages -= (1ul << order);
+    pmm_state.free_pages -= (1ul << order);
+
+    pmm_state.block_order[page_idx] = no_order;
+}
+// Called under the lock after taking pages off the buddy lists.
+inline void check_low_watermark() {
+    if (pmm_state.free_pages < pmm_state.watermarks[static_cast<size_t>(Watermark::Low)]) {
+        Reclaimer::wake();
+    }
+}
+
+// Derive the watermarks from the pages on the buddy lists.
+void set_watermarks() {
+    size_t min_pages = std::clamp(pmm_state.free_pages / 512, WATERMARK_MIN_FLOOR,
+                                  WATERMARK_MIN_CEIL);
+
+    pmm_state.watermarks[static_cast<size_t>(Watermark::Min)]  = min_pages;
+    pmm_state.watermarks[static_cast<size_t>(Watermark::Low)]  = min_pages + (min_pages / 4);
+    pmm_state.watermarks[static_cast<size_t>(Watermark::High)] = min_pages + (min_pages / 2);
+}
+
+Shrinker cache_shrinker;
 }  // namespace
 
 void PhysicalManager::set_bit(size_t idx) {
@@ -77,143 +623,292 @@ bool PhysicalManager::test_bit(size_t idx) {
     return pmm_state.bitmap[byte] & (1ULL << bit);
 }
 
-void PhysicalManager::cache_refill(PerCPUCache& cache) {
-    // Calculate number of page to transfer
-    size_t need = BATCH_SIZE;
+void PhysicalManager::set_range(size_t idx, size_t count) {
+    size_t end = idx + count;
+
+    while (idx < end) {
+        size_t word = idx / bit_count;
+        size_t bit  = idx % bit_count;
+        size_t n    = std::min<size_t>(bit_count - bit, end - idx);
 
-    if (cache.count + need > cache.capacity) {
-        need = cache.capacity - cache.capacity;
+        uint_least64_t mask = (n == bit_count) ? ~0ull : (((1ull << n) - 1) << bit);
+        pmm_state.bitmap[word] |= mask;
+
+        if (pmm_state.bitmap[word] == ~0ull) {
+            pmm_state.summary_bitmap[word / bit_count] |= (1ull << (word % bit_count));
+        }
+
+        idx += n;
     }
+}
 
-    if (need == 0) {
-        return;
+void PhysicalManager::clear_range(size_t idx, size_t count) {
+    size_t end = idx + count;
+
+    while (idx < end) {
+        size_t word = idx / bit_count;
+        size_t bit  = idx % bit_count;
+        size_t n    = std::min<size_t>(bit_count - bit, end - idx);
+
+        uint_least64_t mask = (n == bit_count) ? ~0ull : (((1ull << n) - 1) << bit);
+        pmm_state.bitmap[word] &= ~mask;
+        pmm_state.summary_bitmap[word / bit_count] &= ~(1ull << (word % bit_count));
+
+        idx += n;
     }
+}
 
-    size_t collected = 0;
+size_t PhysicalManager::buddy_alloc(size_t zone_idx, size_t order, size_t max_order) {
+    Zone& zone = pmm_state.zones[zone_idx];
 
-    auto scan_bitmap_range = [&](size_t start_idx, size_t end_idx) -> bool {
-        size_t start = start_idx / bit_count;
-        size_t end   = div_roundup(end_idx, bit_count);
+    // First-fit over the orders: the smallest non-empty list at or above
+    // `order` gives the block that fragments the zone the least.
+    size_t curr = order;
+    while ((curr <= max_order) && (zone.free_lists[curr] == nullptr)) {
+        curr++;
+    }
 
-        for (size_t s = start; s < end; ++s) {
-            // Prefech the summary bitmap (~2 cache lines)
-            __builtin_prefetch(&pmm_state.summary_bitmap[s + 2], 0, 1);
+    if (curr > max_order) {
+        return no_page;
+    }
 
-            if (pmm_state.summary_bitmap[s] == ~0ull) {
-                continue;
-            }
+    size_t page_idx = block_index(zone.free_lists[curr]);
+    remove_block(zone, page_idx, curr);
 
-            uint_least64_t summary_val = pmm_state.summary_bitmap[s];
-            uint_least64_t inv_summary = ~summary_val;
+    // Split down to the requested order, returning the upper halves.
+    while (curr > order) {
+        curr--;
+        push_block(zone, page_idx + (1ul << curr), curr);
+    }
 
-            while (inv_summary) {
-                int block_bit   = __builtin_ctzll(inv_summary);
-                size_t word_idx = (s * bit_count) + static_cast<size_t>(block_bit);
+    return page_idx;
+}
 
-                if (word_idx >= end_idx) {
-                    return false;
-                }
+void PhysicalManager::buddy_free(size_t page_idx, size_t order) {
+    Zone* zone = zone_of(page_idx);
 
-                // Prefetch the main bitmap (~4 cache lines)
-                __builtin_prefetch(&pmm_state.bitmap[word_idx + 4], 1, 1);
+    if (zone == nullptr) {
+        return;
+    }
 
-                uint_least64_t word_val = pmm_state.bitmap[word_idx];
+    // Coalesce upwards while the buddy is a free block of the same order.
+    // Interior pages of a free block and allocated pages both read as
+    // `no_order`, so a single byte compare is enough to decide.
+    while (order < MAX_ORDER) {
+        size_t buddy = page_idx ^ (1ul << order);
 
-                // If word is not full, extract pages
-                if (word_val != ~0ull) {
-                    if (word_val == 0 && (need - collected) >= 64) {
-                        pmm_state.bitmap[word_idx] = ~0ull;  // Mark full
-                        pmm_state.summary_bitmap[s] |= (1ul << block_bit);
+        if ((buddy < zone->start_pfn) || ((buddy + (1ul << order)) > zone->end_pfn) ||
+            (pmm_state.block_order[buddy] != order)) {
+            break;
+        }
 
-                        uint_least64_t base_page = word_idx * bit_count;
+        remove_block(*zone, buddy, order);
+        page_idx &= ~(1ul << order);
+        order++;
+    }
+
+    push_block(*zone, page_idx, order);
+}
 
-                        for (size_t k = 0; k < bit_count; ++k) {
-                            cache.stack[cache.count++] = (base_page + k) * PAGE_SIZE_4K;
-                        }
+void PhysicalManager::buddy_free_range(size_t page_idx, size_t count) {
+    while (count > 0) {
+        Zone* zone = zone_of(page_idx);
 
-                        collected += bit_count;
-                    } else {
-                        uint_least64_t inv_word = ~word_val;
-                        bool word_modified      = false;
+        if (zone == nullptr) {
+            return;
+        }
 
-                        while (inv_word && (collected < need)) {
-                            int page_bit = __builtin_ctzll(inv_word);
-                            size_t page_idx =
-                                (word_idx * bit_count) + static_cast<size_t>(page_bit);
+        size_t chunk = std::min(count, zone->end_pfn - page_idx);
+        count -= chunk;
 
-                            if (page_idx >= pmm_state.total_pages) {
-                                return true;
-                            }
+        // Break the run into the largest naturally aligned blocks it holds.
+        while (chunk > 0) {
+            size_t align_order = (page_idx == 0) ? MAX_ORDER : std::countr_zero(page_idx);
+            size_t size_order  = static_cast<size_t>(std::bit_width(chunk)) - 1;
+            size_t order       = std::min({align_order, size_order, MAX_ORDER});
 
-                            // Add to CPU cache
-                            cache.stack[cache.count++] = page_idx * PAGE_SIZE_4K;
-                            collected++;
+            buddy_free(page_idx, order);
 
-                            // Mark as used
-                            word_val |= (1ul << page_bit);
-                            inv_word &= ~(1ul << page_bit);
+            page_idx += (1ul << order);
+            chunk -= (1ul << order);
+        }
+    }
+}
 
-                            word_modified = true;
-                        }
+size_t PhysicalManager::alloc_from_node(uint32_t node, size_t order, bool dma,
+                                        size_t max_order) {
+    // Normal zones first so DMA32 stays available for the devices that need it.
+    for (int pass = dma ? 1 : 0; pass < 2; ++pass) {
+        bool want_dma32 = (pass == 1);
 
-                        if (word_modified) {
-                            // Write back to global bitmap
-                            pmm_state.bitmap[word_idx] = word_val;
+        for (size_t zone_idx = 0; zone_idx < pmm_state.zone_count; ++zone_idx) {
+            const Zone& zone = pmm_state.zones[zone_idx];
 
-                            // Update summary bitmap
-                            if (word_val == ~0ull) {
-                                pmm_state.summary_bitmap[s] |= (1ul << block_bit);
-                            }
-                        }
-                    }
+            if ((zone.node != node) || (zone.dma32 != want_dma32) ||
+                (zone.free_pages < (1ul << order))) {
+                continue;
+            }
 
-                    if (collected >= need) {
-                        // Update hint for next allocation
-                        pmm_state.free_idx_hint = word_idx * bit_count;
-                        return true;
-                    }
-                }
+            size_t page_idx = buddy_alloc(zone_idx, order, max_order);
 
-                // Clear bit to move to next free word in this summary block
-                inv_summary &= ~(1ul << block_bit);
+            if (page_idx != no_page) {
+                return page_idx;
             }
         }
+    }
 
-        // Continue to next range
-        return false;
-    };
+    return no_page;
+}
+
+void* PhysicalManager::alloc_block(size_t count, size_t alignment, uint32_t node, bool dma,
+                                   bool keep_clean) {
+    size_t align_pages = alignment / PAGE_SIZE_4K;
+    size_t order = std::max(order_for(count), static_cast<size_t>(std::countr_zero(align_pages)));
 
-    size_t start_idx = pmm_state.free_idx_hint / bit_count;
+    if (order > MAX_ORDER) {
+        LOG_WARN("PMM request exceeds max block order count=%zu align=0x%zx", count, alignment);
+        return nullptr;
+    }
+
+    // Walk the nodes nearest-first; a remote page beats no page at all.
+    // Requests below 2MB use up a node's fragments before they may split one
+    // of its free 2MB-or-larger blocks.
+    const uint32_t* fallback = hal::Numa::fallback_order(node);
+    size_t page_idx          = no_page;
+
+    for (size_t i = 0; (i < hal::Numa::node_count()) && (page_idx == no_page); ++i) {
+        if (order < HUGE_2M_ORDER) {
+            page_idx = alloc_from_node(fallback[i], order, dma, HUGE_2M_ORDER - 1);
+        }
 
-    // Prioritize High mem (>4GB) if we actually have High mem (threshold < total)
-    // and we are currently looking at low mem.
-    if ((pmm_state.low_mem_threshold_idx < pmm_state.total_pages) &&
-        (pmm_state.free_idx_hint < pmm_state.low_mem_threshold_idx)) {
-        start_idx = pmm_state.low_mem_threshold_idx / bit_count;
+        if (page_idx == no_page) {
+            page_idx = alloc_from_node(fallback[i], order, dma);
+        }
     }
 
-    // Scan from Hint -> End of Memory
-    if (!scan_bitmap_range(start_idx, pmm_state.bitmap_entries) && (start_idx > 0)) {
-        // Wrap around (Scan from 0 -> Hint)
-        scan_bitmap_range(0, start_idx);
+    if (page_idx == no_page) {
+        return nullptr;
     }
 
-    pmm_state.used_pages += collected;
+    // Give the unused tail of a rounded-up block straight back.
+    size_t block_pages = 1ul << order;
+    if (block_pages > count) {
+        buddy_free_range(page_idx + count, block_pages - count);
+    }
+
+    set_range(page_idx, count);
+    claim_frame(page_idx);
+
+    if (!keep_clean) {
+        clear_clean_range(page_idx, count);
+    }
+
+    pmm_state.used_pages += count;
+    check_low_watermark();
+
+    return reinterpret_cast<void*>(page_idx * PAGE_SIZE_4K);
+}
+
+void* PhysicalManager::alloc_slow(size_t count, size_t alignment, uint32_t node, bool dma,
+                                  bool keep_clean) {
+    void* addr = nullptr;
+
+    {
+        LockGuard guard(pmm_state.lock);
+        addr = alloc_block(count, alignment, node, dma, keep_clean);
+    }
+
+    // Memory that hasn't come up yet beats reclaiming the caches.
+    while ((addr == nullptr) && grow_deferred(node)) {
+        LockGuard guard(pmm_state.lock);
+        addr = alloc_block(count, alignment, node, dma, keep_clean);
+    }
+
+    // Out of memory: the caller can't wait for the reclaim thread and pulls
+    // pages back from the caches itself. An allocation that was served only
+    // leaves it to the thread; draining every CPU's cache on each one under
+    // steady pressure would throw away the magazines just refilled.
+    if (addr == nullptr) {
+        size_t target = std::max(watermark_deficit(Watermark::Low), count);
+
+        if (Reclaimer::direct_reclaim(target) > 0) {
+            LockGuard guard(pmm_state.lock);
+            addr = alloc_block(count, alignment, node, dma, keep_clean);
+        }
+    } else if (watermark_deficit(Watermark::Min) > 0) {
+        Reclaimer::wake();
+    }
+
+    return addr;
 }
 
-void PhysicalManager::cache_flush(PerCPUCache& cache) {
-    size_t target_count = cache.capacity / 2;
+void PhysicalManager::magazine_fill(Magazine& mag, uint32_t node) {
+    size_t need = MAGAZINE_SIZE - mag.count;
 
-    if (cache.capacity <= target_count) {
+    if (need == 0) {
         return;
     }
 
-    size_t flush_count     = cache.capacity - target_count;
-    uintptr_t* flush_start = &cache.stack[target_count];
+    size_t collected = 0;
+
+    // Pull whole blocks, largest first, so one refill costs a handful of list
+    // operations rather than a bit scan per page. The local node is drained
+    // down to single pages before any remote node is touched.
+    //
+    // Each node is visited twice: first only blocks below 2MB may be taken,
+    // so refills soak up existing fragments and leave fully free 2MB blocks
+    // intact for huge mappings. Only the second pass splits those.
+    const uint32_t* fallback = hal::Numa::fallback_order(node);
+
+    for (size_t i = 0; (i < hal::Numa::node_count()) && (collected < need); ++i) {
+        for (size_t max_order : {HUGE_2M_ORDER - 1, MAX_ORDER}) {
+            size_t order = static_cast<size_t>(std::bit_width(need - collected)) - 1;
+
+            while (collected < need) {
+                size_t page_idx = alloc_from_node(fallback[i], order, false, max_order);
+
+                if (page_idx == no_page) {
+                    if (order == 0) {
+                        break;
+                    }
+
+                    order--;
+                    continue;
+                }
+
+                size_t pages = 1ul << order;
+                set_range(page_idx, pages);
+
+                for (size_t k = 0; k < pages; ++k) {
+                    mag.pages[mag.count++] = (page_idx + k) * PAGE_SIZE_4K;
+                }
+
+                collected += pages;
+
+                if (collected < need) {
+                    order =
+                        std::min(order, static_cast<size_t>(std::bit_width(need - collected)) - 1);
+                }
+            }
+
+            if (collected == need) {
+                break;
+            }
+        }
+    }
+
+    pmm_state.used_pages += collected;
+    check_low_watermark();
+}
+
+void PhysicalManager::magazine_drain(Magazine& mag) {
+    uintptr_t* pages = mag.pages;
+    size_t count     = mag.count;
 
-    // Sort the addresses in order, so they hit consecutive bitmap words.
-    if (flush_count > 1) {
-        qsort(flush_start, flush_count, sizeof(uintptr_t), [](const void* a, const void* b) -> int {
+    // Sort the addresses in order, so neighbouring pages form runs that
+    // coalesce back into large buddy blocks.
+    if (count > 1) {
+        qsort(pages, count, sizeof(uintptr_t), [](const void* a, const void* b) -> int {
             uintptr_t arg1 = *static_cast<const uintptr_t*>(a);
             uintptr_t arg2 = *static_cast<const uintptr_t*>(b);
 
@@ -229,484 +924,838 @@ void PhysicalManager::cache_flush(PerCPUCache& cache) {
         });
     }
 
-    size_t last_word_idx         = ~0ull;
-    uint_least64_t curr_word_val = 0;
-    bool dirty                   = false;
+    size_t i = 0;
+    while (i < count) {
+        size_t run_start = pages[i] / PAGE_SIZE_4K;
+        size_t run_len   = 1;
 
-    for (size_t i = 0; i < flush_count; ++i) {
-        uintptr_t phys_addr = flush_start[i];
-        size_t page_idx     = phys_addr / PAGE_SIZE_4K;
+        while (((i + run_len) < count) &&
+               ((pages[i + run_len] / PAGE_SIZE_4K) == (run_start + run_len))) {
+            run_len++;
+        }
+
+        i += run_len;
 
-        if (page_idx >= pmm_state.total_pages) {
+        if ((run_start + run_len) > pmm_state.total_pages) {
             continue;
         }
 
-        size_t word_idx = page_idx / bit_count;
-        size_t bit_idx  = page_idx % bit_count;
+        clear_range(run_start, run_len);
+        pmm_state.used_pages -= run_len;
+        buddy_free_range(run_start, run_len);
+    }
 
-        uint_least64_t mask = (1ul << bit_idx);
+    mag.count = 0;
+}
 
-        // If we moved to a new word, commit the previous one to the global state
-        if (word_idx != last_word_idx) {
-            if (dirty && (last_word_idx < pmm_state.bitmap_entries)) {
-                const size_t last_word_byte = last_word_idx / bit_count;
-                const size_t last_word_bit  = last_word_idx % bit_count;
+void PhysicalManager::depot_drain() {
+    for (MagazineDepot& depot : pmm_state.full_magazines) {
+        while (Magazine* mag = depot_pop(depot)) {
+            magazine_drain(*mag);
+            depot_push(pmm_state.empty_magazines, mag);
+        }
+    }
+}
 
-                pmm_state.bitmap[last_word_idx] = curr_word_val;
-                pmm_state.summary_bitmap[last_word_byte] &= ~(1ul << last_word_bit);
-            }
+uintptr_t PhysicalManager::cache_pop(PerCPUCache& cache) {
+    if (cache.loaded->count == 0) {
+        if (cache.previous->count > 0) {
+            std::swap(cache.loaded, cache.previous);
+        } else if (Magazine* full = depot_pop(pmm_state.full_magazines[cache.node])) {
+            // Both magazines are empty: trade one for a full one.
+            depot_push(pmm_state.empty_magazines, cache.previous);
+            cache.previous = cache.loaded;
+            cache.loaded   = full;
+        } else {
+            LockGuard guard(pmm_state.lock);
+            magazine_fill(*cache.loaded, cache.node);
+        }
 
-            // Load new word
-            last_word_idx = word_idx;
-            curr_word_val = pmm_state.bitmap[word_idx];
-            dirty         = true;
+        if (cache.loaded->count == 0) {
+            return 0;
         }
+    }
 
-        // Clear the bit in the local copy
-        curr_word_val &= ~mask;
-        pmm_state.used_pages--;
+    return cache.loaded->pages[--cache.loaded->count];
+}
 
-        if (page_idx < pmm_state.free_idx_hint) {
-            pmm_state.free_idx_hint = page_idx;
+void PhysicalManager::cache_push(PerCPUCache& cache, uintptr_t page) {
+    if (cache.loaded->count == MAGAZINE_SIZE) {
+        if (cache.previous->count == 0) {
+            std::swap(cache.loaded, cache.previous);
+        } else if (Magazine* empty = depot_pop(pmm_state.empty_magazines)) {
+            // Both magazines are full: hand one to the depot.
+            depot_push(pmm_state.full_magazines[cache.node], cache.previous);
+            cache.previous = cache.loaded;
+            cache.loaded   = empty;
+        } else {
+            // No spare magazines left anywhere; return one to the buddy lists.
+            LockGuard guard(pmm_state.lock);
+            magazine_drain(*cache.previous);
+            std::swap(cache.loaded, cache.previous);
         }
+    }
+
+    cache.loaded->pages[cache.loaded->count++] = page;
+}
 
-        if (page_idx < pmm_state.aligned_index_hint) {
-            pmm_state.aligned_index_hint = page_idx;
+void* PhysicalManager::alloc(size_t count) {
+    if (count == 0) {
+        return nullptr;
+    }
+
+    if (count == 1) {
+        CacheGuard guard;
+
+        if (PerCPUCache* cache = guard.get()) {
+            uintptr_t page = cache_pop(*cache);
+
+            if (page != 0) {
+                clear_clean(page / PAGE_SIZE_4K);
+                claim_frame(page / PAGE_SIZE_4K);
+                return reinterpret_cast<void*>(page);
+            }
         }
     }
 
-    if (dirty && (last_word_idx < pmm_state.bitmap_entries)) {
-        const size_t last_word_byte = last_word_idx / bit_count;
-        const size_t last_word_bit  = last_word_idx % bit_count;
+    void* addr = alloc_slow(count, PAGE_SIZE_4K, local_node(), false);
+    if (addr != nullptr) {
+        // LOG_DEBUG("PMM alloc (buddy) count=%zu addr=%p used_pages=%zu", count, addr,
+        //   pmm_state.used_pages);
+    } else {
+        LOG_WARN("PMM alloc failed count=%zu", count);
+    }
+
+    return addr;
+}
 
-        pmm_state.bitmap[last_word_idx] = curr_word_val;
-        pmm_state.summary_bitmap[last_word_byte] &= ~(1ul << last_word_bit);
+void* PhysicalManager::alloc_aligned(size_t count, size_t alignment) {
+    if ((count == 0) || (alignment == 0) || (alignment % PAGE_SIZE_4K != 0) ||
+        !std::has_single_bit(alignment)) {
+        LOG_WARN("PMM alloc_aligned invalid params count=%zu align=0x%zx", count, alignment);
+        return nullptr;
+    }
+
+    void* addr = alloc_slow(count, alignment, local_node(), false);
+
+    if (addr == nullptr) {
+        LOG_WARN("PMM alloc_aligned failed count=%zu align=0x%zx", count, alignment);
     }
 
-    cache.count = target_count;
+    return addr;
 }
 
-void* PhysicalManager::alloc_from_bitmap(size_t count) {
-    size_t start_idx = pmm_state.free_idx_hint;
+void* PhysicalManager::alloc_on_node(uint32_t node, size_t count) {
+    if (count == 0) {
+        return nullptr;
+    }
+
+    // The CPU cache already holds node-local pages for its own node.
+    if ((count == 1) && (node == local_node())) {
+        return alloc(1);
+    }
+
+    void* addr = alloc_slow(count, PAGE_SIZE_4K, node, false);
 
-    if ((pmm_state.low_mem_threshold_idx < pmm_state.total_pages) &&
-        (start_idx < pmm_state.low_mem_threshold_idx)) {
-        start_idx = pmm_state.low_mem_threshold_idx;
+    if (addr == nullptr) {
+        LOG_WARN("PMM alloc_on_node failed node=%u count=%zu", node, count);
     }
 
-    // Core bitmap-based allocation path (single or multi-page).
-    if (count == 1) {
-        // Single-page allocations prefer to find a "mostly free" region
-        // using the summary bitmap, then drill down into the main bitmap.
-        size_t search_start         = start_idx / bit_count;
-        size_t search_start_summary = search_start / bit_count;
+    return addr;
+}
 
-        for (size_t s = search_start_summary; s < pmm_state.summary_entries; ++s) {
-            __builtin_prefetch(&pmm_state.summary_bitmap[s + 4], 0, 1);
+void* PhysicalManager::alloc_huge(PageSize size, bool use_reserve) {
+    if (size == PageSize::Size4K) {
+        return alloc();
+    }
 
-            // Each summary entry covers 64 bitmap entries = 4096 pages.
-            uint_least64_t summary_entry = pmm_state.summary_bitmap[s];
+    size_t pool  = huge_pool_of(size);
+    size_t pages = 1ul << huge_pool_order[pool];
 
-            // Summary == all ones => every tracked 64-page block here is full.
-            // Skipping avoids touching obviously-saturated regions at all.
-            if (summary_entry == static_cast<uint_least64_t>(-1)) {
-                continue;
+    uint32_t node   = local_node();
+    size_t page_idx = no_page;
+
+    if (use_reserve) {
+        LockGuard guard(pmm_state.lock);
+
+        // Prefer a reserved frame on this CPU's node, else any reserved frame.
+        FreeBlock** link = &pmm_state.huge_pool[pool];
+
+        for (FreeBlock** curr = link; *curr != nullptr; curr = &(*curr)->next) {
+            if (pmm_state.frames[block_index(*curr)].node == node) {
+                link = curr;
+                break;
+            }
+        }
+
+        if (FreeBlock* block = *link) {
+            *link = block->next;
+            pmm_state.huge_pool_count[pool]--;
+
+            page_idx = block_index(block);
+        }
+    }
+
+    if (page_idx == no_page) {
+        void* addr = alloc_slow(pages, pages * PAGE_SIZE_4K, node, false);
+
+        if (addr == nullptr) {
+            if (use_reserve) {
+                LOG_WARN("PMM alloc_huge failed size=%s", huge_pool_name[pool]);
             }
 
-            // Find a bitmap word (block of 64 pages) with at least one free page.
-            int block_offset = __builtin_ctzll(~summary_entry);
-            size_t map_idx   = (s * bit_count) + static_cast<size_t>(block_offset);
+            return nullptr;
+        }
 
-            // Now verify the actual bitmap word and pick the first free page in it.
-            if (map_idx < pmm_state.bitmap_entries) {
-                __builtin_prefetch(&pmm_state.bitmap[map_idx + 8], 0, 1);
-                uint_least64_t entry = pmm_state.bitmap[map_idx];
+        page_idx = reinterpret_cast<uintptr_t>(addr) / PAGE_SIZE_4K;
+    }
 
-                if (entry != static_cast<uint_least64_t>(-1)) {
-                    int bit_offset = __builtin_ctzll(~entry);
-                    size_t idx     = (map_idx * bit_count) + static_cast<size_t>(bit_offset);
+    claim_frame(page_idx, FrameHuge, static_cast<uint8_t>(huge_pool_order[pool]));
 
-                    if (idx < pmm_state.total_pages) {
-                        set_bit(idx);
-                        pmm_state.used_pages++;
-                        pmm_state.free_idx_hint = idx + 1;
+    return reinterpret_cast<void*>(page_idx * PAGE_SIZE_4K);
+}
 
-                        // LOG_DEBUG("PMM alloc_from_bitmap (summary path) page=%zu", idx);
-                        return reinterpret_cast<void*>(idx * PAGE_SIZE_4K);
-                    }
-                }
+void* PhysicalManager::alloc_clear(size_t count) {
+    if (count == 0) {
+        return nullptr;
+    }
+
+    // Single pages come from the clean pool whenever the idle thread kept up,
+    // else from the CPU cache, which may still hold pages freed clean.
+    if (count == 1) {
+        uintptr_t page = 0;
+        bool clean     = false;
+
+        {
+            CacheGuard guard;
+            PerCPUCache* cache = guard.get();
+
+            if (cache && (cache->zero_count > 0)) {
+                page  = cache->zero_stack[--cache->zero_count];
+                clean = true;
+            } else if (cache) {
+                page  = cache_pop(*cache);
+                clean = (page != 0) && test_clean(page / PAGE_SIZE_4K);
             }
         }
 
-        // Wrap around: if we started past 0, scan from 0 to the start hint.
-        if (pmm_state.free_idx_hint > 0) {
-            for (size_t s = 0; s < search_start_summary; ++s) {
-                uint_least64_t summary_entry = pmm_state.summary_bitmap[s];
+        if (page != 0) {
+            clear_clean(page / PAGE_SIZE_4K);
+            claim_frame(page / PAGE_SIZE_4K);
 
-                if (summary_entry == static_cast<uint_least64_t>(-1)) {
-                    continue;
-                }
+            if (!clean) {
+                memset(reinterpret_cast<void*>(to_higher_half(page)), 0, PAGE_SIZE_4K);
+            }
 
-                int block_offset = __builtin_ctzll(~summary_entry);
-                size_t map_idx   = (s * bit_count) + static_cast<size_t>(block_offset);
+            return reinterpret_cast<void*>(page);
+        }
+    }
 
-                if (map_idx < pmm_state.bitmap_entries) {
-                    uint_least64_t entry = pmm_state.bitmap[map_idx];
+    void* ret = alloc_slow(count, PAGE_SIZE_4K, local_node(), false, true);
 
-                    if (entry != static_cast<uint_least64_t>(-1)) {
-                        int bit_offset = __builtin_ctzll(~entry);
-                        size_t idx     = (map_idx * bit_count) + static_cast<size_t>(bit_offset);
+    if (ret == nullptr) {
+        LOG_WARN("PMM alloc_clear failed count=%zu", count);
+        return nullptr;
+    }
 
-                        if (idx < pmm_state.total_pages) {
-                            set_bit(idx);
-                            pmm_state.used_pages++;
-                            pmm_state.free_idx_hint = idx + 1;
+    // Only the pages that aren't known to be zero get cleared.
+    size_t page_idx = reinterpret_cast<uintptr_t>(ret) / PAGE_SIZE_4K;
 
-                            // LOG_DEBUG("PMM alloc_from_bitmap (wrap+summary) page=%zu", idx);
-                            return reinterpret_cast<void*>(idx * PAGE_SIZE_4K);
-                        }
-                    }
-                }
+    for (size_t i = 0; i < count; ++i) {
+        if (!test_clean(page_idx + i)) {
+            memset(reinterpret_cast<void*>(to_higher_half((page_idx + i) * PAGE_SIZE_4K)), 0,
+                   PAGE_SIZE_4K);
+        }
+    }
+
+    clear_clean_range(page_idx, count);
+
+    return ret;
+}
+
+void* PhysicalManager::alloc_dma(size_t count, size_t alignment) {
+    if ((count == 0) || (alignment == 0) || (alignment % PAGE_SIZE_4K != 0) ||
+        !std::has_single_bit(alignment)) {
+        LOG_WARN("PMM alloc_dma invalid params count=%zu align=0x%zx", count, alignment);
+        return nullptr;
+    }
+
+    return alloc_slow(count, alignment, local_node(), true);
+}
+
+void PhysicalManager::free_to_bitmap(size_t page_idx, size_t count) {
+    size_t end  = std::min(page_idx + count, pmm_state.total_pages);
+    size_t curr = page_idx;
+
+    while (curr < end) {
+        // Pages that are already free are skipped, so overlapping reclaims
+        // can never insert the same page into the buddy lists twice.
+        size_t run_start = cpu::arch::BitScan::find_first_set(pmm_state.bitmap, curr, end);
+        size_t run_end   = cpu::arch::BitScan::find_first_zero(pmm_state.bitmap, run_start, end);
+        size_t run_len   = run_end - run_start;
+
+        if (run_len > 0) {
+            clear_range(run_start, run_len);
+            pmm_state.used_pages -= run_len;
+            buddy_free_range(run_start, run_len);
+        }
+
+        curr = run_end;
+    }
+}
+
+void PhysicalManager::rebuild_free_lists() {
+    size_t total = pmm_state.total_pages;
+    size_t idx   = 0;
+
+    while (idx < total) {
+        size_t run_start = cpu::arch::BitScan::find_first_zero(pmm_state.bitmap, idx, total);
+        size_t run_end   = cpu::arch::BitScan::find_first_set(pmm_state.bitmap, run_start, total);
+
+        if (run_end > run_start) {
+            buddy_free_range(run_start, run_end - run_start);
+        }
+
+        idx = run_end;
+    }
+}
+
+void PhysicalManager::reserve_huge_pool() {
+    // 1GB frames first: they are the first casualties of fragmentation.
+    for (size_t pool = HUGE_POOLS; pool-- > 0;) {
+        size_t pages = 1ul << huge_pool_order[pool];
+
+        while (pmm_state.huge_pool_count[pool] < huge_pool_target[pool]) {
+            // Spread the reserve round-robin so every node has local frames.
+            size_t node = pmm_state.huge_pool_count[pool] % hal::Numa::node_count();
+            void* addr  = alloc_block(pages, pages * PAGE_SIZE_4K, static_cast<uint32_t>(node),
+                                      false);
+
+            if (addr == nullptr) {
+                break;
             }
+
+            FreeBlock* block          = block_at(reinterpret_cast<uintptr_t>(addr) / PAGE_SIZE_4K);
+            block->next               = pmm_state.huge_pool[pool];
+            pmm_state.huge_pool[pool] = block;
+            pmm_state.huge_pool_count[pool]++;
+        }
+
+        if (pmm_state.huge_pool_count[pool] < huge_pool_target[pool]) {
+            LOG_WARN("PMM: reserved only %zu of %zu %s frames", pmm_state.huge_pool_count[pool],
+                     huge_pool_target[pool], huge_pool_name[pool]);
+        } else if (huge_pool_target[pool] > 0) {
+            LOG_INFO("PMM: reserved %zu %s frames", huge_pool_target[pool], huge_pool_name[pool]);
+        }
+    }
+}
+
+void PhysicalManager::free(void* ptr, size_t count) {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    release_frame(reinterpret_cast<uintptr_t>(ptr) / PAGE_SIZE_4K);
+
+    if (count == 1) {
+        CacheGuard guard;
+
+        if (PerCPUCache* cache = guard.get()) {
+            cache_push(*cache, reinterpret_cast<uintptr_t>(ptr));
+            return;
         }
     }
 
-    return alloc_aligned(count, PAGE_SIZE_4K);
+    LockGuard guard(pmm_state.lock);
+
+    // Multi-page free: release the range to the bitmap and buddy lists.
+    free_to_bitmap(reinterpret_cast<uintptr_t>(ptr) / PAGE_SIZE_4K, count);
+    // LOG_DEBUG("PMM free range addr=%p count=%zu used_pages=%zu", ptr, count,
+    // pmm_state.used_pages);
 }
 
-void* PhysicalManager::alloc(size_t count) {
+void PhysicalManager::put_batch(uintptr_t* pages, size_t count) {
+    size_t last = 0;
+
+    // Pages someone else still holds a reference to stay where they are
+    for (size_t i = 0; i < count; ++i) {
+        PageFrame* page = frame(pages[i]);
+
+        if (page && (page->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)) {
+            pages[last++] = pages[i];
+        }
+    }
+
+    count = last;
+
     if (count == 0) {
-        return nullptr;
+        return;
+    }
+
+    {
+        CacheGuard guard;
+
+        if (PerCPUCache* cache = guard.get()) {
+            for (size_t i = 0; i < count; ++i) {
+                cache_push(*cache, pages[i]);
+            }
+
+            return;
+        }
+    }
+
+    LockGuard guard(pmm_state.lock);
+
+    for (size_t i = 0; i < count; ++i) {
+        free_to_bitmap(pages[i] / PAGE_SIZE_4K, 1);
+    }
+}
+
+void PhysicalManager::free_huge(void* ptr, PageSize size) {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    if (size == PageSize::Size4K) {
+        free(ptr);
+        return;
+    }
+
+    size_t pool     = huge_pool_of(size);
+    size_t page_idx = reinterpret_cast<uintptr_t>(ptr) / PAGE_SIZE_4K;
+
+    release_frame(page_idx);
+
+    LockGuard guard(pmm_state.lock);
+
+    // Top the reserve back up before giving frames to the buddy lists.
+    if (pmm_state.huge_pool_count[pool] < huge_pool_target[pool]) {
+        FreeBlock* block          = block_at(page_idx);
+        block->next               = pmm_state.huge_pool[pool];
+        pmm_state.huge_pool[pool] = block;
+        pmm_state.huge_pool_count[pool]++;
+        return;
+    }
+
+    free_to_bitmap(page_idx, 1ul << huge_pool_order[pool]);
+}
+
+void PhysicalManager::free_clean(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    uintptr_t page = reinterpret_cast<uintptr_t>(ptr);
+
+    // Free like any other page: the frame no longer has an owner
+    release_frame(page / PAGE_SIZE_4K);
+    mark_clean(page / PAGE_SIZE_4K);
+
+    {
+        CacheGuard guard;
+        PerCPUCache* cache = guard.get();
+
+        if (cache && (cache->zero_count < ZERO_POOL_SIZE)) {
+            cache->zero_stack[cache->zero_count++] = page;
+            return;
+        }
     }
 
-    if ((count == 1) && pmm_state.cpus) {
-        LockGuard guard(pmm_state.interrupt_lock);
+    // Pool is full: the page still carries its clean bit through the normal
+    // free path, so the idle thread won't zero it again.
+    free(ptr);
+}
+
+size_t PhysicalManager::refill_zero_pool(size_t budget) {
+    if (pmm_state.cpus == nullptr) {
+        return 0;
+    }
+
+    size_t added = 0;
+
+    while (added < budget) {
+        uintptr_t page = 0;
+
+        {
+            CacheGuard guard;
+            PerCPUCache* cache = guard.get();
+
+            if ((cache == nullptr) || (cache->zero_count >= ZERO_POOL_SIZE)) {
+                break;
+            }
+
+            // Taken raw: a page that is still clean doesn't need zeroing again.
+            page = cache_pop(*cache);
 
-        size_t core_id = 0;
+            if (page == 0) {
+                break;
+            }
+        }
 
-        if (cpu::CpuCoreManager::get().initialized()) {
-            core_id = cpu::CpuCoreManager::get().get_current_core()->core_idx;
+        // Zero with interrupts on: the page is private to us until it's
+        // published below, and a wakeup must be able to preempt the idle loop.
+        if (!test_clean(page / PAGE_SIZE_4K)) {
+            arch::zero_page_nt(reinterpret_cast<void*>(to_higher_half(page)));
+            mark_clean(page / PAGE_SIZE_4K);
         }
 
-        if (core_id < pmm_state.num_cpus) {
-            PerCPUCache& cache = pmm_state.cpus[core_id];
+        {
+            // We may have migrated while zeroing; publish on whichever core we're on now.
+            CacheGuard guard;
+            PerCPUCache* cache = guard.get();
 
-            if (cache.count == 0) {
+            if (cache && (cache->zero_count < ZERO_POOL_SIZE)) {
+                cache->zero_stack[cache->zero_count++] = page;
+            } else if (cache) {
+                cache_push(*cache, page);
+            } else {
                 LockGuard _(pmm_state.lock);
-                cache_refill(cache);
-            }
-
-            if (cache.count > 0) {
-                return reinterpret_cast<void*>(cache.stack[--cache.count]);
+                free_to_bitmap(page / PAGE_SIZE_4K, 1);
             }
         }
-    }
-
-    LockGuard guard(pmm_state.lock);
 
-    void* addr = alloc_from_bitmap(count);
-    if (addr != nullptr) {
-        // LOG_DEBUG("PMM alloc (bitmap) count=%zu addr=%p used_pages=%zu", count, addr,
-        //   pmm_state.used_pages);
-    } else {
-        LOG_WARN("PMM alloc failed count=%zu", count);
+        added++;
     }
 
-    return addr;
+    return added;
 }
 
-void* PhysicalManager::alloc_aligned(size_t count, size_t alignment) {
-    if ((count == 0) || (alignment == 0) || (alignment % PAGE_SIZE_4K != 0)) {
-        LOG_WARN("PMM alloc_aligned invalid params count=%zu align=0x%zx", count, alignment);
-        return nullptr;
-    }
+void PhysicalManager::reclaim_type(size_t memmap_type) {
+    // Reclaim all regions of a specific Limine memmap type.
+    for (size_t i = 0; i < memmap_request.response->entry_count; ++i) {
+        limine_memmap_entry* entry = memmap_request.response->entries[i];
+
+        if (entry->type == memmap_type) {
+            uintptr_t base_aligned = align_up(entry->base, PAGE_SIZE_4K);
+            uintptr_t end_aligned  = align_down(entry->base + entry->length, PAGE_SIZE_4K);
 
-    size_t pages_per_alignment = alignment / PAGE_SIZE_4K;
+            if (end_aligned > base_aligned) {
+                size_t pages = (end_aligned - base_aligned) / PAGE_SIZE_4K;
+                free(reinterpret_cast<void*>(base_aligned), pages);
+                LOG_INFO("PMM reclaimed type=%zu base=0x%lx pages=%zu", memmap_type, base_aligned,
+                         pages);
+            }
+        }
+    }
+}
 
+PMMStats PhysicalManager::get_stats() {
     LockGuard guard(pmm_state.lock);
 
-    size_t start_hint = pmm_state.free_idx_hint;
+    size_t cached_total = 0;
+    size_t zeroed_total = 0;
 
-    // Prefer High Memory
-    if ((pmm_state.low_mem_threshold_idx < pmm_state.total_pages) &&
-        (start_hint < pmm_state.low_mem_threshold_idx)) {
-        start_hint = pmm_state.low_mem_threshold_idx;
+    for (size_t i = 0; i < pmm_state.num_cpus; ++i) {
+        cached_total += pmm_state.cpus[i].loaded->count + pmm_state.cpus[i].previous->count;
+        zeroed_total += pmm_state.cpus[i].zero_count;
     }
 
-    // Use the aligned hint if alignment is large
-    if (alignment >= PAGE_SIZE_2M) {
-        start_hint = pmm_state.aligned_index_hint;
+    for (const MagazineDepot& depot : pmm_state.full_magazines) {
+        cached_total += __atomic_load_n(&depot.pages, __ATOMIC_RELAXED);
     }
 
-    // Two-pass search.
-    auto try_alloc = [&](size_t start, size_t end) -> void* {
-        size_t curr = align_up(start, pages_per_alignment);
+    size_t huge_total = 0;
 
-        while (curr < end) {
-            // Ensure we don't overrun physical memory or the search range.
-            if (curr + count > pmm_state.total_pages) {
-                break;
-            }
+    for (size_t i = 0; i < HUGE_POOLS; ++i) {
+        huge_total += pmm_state.huge_pool_count[i] << huge_pool_order[i];
+    }
 
-            if ((curr % bit_count) == 0 && (count >= bit_count)) {
-                size_t summary_idx = curr / bit_count / bit_count;
+    // Pages parked in the CPU caches, the depot and clean pools are free to
+    // callers. The huge reserve is neither used nor generally free.
+    size_t actual_used = pmm_state.used_pages - cached_total - zeroed_total - huge_total;
 
-                if ((summary_idx < pmm_state.summary_entries) &&
-                    (pmm_state.summary_bitmap[summary_idx] == ~0ul)) {
-                    curr += (bit_count * bit_count);
-                    curr = align_up(curr, pages_per_alignment);
-                    continue;
-                }
-            }
+    PMMStats stats      = {};
+    stats.total_memory  = pmm_state.total_pages * PAGE_SIZE_4K;
+    stats.used_memory   = actual_used * PAGE_SIZE_4K;
+    stats.free_memory   = (pmm_state.total_pages - actual_used - huge_total) * PAGE_SIZE_4K;
+    stats.zeroed_memory = zeroed_total * PAGE_SIZE_4K;
+    stats.huge_reserved = huge_total * PAGE_SIZE_4K;
 
-            // Inner scan: Check if `count` pages starting at `curr` are free.
-            bool fit = true;
-            for (size_t j = 0; j < count; ++j) {
-                if (test_bit(curr + j)) {
-                    fit = false;
+    return stats;
+}
 
-                    // Found an allocated page at (curr + j); skip ahead to next alignment.
-                    curr = align_up(curr + j + 1, pages_per_alignment);
-                    break;
-                }
-            }
+size_t PhysicalManager::watermark_deficit(Watermark mark) {
+    size_t target = pmm_state.watermarks[static_cast<size_t>(mark)];
+    size_t free   = __atomic_load_n(&pmm_state.free_pages, __ATOMIC_RELAXED);
 
-            if (fit) {
-                // Mark pages as used.
-                for (size_t j = 0; j < count; ++j) {
-                    set_bit(curr + j);
-                }
+    return (free < target) ? (target - free) : 0;
+}
 
-                pmm_state.used_pages += count;
-                if (alignment >= PAGE_SIZE_2M) {
-                    pmm_state.aligned_index_hint = curr + count;
-                } else {
-                    pmm_state.free_idx_hint = curr + count;
-                }
+void PhysicalManager::drain_local_cache() {
+    CacheGuard guard;
+    PerCPUCache* cache = guard.get();
 
-                void* addr = reinterpret_cast<void*>(curr * PAGE_SIZE_4K);
-                // LOG_DEBUG("PMM alloc_aligned count=%zu align=0x%zx addr=%p used_pages=%zu",
-                // count,
-                //   alignment, addr, pmm_state.used_pages);
-                return addr;
-            }
-        }
+    // Also the case when we interrupted this core's own cache operation.
+    if (cache == nullptr) {
+        return;
+    }
 
-        return nullptr;
-    };
+    LockGuard pmm_guard(pmm_state.lock);
 
-    // Pass 1: Hint -> End.
-    void* res = try_alloc(start_hint, pmm_state.total_pages);
+    magazine_drain(*cache->loaded);
+    magazine_drain(*cache->previous);
 
-    if (res) {
-        return res;
+    // Pre-zeroed pages keep their clean bit, so no zeroing work is lost.
+    for (size_t i = 0; i < cache->zero_count; ++i) {
+        free_to_bitmap(cache->zero_stack[i] / PAGE_SIZE_4K, 1);
     }
 
-    // Pass 2: 0 -> Hint (wrap around).
-    if (pmm_state.free_idx_hint > 0) {
-        res = try_alloc(0, pmm_state.free_idx_hint);
+    cache->zero_count = 0;
+}
+
+size_t PhysicalManager::shrink_count(void*) {
+    size_t cached = 0;
 
-        if (res) {
-            return res;
-        }
+    // Unlocked snapshot; it only decides whether a scan is worth it.
+    for (size_t i = 0; i < pmm_state.num_cpus; ++i) {
+        const PerCPUCache& cache = pmm_state.cpus[i];
+        cached += cache.loaded->count + cache.previous->count + cache.zero_count;
     }
 
-    LOG_WARN("PMM alloc_aligned failed count=%zu align=0x%zx", count, alignment);
-    return nullptr;
+    for (const MagazineDepot& depot : pmm_state.full_magazines) {
+        cached += __atomic_load_n(&depot.pages, __ATOMIC_RELAXED);
+    }
+
+    return cached;
 }
 
-void* PhysicalManager::alloc_clear(size_t count) {
-    void* ret = alloc(count);
+size_t PhysicalManager::shrink_scan(void*, size_t) {
+    size_t before = __atomic_load_n(&pmm_state.free_pages, __ATOMIC_RELAXED);
 
-    if (ret != nullptr) {
-        // Map into higher-half and clear contents.
-        uintptr_t virt = to_higher_half(reinterpret_cast<uintptr_t>(ret));
-        memset(reinterpret_cast<void*>(virt), 0, count * PAGE_SIZE_4K);
-        // LOG_DEBUG("PMM alloc_clear count=%zu addr=%p", count, ret);
+    // Everything goes, whatever was asked for: the caches refill on demand.
+    {
+        LockGuard guard(pmm_state.lock);
+        depot_drain();
     }
 
-    return ret;
-}
+    drain_local_cache();
 
-void* PhysicalManager::alloc_dma(size_t count, size_t alignment) {
-    if ((count == 0) || (alignment == 0) || (alignment % PAGE_SIZE_4K != 0)) {
-        LOG_WARN("PMM alloc_dma invalid params count=%zu align=0x%zx", count, alignment);
-        return nullptr;
+    // A CPU's magazines belong to it alone, so each one drains its own. The
+    // wait for their answers needs interrupts on here, or a CPU waiting on
+    // an IPI of ours would never get its reply.
+    if (cpu::CpuCoreManager::get().initialized() && arch::interrupt_status()) {
+        cpu::CpuCoreManager::call_on_others([](void*) { drain_local_cache(); }, nullptr);
     }
 
-    size_t pages_per_alignment = alignment / PAGE_SIZE_4K;
+    size_t after = __atomic_load_n(&pmm_state.free_pages, __ATOMIC_RELAXED);
+
+    return (after > before) ? (after - before) : 0;
+}
+
+uintptr_t PhysicalManager::isolate_block(size_t max_used, size_t& used) {
+    constexpr size_t block_pages = 1ul << HUGE_2M_ORDER;
 
     LockGuard guard(pmm_state.lock);
 
-    size_t limit = pmm_state.low_mem_threshold_idx;
-    size_t curr  = 0;
+    // One block at a time; there is a single compactor.
+    if (pmm_state.isolated_base != 0) {
+        return 0;
+    }
 
-    while (curr < limit) {
-        if ((curr + count) > limit) {
-            break;
-        }
+    // Pages parked in depot magazines read as used and would pin their
+    // blocks; give them back to the buddy lists first.
+    depot_drain();
 
-        if ((curr % bit_count) == 0 && (count >= bit_count)) {
-            size_t summary_idx = curr / bit_count / bit_count;
+    size_t blocks = pmm_state.total_pages / block_pages;
 
-            if ((summary_idx < pmm_state.summary_entries) &&
-                (pmm_state.summary_bitmap[summary_idx] == ~0ul)) {
-                curr += (bit_count * bit_count);
-                curr = align_up(curr, pages_per_alignment);
-                continue;
-            }
+    for (size_t n = 0; n < blocks; ++n) {
+        size_t blk               = pmm_state.compact_cursor;
+        pmm_state.compact_cursor = ((blk + 1) < blocks) ? (blk + 1) : 0;
+
+        // Block 0 can't be told apart from "none", and never holds much anyway.
+        size_t first = blk * block_pages;
+        Zone* zone   = zone_of(first);
+
+        if ((blk == 0) || (zone == nullptr) || (zone->end_pfn < (first + block_pages))) {
+            continue;
         }
 
-        bool fit = true;
+        size_t in_use = cpu::arch::BitScan::popcount(&pmm_state.bitmap[first / bit_count],
+                                                     HUGE_2M_WORDS);
 
-        for (size_t i = 0; i < count; ++i) {
-            if (test_bit(curr + i)) {
-                fit  = false;
-                curr = align_up(curr + i + 1, pages_per_alignment);
-                break;
-            }
+        if ((in_use == 0) || (in_use > max_used)) {
+            continue;
         }
 
-        if (fit) {
-            for (size_t i = 0; i < count; ++i) {
-                set_bit(curr + i);
+        // Free blocks below 2MB are naturally aligned, so each one lies
+        // wholly inside and is found through its head page.
+        memset(pmm_state.isolated, 0, sizeof(pmm_state.isolated));
+
+        for (size_t idx = first; idx < (first + block_pages);) {
+            uint8_t order = pmm_state.block_order[idx];
+
+            if (order == no_order) {
+                idx++;
+                continue;
             }
 
-            pmm_state.used_pages += count;
+            size_t pages = 1ul << order;
+            remove_block(*zone, idx, order);
+            set_range(idx, pages);
+            pmm_state.used_pages += pages;
 
-            return reinterpret_cast<void*>(curr * PAGE_SIZE_4K);
+            for (size_t k = idx - first; k < (idx - first + pages); ++k) {
+                pmm_state.isolated[k / bit_count] |= (1ull << (k % bit_count));
+            }
+
+            idx += pages;
         }
+
+        pmm_state.isolated_base = first * PAGE_SIZE_4K;
+        used                    = in_use;
+
+        return pmm_state.isolated_base;
     }
 
-    return nullptr;
+    return 0;
 }
 
-void PhysicalManager::free_to_bitmap(size_t page_idx, size_t count) {
-    size_t curr      = page_idx;
-    size_t remaining = count;
+void PhysicalManager::release_block(uintptr_t base, const uintptr_t* migrated, size_t count) {
+    constexpr size_t block_pages = 1ul << HUGE_2M_ORDER;
+
+    LockGuard guard(pmm_state.lock);
 
-    // Free individual bits until 64-page aligned
-    while ((remaining > 0) && (curr % bit_count) != 0) {
-        if ((curr < pmm_state.total_pages) && test_bit(curr)) {
-            clear_bit(curr);
-            pmm_state.used_pages--;
+    if ((base == 0) || (base != pmm_state.isolated_base)) {
+        return;
+    }
+
+    size_t first = base / PAGE_SIZE_4K;
+    size_t idx   = 0;
+
+    while (idx < block_pages) {
+        size_t run_start = cpu::arch::BitScan::find_first_set(pmm_state.isolated, idx, block_pages);
+        size_t run_end   = cpu::arch::BitScan::find_first_zero(pmm_state.isolated, run_start,
+                                                               block_pages);
+
+        if (run_end > run_start) {
+            free_to_bitmap(first + run_start, run_end - run_start);
         }
 
-        curr++;
-        remaining--;
+        idx = run_end;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        release_frame(migrated[i] / PAGE_SIZE_4K);
+        free_to_bitmap(migrated[i] / PAGE_SIZE_4K, 1);
     }
 
-    // Free 64 pages at a time using word writes
-    while (remaining >= bit_count) {
-        size_t word_idx = curr / bit_count;
+    pmm_state.isolated_base = 0;
+}
 
-        if (word_idx < pmm_state.bitmap_entries) {
-            uint_least64_t old_val = pmm_state.bitmap[word_idx];
+PageFrame* PhysicalManager::frame(uintptr_t phys) {
+    size_t page_idx = phys / PAGE_SIZE_4K;
 
-            if (old_val != 0) {
-                const size_t byte = word_idx / bit_count;
-                const size_t bit  = word_idx % bit_count;
+    if ((pmm_state.frames == nullptr) || (page_idx >= pmm_state.total_pages)) {
+        return nullptr;
+    }
 
-                // Count how many bits are flipped from 1->0
-                pmm_state.used_pages -= static_cast<size_t>(__builtin_popcountll(old_val));
-                pmm_state.bitmap[word_idx] = 0;
+    // The frames of a slice still waiting for deferred init hold garbage.
+    if (page_idx >= pmm_state.boot_pages) {
+        size_t slice = (page_idx - pmm_state.boot_pages) / DEFERRED_SLICE_PAGES;
 
-                pmm_state.summary_bitmap[byte] &= ~(1ul << bit);
-            }
+        if (__atomic_load_n(&pmm_state.slices[slice], __ATOMIC_ACQUIRE) != SliceReady) {
+            return nullptr;
         }
+    }
+
+    return &pmm_state.frames[page_idx];
+}
 
-        curr += bit_count;
-        remaining -= bit_count;
+void PhysicalManager::get_frame(uintptr_t phys) {
+    if (PageFrame* page = frame(phys)) {
+        page->refcount.fetch_add(1, std::memory_order_relaxed);
     }
+}
 
-    // Free remaining individual bits
-    while (remaining > 0) {
-        if ((curr < pmm_state.total_pages) && test_bit(curr)) {
-            clear_bit(curr);
-            pmm_state.used_pages--;
-        }
+void PhysicalManager::put_frame(uintptr_t phys) {
+    PageFrame* page = frame(phys);
 
-        curr++;
-        remaining--;
+    if ((page == nullptr) || (page->refcount.fetch_sub(1, std::memory_order_acq_rel) != 1)) {
+        return;
     }
 
-    // Hint Update
-    if ((page_idx < pmm_state.free_idx_hint) && (page_idx > pmm_state.low_mem_threshold_idx)) {
-        pmm_state.free_idx_hint = page_idx;
+    void* ptr = reinterpret_cast<void*>(phys & ~(PAGE_SIZE_4K - 1));
+
+    if (page->flags & FrameHuge) {
+        free_huge(ptr, (page->order == HUGE_1G_ORDER) ? PageSize::Size1G : PageSize::Size2M);
+    } else {
+        free(ptr);
     }
 }
 
-void PhysicalManager::free(void* ptr, size_t count) {
-    if (ptr == nullptr) {
+void PhysicalManager::split_huge(uintptr_t phys, PageSize size) {
+    PageFrame* head = frame(phys);
+
+    if ((head == nullptr) || !(head->flags & FrameHuge)) {
         return;
     }
 
-    if ((count == 1) && (pmm_state.cpus)) {
-        LockGuard guard(pmm_state.interrupt_lock);
+    size_t step     = (size == PageSize::Size1G) ? (PAGE_SIZE_2M / PAGE_SIZE_4K) : 1;
+    uint32_t refs   = head->refcount.load(std::memory_order_relaxed);
+    uint16_t flags  = head->flags;
+    uint8_t order   = (size == PageSize::Size1G) ? HUGE_2M_ORDER : 0;
+    size_t head_idx = phys / PAGE_SIZE_4K;
 
-        size_t core_id = 0;
+    if (size != PageSize::Size1G) {
+        flags &= static_cast<uint16_t>(~FrameHuge);
+    }
+
+    // Tail frames still hold whatever their last use left in them
+    for (size_t i = 0; i < 512; ++i) {
+        PageFrame& page = pmm_state.frames[head_idx + (i * step)];
 
-        if (cpu::CpuCoreManager::get().initialized()) {
-            core_id = cpu::CpuCoreManager::get().get_current_core()->core_idx;
+        if (i != 0) {
+            page.mapcount.store(0, std::memory_order_relaxed);
+            page.slab = nullptr;
         }
 
-        if (core_id < pmm_state.num_cpus) {
-            PerCPUCache& cache = pmm_state.cpus[core_id];
+        page.refcount.store(refs, std::memory_order_relaxed);
+        page.flags = flags;
+        page.order = order;
+    }
+}
 
-            if (cache.count >= cache.capacity) {
-                LockGuard _(pmm_state.lock);
-                cache_flush(cache);
-            }
+bool PhysicalManager::merge_huge(uintptr_t phys) {
+    PageFrame* head = frame(phys);
 
-            cache.stack[cache.count++] = reinterpret_cast<uintptr_t>(ptr);
-            return;
-        }
+    if ((head == nullptr) || !is_aligned(phys, PAGE_SIZE_2M)) {
+        return false;
     }
 
-    LockGuard guard(pmm_state.lock);
-
-    // Multi-page free: go directly to bitmap.
-    free_to_bitmap(reinterpret_cast<uintptr_t>(ptr) / PAGE_SIZE_4K, count);
-    // LOG_DEBUG("PMM free range addr=%p count=%zu used_pages=%zu", ptr, count,
-    // pmm_state.used_pages);
-}
+    size_t head_idx = phys / PAGE_SIZE_4K;
 
-void PhysicalManager::reclaim_type(size_t memmap_type) {
-    // Reclaim all regions of a specific Limine memmap type.
-    for (size_t i = 0; i < memmap_request.response->entry_count; ++i) {
-        limine_memmap_entry* entry = memmap_request.response->entries[i];
+    if ((head_idx + 512) > pmm_state.total_pages) {
+        return false;
+    }
 
-        if (entry->type == memmap_type) {
-            uintptr_t base_aligned = align_up(entry->base, PAGE_SIZE_4K);
-            uintptr_t end_aligned  = align_down(entry->base + entry->length, PAGE_SIZE_4K);
+    for (size_t i = 0; i < 512; ++i) {
+        PageFrame& page = pmm_state.frames[head_idx + i];
 
-            if (end_aligned > base_aligned) {
-                size_t pages = (end_aligned - base_aligned) / PAGE_SIZE_4K;
-                free(reinterpret_cast<void*>(base_aligned), pages);
-                LOG_INFO("PMM reclaimed type=%zu base=0x%lx pages=%zu", memmap_type, base_aligned,
-                         pages);
-            }
+        if ((page.flags != 0) || (page.zone != head->zone) ||
+            (page.refcount.load(std::memory_order_relaxed) != 1)) {
+            return false;
         }
     }
+
+    // The tails are covered by the head from here on; freeing the frame
+    // releases the head only, as for any `alloc_huge` frame.
+    head->flags = FrameHuge;
+    head->order = HUGE_2M_ORDER;
+    return true;
 }
 
-PMMStats PhysicalManager::get_stats() {
+size_t PhysicalManager::free_huge_blocks() {
     LockGuard guard(pmm_state.lock);
 
-    size_t cached_total = 0;
+    size_t blocks = 0;
 
-    for (size_t i = 0; i < pmm_state.num_cpus; ++i) {
-        cached_total += pmm_state.cpus[i].count;
+    for (size_t z = 0; z < pmm_state.zone_count; ++z) {
+        for (size_t order = HUGE_2M_ORDER; order <= MAX_ORDER; ++order) {
+            blocks += pmm_state.zones[z].free_count[order] << (order - HUGE_2M_ORDER);
+        }
     }
 
-    size_t actual_used = pmm_state.used_pages - cached_total;
-
-    PMMStats stats     = {};
-    stats.total_memory = pmm_state.total_pages * PAGE_SIZE_4K;
-    stats.used_memory  = actual_used * PAGE_SIZE_4K;
-    stats.free_memory  = (pmm_state.total_pages - actual_used) * PAGE_SIZE_4K;
-
-    return stats;
+    return blocks;
 }
 
 void PhysicalManager::init() {
@@ -714,6 +1763,10 @@ void PhysicalManager::init() {
         PANIC("Error in Limine Memory Map");
     }
 
+    cpu::arch::BitScan::init();
+
+    size_t init_start = hal::Timer::get_cycles();
+
     limine_memmap_entry** memmaps = memmap_request.response->entries;
     size_t memmap_count           = memmap_request.response->entry_count;
 
@@ -755,6 +1808,11 @@ void PhysicalManager::init() {
         pmm_state.low_mem_threshold_idx = pmm_state.total_pages;
     }
 
+    pmm_state.boot_pages  = std::min(pmm_state.total_pages, BOOT_INIT_PAGES);
+    pmm_state.slice_count = div_roundup(pmm_state.total_pages - pmm_state.boot_pages,
+                                        DEFERRED_SLICE_PAGES);
+    pmm_state.slices_left = pmm_state.slice_count;
+
     LOG_INFO("PMM: highest_addr=0x%lx total_pages=%zu low_memory_threshold_page=%zu", highest_addr,
              pmm_state.total_pages, pmm_state.low_mem_threshold_idx);
 
@@ -766,16 +1824,34 @@ void PhysicalManager::init() {
     size_t summary_bytes      = align_up(div_roundup(summary_bits, 8u), 8u);
     pmm_state.summary_entries = summary_bytes / 8;
 
-    // `N` CPU stack cache size (for per cpu cache).
-    size_t structs_byte = pmm_state.num_cpus * sizeof(PerCPUCache);
-    size_t stack_bytes  = pmm_state.num_cpus * (CACHE_SIZE * sizeof(uintptr_t));
+    // `N` CPU caches plus the magazines they and the depot cycle through.
+    size_t structs_byte   = pmm_state.num_cpus * sizeof(PerCPUCache);
+    size_t magazine_count = pmm_state.num_cpus * MAGAZINES_PER_CPU;
+    size_t magazine_bytes = magazine_count * sizeof(Magazine);
+
+    // One byte per page recording the order of the free block it heads.
+    size_t order_bytes = align_up(pmm_state.total_pages, 8u);
+
+    // Clean-page bitmap plus the per-CPU pre-zeroed page stacks.
+    size_t clean_bytes = bitmap_bytes;
+    size_t zero_bytes  = pmm_state.num_cpus * (ZERO_POOL_SIZE * sizeof(uintptr_t));
+
+    // Frame database, padded so it can start on a cache line.
+    size_t frame_bytes = (pmm_state.total_pages * sizeof(PageFrame)) + CACHE_LINE_SIZE;
 
-    size_t total_metadata_bytes = bitmap_bytes + summary_bytes + structs_byte + stack_bytes;
+    // One state byte per deferred slice.
+    size_t slice_bytes = align_up(pmm_state.slice_count, 8u);
+
+    size_t total_metadata_bytes = bitmap_bytes + summary_bytes + structs_byte + magazine_bytes +
+                                  order_bytes + clean_bytes + zero_bytes + frame_bytes +
+                                  slice_bytes;
 
     LOG_DEBUG(
-        "PMM: bitmap_bytes=%zu summary_bytes=%zu cpu_cache_bytes=%zu stack_bytes=%zu "
+        "PMM: bitmap_bytes=%zu summary_bytes=%zu cpu_cache_bytes=%zu magazine_bytes=%zu "
+        "order_bytes=%zu clean_bytes=%zu zero_bytes=%zu frame_bytes=%zu slice_bytes=%zu "
         "metadata_total=%zu",
-        bitmap_bytes, summary_bytes, structs_byte, stack_bytes, total_metadata_bytes);
+        bitmap_bytes, summary_bytes, structs_byte, magazine_bytes, order_bytes, clean_bytes,
+        zero_bytes, frame_bytes, slice_bytes, total_metadata_bytes);
 
     // Find suitable hole for metadata. The idea is to place metadata in a
     // contiguous region that we then remove from the general pool, so the
@@ -826,15 +1902,16 @@ void PhysicalManager::init() {
         }
     }
 
-    // Reserve metadata region: we move the Limine entry forward so the
-    // rest of the kernel never sees that region as free RAM.
-    void* metadata_phys = reinterpret_cast<void*>(meta_base);
-    best_candidate->base += total_metadata_bytes;
-    best_candidate->length -= total_metadata_bytes;
+    // Reserve metadata region: `for_each_usable` skips these pages, so they
+    // never count as free RAM, now or when a deferred slice comes up.
+    void* metadata_phys  = reinterpret_cast<void*>(meta_base);
+    pmm_state.meta_start = meta_base / PAGE_SIZE_4K;
+    pmm_state.meta_end   = div_roundup(meta_base + total_metadata_bytes, PAGE_SIZE_4K);
 
     uintptr_t metadata_virt_addr = to_higher_half(reinterpret_cast<uintptr_t>(metadata_phys));
 
-    // Layout: [bitmap][summary bitmap][cpu cache][cpu stack cache]
+    // Layout: [bitmap][summary bitmap][cpu cache][magazines][block orders]
+    //         [clean bitmap][cpu zero stacks][frame database][slice states]
     pmm_state.bitmap = reinterpret_cast<uintptr_t*>(metadata_virt_addr);
 
     pmm_state.summary_bitmap = reinterpret_cast<uintptr_t*>(metadata_virt_addr + bitmap_bytes);
@@ -842,15 +1919,59 @@ void PhysicalManager::init() {
     pmm_state.cpus =
         reinterpret_cast<PerCPUCache*>(metadata_virt_addr + bitmap_bytes + summary_bytes);
 
-    uintptr_t* stack_data_start = reinterpret_cast<uintptr_t*>(metadata_virt_addr + bitmap_bytes +
-                                                               summary_bytes + structs_byte);
+    pmm_state.magazines = reinterpret_cast<Magazine*>(metadata_virt_addr + bitmap_bytes +
+                                                      summary_bytes + structs_byte);
+
+    // Each CPU starts with two empty magazines; the rest wait in the depot.
+    for (size_t i = 0; i < magazine_count; ++i) {
+        Magazine* mag = &pmm_state.magazines[i];
+        mag->count    = 0;
+
+        if (i < pmm_state.num_cpus) {
+            pmm_state.cpus[i].loaded = mag;
+        } else if (i < (pmm_state.num_cpus * 2)) {
+            pmm_state.cpus[i - pmm_state.num_cpus].previous = mag;
+        } else {
+            depot_push(pmm_state.empty_magazines, mag);
+        }
+    }
+
+    for (size_t i = 0; i < pmm_state.num_cpus; ++i) {
+        pmm_state.cpus[i].node = 0;
+        pmm_state.cpus[i].busy = false;
+    }
+
+    // Only boot memory: every deferred slice initializes its own share.
+    pmm_state.block_order = reinterpret_cast<uint8_t*>(pmm_state.magazines) + magazine_bytes;
+    memset(pmm_state.block_order, no_order, pmm_state.boot_pages);
+
+    pmm_state.clean_bitmap =
+        reinterpret_cast<uint_least64_t*>(pmm_state.block_order + order_bytes);
+    memset(pmm_state.clean_bitmap, 0, clean_bytes);
+
+    uintptr_t* zero_data_start =
+        reinterpret_cast<uintptr_t*>(reinterpret_cast<uint8_t*>(pmm_state.clean_bitmap) +
+                                     clean_bytes);
 
     for (size_t i = 0; i < pmm_state.num_cpus; ++i) {
-        pmm_state.cpus[i].count    = 0;
-        pmm_state.cpus[i].capacity = CACHE_SIZE;
-        pmm_state.cpus[i].stack    = stack_data_start + (i * CACHE_SIZE);
+        pmm_state.cpus[i].zero_stack = zero_data_start + (i * ZERO_POOL_SIZE);
+        pmm_state.cpus[i].zero_count = 0;
     }
 
+    uintptr_t frame_start = reinterpret_cast<uintptr_t>(zero_data_start) + zero_bytes;
+    frame_start           = align_up(frame_start, static_cast<size_t>(CACHE_LINE_SIZE));
+
+    pmm_state.frames = reinterpret_cast<PageFrame*>(frame_start);
+    init_frames(0, pmm_state.boot_pages);
+
+    pmm_state.slices = reinterpret_cast<uint8_t*>(pmm_state.frames + pmm_state.total_pages);
+    memset(pmm_state.slices, SlicePending, slice_bytes);
+
+    // Until ACPI is up every page belongs to node 0; `init_numa` re-zones.
+    setup_zones();
+
+    size_t frames_done = hal::Timer::get_cycles();
+
     LOG_DEBUG(
         "PMM: bitmap@%p (%zu entries), summary@%p (%zu entries), cpu cache@%p (%zu cpu caches)",
         pmm_state.bitmap, pmm_state.bitmap_entries, pmm_state.summary_bitmap,
@@ -858,53 +1979,216 @@ void PhysicalManager::init() {
 
     // Initially mark all pages as used; we will then free only the
     // ranges that Limine reports as usable. This ensures we never
-    // accidentally treat "unknown" memory as allocatable.
+    // accidentally treat "unknown" memory as allocatable. Deferred slices
+    // stay all used until their turn comes.
     memset(pmm_state.bitmap, 0xFF, bitmap_bytes);
-    memset(pmm_state.summary_bitmap, 0xFF, summary_bytes);
-    pmm_state.used_pages = pmm_state.total_pages;
 
-    if (pmm_state.total_pages > pmm_state.low_mem_threshold_idx) {
-        pmm_state.free_idx_hint = pmm_state.low_mem_threshold_idx;
-    } else {
-        pmm_state.free_idx_hint = 0;
-    }
+    // Populate free memory from Limine map by clearing all usable pages. The
+    // summary, counters and buddy lists are then derived from the bitmap.
+    size_t reclaimed_pages = 0;
+    for_each_usable(0, pmm_state.boot_pages, [&](size_t run_start, size_t run_len) {
+        clear_range(run_start, run_len);
+        reclaimed_pages += run_len;
+    });
 
-    pmm_state.aligned_index_hint = pmm_state.free_idx_hint;
+    // One pass builds the summary and counts used pages. Padding bits past
+    // `total_pages` stay set and must not count as used.
+    size_t set_bits = cpu::arch::BitScan::summarize(pmm_state.bitmap, pmm_state.bitmap_entries,
+                                                    pmm_state.summary_bitmap);
+    size_t pad_bits = (pmm_state.bitmap_entries * bit_count) - pmm_state.total_pages;
 
-    // Populate free memory from Limine map by freeing all usable pages.
-    size_t reclaimed_pages = 0;
-    for (size_t i = 0; i < memmap_count; ++i) {
-        limine_memmap_entry* entry = memmaps[i];
+    pmm_state.used_pages = set_bits - pad_bits;
 
-        if (entry->type == LIMINE_MEMMAP_USABLE) {
-            uintptr_t base = entry->base;
-            size_t len     = entry->length;
+    size_t bitmap_done = hal::Timer::get_cycles();
 
-            if (base == 0) {
-                if (len >= PAGE_SIZE_4K) {
-                    base += PAGE_SIZE_4K;
-                    len -= PAGE_SIZE_4K;
-                } else {
-                    continue;
-                }
-            }
+    rebuild_free_lists();
+    set_watermarks();
 
-            size_t pages = len / PAGE_SIZE_4K;
-            reclaimed_pages += pages;
+    size_t lists_done = hal::Timer::get_cycles();
 
-            if (len > 0) {
-                free(reinterpret_cast<void*>(base), pages);
-            }
-        }
-    }
+    pmm_state.boot_cycles[0] = frames_done - init_start;
+    pmm_state.boot_cycles[1] = bitmap_done - frames_done;
+    pmm_state.boot_cycles[2] = lists_done - bitmap_done;
 
-    // Restore `best_candidate` to original size
-    best_candidate->base -= total_metadata_bytes;
-    best_candidate->length += total_metadata_bytes;
+    cache_shrinker.name  = "pmm-cpu-caches";
+    cache_shrinker.count = shrink_count;
+    cache_shrinker.scan  = shrink_scan;
+    Reclaimer::register_shrinker(cache_shrinker);
 
     PMMStats stats = get_stats();
     LOG_INFO("PMM initialized: total_pages=%zu (~%zu MiB), reclaimed=%zu pages, free=%zu MiB",
              pmm_state.total_pages, (pmm_state.total_pages * PAGE_SIZE_4K) >> 20, reclaimed_pages,
              stats.free_memory >> 20);
+    LOG_INFO("PMM: watermarks min=%zu low=%zu high=%zu pages",
+             pmm_state.watermarks[static_cast<size_t>(Watermark::Min)],
+             pmm_state.watermarks[static_cast<size_t>(Watermark::Low)],
+             pmm_state.watermarks[static_cast<size_t>(Watermark::High)]);
+
+    if (pmm_state.slice_count > 0) {
+        LOG_INFO("PMM: %zu MiB above 4GB deferred to %zu slice(s)",
+                 ((pmm_state.total_pages - pmm_state.boot_pages) * PAGE_SIZE_4K) >> 20,
+                 pmm_state.slice_count);
+    }
+}
+
+void PhysicalManager::init_numa() {
+    LockGuard guard(pmm_state.lock);
+
+    // Hand every cached page back so the rebuilt lists see all free memory.
+    // Only the BSP runs here, so nothing else touches the magazines.
+    for (size_t i = 0; i < pmm_state.num_cpus; ++i) {
+        magazine_drain(*pmm_state.cpus[i].loaded);
+        magazine_drain(*pmm_state.cpus[i].previous);
+    }
+
+    depot_drain();
+
+    // Drop the boot-time free lists and rediscover free runs from the
+    // bitmap, which is authoritative; only the zone layout changes. No
+    // deferred slice is up yet, so that is all boot memory.
+    memset(pmm_state.block_order, no_order, pmm_state.boot_pages);
+    setup_zones();
+    rebuild_free_lists();
+
+    for (size_t i = 0; i < pmm_state.num_cpus; ++i) {
+        uint32_t apic_id       = mp_request.response->cpus[i]->lapic_id;
+        pmm_state.cpus[i].node = hal::Numa::node_of_cpu(apic_id);
+    }
+
+    // Taken once the zones follow the nodes, so the reserve can be spread.
+    // With memory still to come it waits for `finish_deferred`.
+    if (pmm_state.slice_count == 0) {
+        reserve_huge_pool();
+    }
+
+    for (size_t node = 0; node < hal::Numa::node_count(); ++node) {
+        size_t free_pages = 0;
+
+        for (size_t z = 0; z < pmm_state.zone_count; ++z) {
+            if (pmm_state.zones[z].node == node) {
+                free_pages += pmm_state.zones[z].free_pages;
+            }
+        }
+
+        LOG_INFO("PMM: node %zu has %zu MiB free", node, (free_pages * PAGE_SIZE_4K) >> 20);
+    }
+
+    LOG_DEBUG("PMM: %zu zone(s) after NUMA setup", pmm_state.zone_count);
+}
+
+void PhysicalManager::init_slice(size_t slice) {
+    size_t start = slice_start(slice);
+    size_t end   = std::min(start + DEFERRED_SLICE_PAGES, pmm_state.total_pages);
+
+    // The bulk of the work, without the lock: the slice is all used in the
+    // bitmap, so nothing else reads these frames or block orders yet.
+    init_frames(start, end);
+    assign_zones(start, end);
+    memset(&pmm_state.block_order[start], no_order, end - start);
+
+    __atomic_store_n(&pmm_state.slices[slice], SliceReady, __ATOMIC_RELEASE);
+
+    {
+        LockGuard guard(pmm_state.lock);
+
+        // A slice owns whole summary words and buddy blocks, so its free
+        // runs merge only with each other.
+        for_each_usable(start, end, [](size_t run_start, size_t run_len) {
+            clear_range(run_start, run_len);
+            buddy_free_range(run_start, run_len);
+
+            pmm_state.used_pages -= run_len;
+            pmm_state.deferred_pages += run_len;
+        });
+    }
+
+    if (__atomic_sub_fetch(&pmm_state.slices_left, 1, __ATOMIC_ACQ_REL) == 0) {
+        finish_deferred();
+    }
+}
+
+bool PhysicalManager::grow_deferred(uint32_t node) {
+    // Slices only come up after `init_numa` (see `init_deferred`).
+    if ((__atomic_load_n(&pmm_state.deferred_start, __ATOMIC_ACQUIRE) == 0) ||
+        (__atomic_load_n(&pmm_state.slices_left, __ATOMIC_ACQUIRE) == 0)) {
+        return false;
+    }
+
+    size_t slice = claim_slice(node);
+
+    if (slice != no_page) {
+        init_slice(slice);
+        return true;
+    }
+
+    // Every slice is taken: wait for one of them to land instead of failing.
+    size_t left = __atomic_load_n(&pmm_state.slices_left, __ATOMIC_ACQUIRE);
+
+    while ((left > 0) && (__atomic_load_n(&pmm_state.slices_left, __ATOMIC_ACQUIRE) == left)) {
+        arch::pause();
+    }
+
+    return left > 0;
+}
+
+void PhysicalManager::finish_deferred() {
+    size_t cycles = hal::Timer::get_cycles() - pmm_state.deferred_start;
+
+    {
+        LockGuard guard(pmm_state.lock);
+
+        // Both were sized for boot memory alone.
+        set_watermarks();
+        reserve_huge_pool();
+    }
+
+    LOG_INFO("PMM: deferred init added %zu MiB on %u core(s) in %zu us",
+             (pmm_state.deferred_pages * PAGE_SIZE_4K) >> 20,
+             __atomic_load_n(&pmm_state.deferred_cores, __ATOMIC_RELAXED),
+             hal::Timer::cycles_to_ns(cycles) / 1000);
+    LOG_INFO("PMM: watermarks min=%zu low=%zu high=%zu pages",
+             pmm_state.watermarks[static_cast<size_t>(Watermark::Min)],
+             pmm_state.watermarks[static_cast<size_t>(Watermark::Low)],
+             pmm_state.watermarks[static_cast<size_t>(Watermark::High)]);
+}
+
+void PhysicalManager::init_deferred() {
+    cpu::preempt_disable();
+
+    cpu::PerCpuData* core = cpu::CpuCoreManager::get().get_current_core();
+    size_t start          = hal::Timer::get_cycles();
+    size_t unset          = 0;
+
+    __atomic_compare_exchange_n(&pmm_state.deferred_start, &unset, start, false, __ATOMIC_RELEASE,
+                                __ATOMIC_RELAXED);
+
+    // `init` ran before any time source was calibrated; report it now.
+    if (core->is_bsp) {
+        const size_t* phases = pmm_state.boot_cycles;
+
+        LOG_INFO("PMM: boot init took %zu us (frame db %zu us, bitmap %zu us, free lists %zu us)",
+                 hal::Timer::cycles_to_ns(phases[0] + phases[1] + phases[2]) / 1000,
+                 hal::Timer::cycles_to_ns(phases[0]) / 1000,
+                 hal::Timer::cycles_to_ns(phases[1]) / 1000,
+                 hal::Timer::cycles_to_ns(phases[2]) / 1000);
+    }
+
+    uint32_t node = local_node();
+    size_t done   = 0;
+
+    for (size_t slice = claim_slice(node); slice != no_page; slice = claim_slice(node)) {
+        if (done++ == 0) {
+            __atomic_fetch_add(&pmm_state.deferred_cores, 1, __ATOMIC_RELAXED);
+        }
+
+        init_slice(slice);
+    }
+
+    if (done > 0) {
+        LOG_DEBUG("PMM: core %u set up %zu deferred slice(s) in %zu us", core->core_idx, done,
+                  hal::Timer::cycles_to_ns(hal::Timer::get_cycles() - start) / 1000);
+    }
+
+    cpu::preempt_enable();
 }
 }  // namespace kernel::memory
\ No newline at end of file
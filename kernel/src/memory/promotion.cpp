@@ -0,0 +1,112 @@
+#include "memory/promotion.hpp"
+#include "hal/smp_manager.hpp"
+#include "libs/log.hpp"
+#include "libs/math.hpp"
+#include "memory/memory.hpp"
+#include "memory/pmm.hpp"
+#include "memory/user_address_space.hpp"
+#include "task/process.hpp"
+#include "task/scheduler.hpp"
+
+namespace kernel::memory {
+namespace {
+// The thread wakes every PROMOTE_INTERVAL_MS and collapses up to
+// PROMOTE_BATCH ranges, while more than PROMOTE_MIN_FREE free 2MB blocks are
+// left; below that the blocks are worth more to the compactor's callers.
+constexpr size_t PROMOTE_INTERVAL_MS = 2000;
+constexpr size_t PROMOTE_BATCH       = 16;
+constexpr size_t PROMOTE_MIN_FREE    = 64;
+
+PromotionStats promote_stats;
+}  // namespace
+
+size_t Promoter::scan(UserAddressSpace& space, size_t budget) {
+    size_t promoted = 0;
+
+    // Faults on the range wait for us while it's being collapsed.
+    LockGuard guard(space.mutex);
+
+    UserVmRegion* region = space.root;
+
+    while (region && region->left) {
+        region = region->left;
+    }
+
+    for (; region && (promoted < budget); region = space.successor(region)) {
+        if (region->page_size != PageSize::Size4K) {
+            continue;
+        }
+
+        uintptr_t start = align_up(region->start, PAGE_SIZE_2M);
+
+        for (uintptr_t virt = start; (virt + PAGE_SIZE_2M) <= region->end(); virt += PAGE_SIZE_2M) {
+            if (promoted == budget) {
+                break;
+            }
+
+            promote_stats.ranges_scanned++;
+
+            // Already huge, or not even the first page populated yet
+            if (space.page_map->leaf_size(virt) != PAGE_SIZE_4K) {
+                continue;
+            }
+
+            // An aligned run of frames needs no copy; check before it's gone
+            uintptr_t first = space.page_map->translate(virt);
+
+            if (!space.page_map->collapse(virt, true)) {
+                continue;
+            }
+
+            if (space.page_map->translate(virt) != first) {
+                promote_stats.copied++;
+            }
+
+            promote_stats.promoted++;
+            promoted++;
+        }
+    }
+
+    return promoted;
+}
+
+PromotionStats Promoter::get_stats() {
+    return promote_stats;
+}
+
+void Promoter::worker(void*) {
+    while (true) {
+        task::Scheduler::get().sleep(PROMOTE_INTERVAL_MS);
+
+        if (PhysicalManager::free_huge_blocks() <= PROMOTE_MIN_FREE) {
+            continue;
+        }
+
+        UserAddressSpace::Registry& registry = UserAddressSpace::registry();
+        LockGuard guard(registry.lock);
+
+        size_t budget = PROMOTE_BATCH;
+
+        for (UserAddressSpace& space : registry.spaces) {
+            budget -= scan(space, budget);
+
+            if (budget == 0) {
+                break;
+            }
+        }
+
+        promote_stats.passes++;
+
+        if (budget < PROMOTE_BATCH) {
+            LOG_DEBUG("Promoter: collapsed %zu ranges into 2MB pages", PROMOTE_BATCH - budget);
+        }
+    }
+}
+
+void Promoter::start() {
+    task::Thread* thread = new task::Thread(task::Process::kernel_proc, worker, nullptr);
+    cpu::CpuCoreManager::get().get_current_core()->sched.add_thread(thread);
+
+    LOG_INFO("Promoter: started (above %zu free 2MB blocks)", PROMOTE_MIN_FREE);
+}
+}  // namespace kernel::memory
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "memory/reclaim.hpp"
+#include "arch.hpp"
+#include "hal/smp_manager.hpp"
+#include "libs/log.hpp"
+#include "memory/pmm.hpp"
+#include "task/process.hpp"
+#include "task/scheduler.hpp"
+
+namespace kernel::memory {
+namespace {
+// After a pass that freed nothing the thread waits this long before it can
+// be woken again, so allocations at the watermark don't keep it spinning.
+constexpr size_t RECLAIM_BACKOFF_MS = 100;
+
+struct {
+    task::Thread* thread = nullptr;
+    bool wanted          = false;  // Set by `wake`, consumed by `pending_wakeup`
+
+    ReclaimStats stats = {};
+} reclaim_state;
+
+// Before GS is loaded only the BSP runs, so one flag stands in for it
+bool boot_in_reclaim = false;
+
+// Marks the calling CPU as running shrinkers while it lives, with
+// preemption off so the mark stays with the CPU that set it. `entered` is
+// false if the CPU was in reclaim already, i.e. a shrinker allocated.
+class ReclaimGuard {
+   public:
+    ReclaimGuard() {
+        if (cpu::percpu_available) {
+            cpu::preempt_disable();
+            this->flag = &cpu::CpuCoreManager::get().get_current_core()->in_reclaim;
+        }
+
+        this->entered = !*this->flag;
+        *this->flag   = true;
+    }
+
+    ~ReclaimGuard() {
+        if (this->entered) {
+            *this->flag = false;
+        }
+
+        if (cpu::percpu_available) {
+            cpu::preempt_enable();
+        }
+    }
+
+    bool entered = false;
+
+   private:
+    bool* flag = &boot_in_reclaim;
+};
+}  // namespace
+
+Reclaimer::Registry& Reclaimer::registry() {
+    static Registry registry;
+    return registry;
+}
+
+void Reclaimer::register_shrinker(Shrinker& shrinker) {
+    LockGuard guard(registry().lock);
+    registry().shrinkers.push_back(shrinker);
+}
+
+void Reclaimer::unregister_shrinker(Shrinker& shrinker) {
+    LockGuard guard(registry().lock);
+    registry().shrinkers.remove(shrinker);
+}
+
+size_t Reclaimer::shrink(size_t nr_pages, bool may_wait) {
+    Registry& reg = registry();
+    ReclaimGuard guard;
+
+    // Reached from an allocation a shrinker made: running them again would
+    // take the locks they already hold.
+    if (!guard.entered) {
+        return 0;
+    }
+
+    // A caller that can't take IPIs must not spin here: the holder may be
+    // waiting for that very CPU to answer one (see the PMM shrinker).
+    if (may_wait) {
+        reg.lock.lock();
+    } else if (!reg.lock.try_lock()) {
+        return 0;
+    }
+
+    size_t freed = 0;
+
+    for (Shrinker& shrinker : reg.shrinkers) {
+        if (freed >= nr_pages) {
+            break;
+        }
+
+        // The caller may hold an IrqLock the heap's paths also take
+        if (!may_wait && shrinker.reenters_heap) {
+            continue;
+        }
+
+        if (shrinker.count(shrinker.ctx) == 0) {
+            continue;
+        }
+
+        freed += shrinker.scan(shrinker.ctx, nr_pages - freed);
+    }
+
+    reg.lock.unlock();
+
+    __atomic_fetch_add(&reclaim_state.stats.pages_reclaimed, freed, __ATOMIC_RELAXED);
+    return freed;
+}
+
+size_t Reclaimer::direct_reclaim(size_t nr_pages) {
+    __atomic_fetch_add(&reclaim_state.stats.direct_reclaims, 1, __ATOMIC_RELAXED);
+    return shrink(nr_pages, arch::interrupt_status());
+}
+
+void Reclaimer::wake() {
+    if (!__atomic_load_n(&reclaim_state.wanted, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&reclaim_state.wanted, true, __ATOMIC_RELEASE);
+    }
+}
+
+task::Thread* Reclaimer::pending_wakeup(uint32_t cpu_id) {
+    task::Thread* thread = reclaim_state.thread;
+
+    // Only the thread's own core wakes it, and only once it has blocked;
+    // the request stays pending until then.
+    if ((thread == nullptr) || (thread->cpu->core_idx != cpu_id) ||
+        (thread->state != task::ThreadState::Blocked)) {
+        return nullptr;
+    }
+
+    if (!__atomic_exchange_n(&reclaim_state.wanted, false, __ATOMIC_ACQ_REL)) {
+        return nullptr;
+    }
+
+    return thread;
+}
+
+ReclaimStats Reclaimer::get_stats() {
+    return reclaim_state.stats;
+}
+
+void Reclaimer::worker(void*) {
+    while (true) {
+        task::Scheduler::get().block();
+        __atomic_fetch_add(&reclaim_state.stats.kswapd_wakeups, 1, __ATOMIC_RELAXED);
+
+        while (size_t deficit = PhysicalManager::watermark_deficit(Watermark::High)) {
+            if (shrink(deficit, true) == 0) {
+                task::Scheduler::get().sleep(RECLAIM_BACKOFF_MS);
+                break;
+            }
+        }
+    }
+}
+
+void Reclaimer::start() {
+    task::Thread* thread = new task::Thread(task::Process::kernel_proc, worker, nullptr);
+    cpu::CpuCoreManager::get().get_current_core()->sched.add_thread(thread);
+
+    reclaim_state.thread = thread;
+
+    LOG_INFO("Reclaimer: started");
+}
+}  // namespace kernel::memory
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "memory/tlb_gather.hpp"
+#include "memory/pagemap.hpp"
+#include "memory/pmm.hpp"
+
+namespace kernel::memory {
+namespace {
+// Kind of a gathered frame, kept in the low bits of its (page aligned) address
+constexpr uintptr_t KIND_PAGE        = 0;
+constexpr uintptr_t KIND_HUGE_2M     = 1;
+constexpr uintptr_t KIND_HUGE_1G     = 2;
+constexpr uintptr_t KIND_CLEAN_TABLE = 3;
+constexpr uintptr_t KIND_MASK        = PAGE_SIZE_4K - 1;
+}  // namespace
+
+TlbGather::~TlbGather() {
+    this->finish();
+}
+
+void TlbGather::add_range(uintptr_t virt_addr, size_t size) {
+    uintptr_t start = virt_addr & ~(size - 1);
+    uintptr_t end   = start + size;
+
+    if (this->range_start == this->range_end) {
+        this->range_start = start;
+        this->range_end   = end;
+        return;
+    }
+
+    // One covering range; `flush_tlb` turns a wide one into a context flush
+    if (start < this->range_start) {
+        this->range_start = start;
+    }
+
+    if (end > this->range_end) {
+        this->range_end = end;
+    }
+}
+
+void TlbGather::add_frame(uintptr_t phys, PageSize size) {
+    switch (size) {
+        case PageSize::Size4K:
+            this->add_entry(phys | KIND_PAGE);
+            break;
+        case PageSize::Size2M:
+            this->add_entry(phys | KIND_HUGE_2M);
+            break;
+        case PageSize::Size1G:
+            this->add_entry(phys | KIND_HUGE_1G);
+            break;
+    }
+}
+
+void TlbGather::add_table(uintptr_t phys, bool clean) {
+    this->add_entry(phys | (clean ? KIND_CLEAN_TABLE : KIND_PAGE));
+}
+
+void TlbGather::add_entry(uintptr_t entry) {
+    if (this->local_count < LOCAL_ENTRIES) {
+        this->local[this->local_count++] = entry;
+        return;
+    }
+
+    Batch* batch = this->batches;
+
+    if (!batch || (batch->count == sizeof(batch->entries) / sizeof(batch->entries[0]))) {
+        batch = static_cast<Batch*>(PhysicalManager::alloc());
+
+        if (!batch) {
+            // No page to grow into; pay for an early flush instead
+            this->finish();
+            this->local[this->local_count++] = entry;
+            return;
+        }
+
+        batch        = to_higher_half(batch);
+        batch->next  = this->batches;
+        batch->count = 0;
+
+        this->batches = batch;
+    }
+
+    batch->entries[batch->count++] = entry;
+}
+
+void TlbGather::release(uintptr_t* entries, size_t count) {
+    size_t pages = 0;
+
+    // Plain pages are compacted to the front and put in one go. Frames only
+    // go back to the PMM once their last reference is dropped.
+    for (size_t i = 0; i < count; ++i) {
+        uintptr_t kind  = entries[i] & KIND_MASK;
+        uintptr_t frame = entries[i] & ~KIND_MASK;
+
+        switch (kind) {
+            case KIND_PAGE:
+                entries[pages++] = frame;
+                break;
+            case KIND_HUGE_2M:
+            case KIND_HUGE_1G:
+                PhysicalManager::put_frame(frame);
+                break;
+            case KIND_CLEAN_TABLE:
+                PhysicalManager::free_clean(reinterpret_cast<void*>(frame));
+                break;
+        }
+    }
+
+    PhysicalManager::put_batch(entries, pages);
+}
+
+void TlbGather::finish() {
+    if (this->range_end > this->range_start) {
+        this->map->flush_tlb(this->range_start,
+                             (this->range_end - this->range_start) / PAGE_SIZE_4K);
+    }
+
+    this->range_start = 0;
+    this->range_end   = 0;
+
+    release(this->local, this->local_count);
+    this->local_count = 0;
+
+    while (Batch* batch = this->batches) {
+        this->batches = batch->next;
+
+        release(batch->entries, batch->count);
+        PhysicalManager::free(reinterpret_cast<void*>(from_higher_half(batch)));
+    }
+}
+}  // namespace kernel::memory
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "memory/memory.hpp"
 #include "memory/pagemap.hpp"
 #include "memory/pcid_manager.hpp"
+#include "memory/tlb_gather.hpp"
 #include "memory/user_address_space.hpp"
 #include "libs/math.hpp"
 #include "task/process.hpp"
@@ -42,27 +43,49 @@ void UserVmRegionAllocator::refill() {
     }
 }
 
+UserAddressSpace::Registry& UserAddressSpace::registry() {
+    static Registry registry;
+    return registry;
+}
+
 void UserAddressSpace::init(task::Process* proc) {
     this->page_map      = proc->map;
     this->root          = nullptr;
     this->cached_cursor = nullptr;
+
+    LockGuard guard(registry().lock);
+    registry().spaces.push_back(*this);
 }
 
 UserAddressSpace::~UserAddressSpace() {
+    {
+        // Unlisted first: the compactor holds the registry lock while it
+        // walks a space, so it is done with this one once we get the lock.
+        LockGuard guard(registry().lock);
+        registry().spaces.remove(*this);
+    }
+
     LockGuard guard(this->mutex);
 
-    this->free_tree(this->root);
+    // Tear down every mapping left with a single flush at the end
+    TlbGather gather(this->page_map);
+
+    this->free_tree(this->root, gather);
     this->root          = nullptr;
     this->cached_cursor = nullptr;
+
+    gather.finish();
 }
 
-void UserAddressSpace::free_tree(UserVmRegion* node) {
+void UserAddressSpace::free_tree(UserVmRegion* node, TlbGather& gather) {
     if (!node) {
         return;
     }
 
-    this->free_tree(node->left);
-    this->free_tree(node->right);
+    this->free_tree(node->left, gather);
+    this->free_tree(node->right, gather);
+
+    this->page_map->unmap_range(node->start, node->size, gather, true);
     this->metadata_allocator.deallocate(node);
 }
 
@@ -94,7 +117,7 @@ void* UserAddressSpace::allocate(size_t size, uint8_t flags, PageSize type) {
     this->insert_region(virt_addr, size, flags, CacheType::WriteBack, type);
 
     if (!(flags & Lazy)) {
-        if (!this->populate(virt_addr, size, flags, CacheType::WriteBack)) {
+        if (!this->populate(virt_addr, size, flags, CacheType::WriteBack, type)) {
             UserVmRegion* node = this->find_region_containing(virt_addr);
 
             if (node) {
@@ -139,7 +162,7 @@ bool UserAddressSpace::allocate_specific(uintptr_t virt_addr, size_t size, uint8
     this->insert_region(virt_addr, size, flags, CacheType::WriteBack, type);
 
     if (!(flags & Lazy)) {
-        if (!this->populate(virt_addr, size, flags, CacheType::WriteBack)) {
+        if (!this->populate(virt_addr, size, flags, CacheType::WriteBack, type)) {
             UserVmRegion* node = this->find_region_containing(virt_addr);
 
             if (node) {
@@ -162,10 +185,11 @@ void UserAddressSpace::free(void* ptr) {
 
     // Only free if we found the exact starting address
     if (node && node->start == virt_addr) {
-        // Unmap physical frames and flush TLB
-        uint16_t pcid = PcidManager::get().get_pcid(this->process);
+        // Unmap physical frames, then flush the TLB once for the region
+        TlbGather gather(this->page_map);
+        this->page_map->unmap_range(node->start, node->size, gather, true);
+        gather.finish();
 
-        this->page_map->unmap(node->start, pcid, true);
         this->delete_node(node);
     }
 }
@@ -662,36 +686,11 @@ void UserAddressSpace::delete_fixup(UserVmRegion* x) {
     }
 }
 
-bool UserAddressSpace::populate(uintptr_t start, size_t size, uint8_t flags, CacheType cache) {
-    uintptr_t curr = start;
-    uintptr_t end  = start + size;
-
-    while (curr < end) {
-        size_t remaining = end - curr;
-
-        if (!this->page_map->translate(curr)) {
-            if ((remaining >= PAGE_SIZE_1G) && (curr % PAGE_SIZE_1G == 0)) {
-                if (!this->page_map->map(curr, flags, cache, PageSize::Size1G)) {
-                    return false;
-                }
-
-                curr += PAGE_SIZE_1G;
-            } else if ((remaining >= PAGE_SIZE_2M) && (curr % PAGE_SIZE_2M == 0)) {
-                if (!this->page_map->map(curr, flags, cache, PageSize::Size2M)) {
-                    return false;
-                }
-
-                curr += PAGE_SIZE_2M;
-            } else {
-                if (!this->page_map->map(curr, flags, cache, PageSize::Size4K)) {
-                    return false;
-                }
-
-                curr += PAGE_SIZE_4K;
-            }
-        }
-    }
-
-    return true;
+bool UserAddressSpace::populate(uintptr_t start, size_t size, uint8_t flags, CacheType cache,
+                                PageSize type) {
+    // Already-mapped pages are kept; the holes get fresh frames. Only a
+    // region that asked for huge pages gets them, and from the reserve.
+    return this->page_map->populate_range(start, size, flags, cache, type,
+                                          type != PageSize::Size4K);
 }
 }  // namespace kernel::memory
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "memory/vma.hpp"
 #include "boot/boot.h"
 #include "memory/pmm.hpp"
+#include "memory/tlb_gather.hpp"
+#include "libs/log.hpp"
 #include "libs/math.hpp"
 #include "hal/smp_manager.hpp"
 
@@ -139,12 +141,20 @@ void VirtualMemoryAllocator::free(void* ptr, bool free_phys) {
     }
 
     size_t size = node->size;
-
-    this->delete_node_locked(node);
     this->lock.unlock();
 
+    // Unmap and flush before the range goes back to the tree, so whoever
+    // gets it next can't meet our stale translations.
     this->unmap(virt_addr, size, free_phys);
 
+    this->lock.lock();
+
+    if ((node = this->find_node(virt_addr))) {
+        this->delete_node_locked(node);
+    }
+
+    this->lock.unlock();
+
     if (free_phys && size == PAGE_SIZE_4K) {
         uint32_t cpu   = 0;
         auto& core_mgr = cpu::CpuCoreManager::get();
@@ -167,49 +177,76 @@ void VirtualMemoryAllocator::free(void* ptr, bool free_phys) {
     }
 }
 
-void VirtualMemoryAllocator::map(uintptr_t virt_addr, size_t size, uint8_t flags, CacheType cache) {
-    auto* kmap = PageMap::get_kernel_map();
+bool VirtualMemoryAllocator::grow(void* ptr, size_t size) {
+    uintptr_t virt_addr = reinterpret_cast<uintptr_t>(ptr);
 
-    uintptr_t curr = virt_addr;
-    uintptr_t end  = virt_addr + size;
+    this->lock.lock();
+    VmRegion* node = this->find_node(virt_addr);
 
-    while (curr < end) {
-        size_t remaining = end - curr;
+    if (!node) {
+        this->lock.unlock();
+        return false;
+    }
 
-        if ((remaining >= PAGE_SIZE_1G) && (curr % PAGE_SIZE_1G == 0)) {
-            kmap->map(curr, flags, cache, PageSize::Size1G);
-            curr += PAGE_SIZE_1G;
-        } else if ((remaining >= PAGE_SIZE_2M) && (curr % PAGE_SIZE_2M == 0)) {
-            kmap->map(curr, flags, cache, PageSize::Size2M);
-            curr += PAGE_SIZE_2M;
-        } else {
-            kmap->map(curr, flags, cache, PageSize::Size4K);
-            curr += PAGE_SIZE_4K;
-        }
+    if (size <= node->size) {
+        this->lock.unlock();
+        return true;
     }
-}
 
-void VirtualMemoryAllocator::unmap(uintptr_t virt_addr, size_t size, bool free_phys) {
-    auto* kmap = PageMap::get_kernel_map();
+    size_t extra = size - node->size;
 
-    uintptr_t curr = virt_addr;
-    uintptr_t end  = virt_addr + size;
+    if (node->gap < extra) {
+        this->lock.unlock();
+        return false;
+    }
+
+    uintptr_t old_end = node->end();
+    uint8_t flags     = node->flags;
+    CacheType cache   = node->cache;
+
+    node->size += extra;
+    node->gap -= extra;
+    this->update_path_to_root(node);
+
+    // Freed single pages wait in the per-CPU caches without a node in the
+    // tree, so the gap we just took may still hold some of them.
+    for (size_t i = 0; i < this->cpu_count; ++i) {
+        CpuCache& cpu_cache = this->caches[i];
+        LockGuard guard(cpu_cache.lock);
 
-    while (curr < end) {
-        uintptr_t remaining = end - curr;
-        size_t step         = PAGE_SIZE_4K;
+        for (int j = 0; j < cpu_cache.count;) {
+            uintptr_t hole = cpu_cache.va_holes[j];
 
-        if ((curr % PAGE_SIZE_1G == 0) && (remaining >= PAGE_SIZE_1G)) {
-            step = PAGE_SIZE_1G;
-        } else if ((curr % PAGE_SIZE_2M == 0) && (remaining >= PAGE_SIZE_2M)) {
-            step = PAGE_SIZE_2M;
+            if ((hole >= old_end) && (hole < (old_end + extra))) {
+                cpu_cache.va_holes[j] = cpu_cache.va_holes[--cpu_cache.count];
+            } else {
+                j++;
+            }
         }
+    }
+
+    this->lock.unlock();
 
-        kmap->unmap(curr, 0, free_phys);
-        curr += step;
+    this->map(old_end, extra, flags, cache);
+    return true;
+}
+
+void VirtualMemoryAllocator::map(uintptr_t virt_addr, size_t size, uint8_t flags, CacheType cache) {
+    auto* kmap = PageMap::get_kernel_map();
+
+    if (!kmap->populate_range(virt_addr, size, flags, cache)) {
+        LOG_ERROR("VMA: failed to back 0x%lx (%zu bytes)", virt_addr, size);
     }
 }
 
+void VirtualMemoryAllocator::unmap(uintptr_t virt_addr, size_t size, bool free_phys) {
+    auto* kmap = PageMap::get_kernel_map();
+
+    // One flush for the whole region, then the frames go back in a batch
+    TlbGather gather(kmap);
+    kmap->unmap_range(virt_addr, size, gather, free_phys);
+}
+
 VmRegion* VirtualMemoryAllocator::find_node(uintptr_t start) {
     VmRegion* curr = this->root;
 
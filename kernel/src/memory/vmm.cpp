@@ -205,6 +205,10 @@ void VirtualManager::free(void* ptr, bool free_phys) {
     vma.free(ptr, free_phys);
 }
 
+bool VirtualManager::grow(void* ptr, size_t count) {
+    return vma.grow(ptr, count * PAGE_SIZE_4K);
+}
+
 void* VirtualManager::reserve_mmio(size_t size, size_t align) {
     return vma.reserve(size, align, 0);
 }
@@ -213,23 +217,27 @@ ScopedAddressSpaceSwitch::ScopedAddressSpaceSwitch(task::Process* proc) {
     cpu::CpuCoreManager& manager = cpu::CpuCoreManager::get();
     cpu::PerCpuData* cpu         = manager.get_current_core();
 
-    task::Process* curr = cpu->curr_thread->owner;
-    this->old_map       = curr->map;
-    this->old_pcid      = cpu->pcid_manager->get_pcid(curr);
+    // A kernel thread may be running on a borrowed user address space
+    this->old_proc = cpu->active_proc ? cpu->active_proc : task::Process::kernel_proc;
+    this->old_map  = this->old_proc->map;
+    this->old_pcid = cpu->pcid_manager->get_pcid(this->old_proc);
 
     PageMap* new_map = proc->map;
     uint16_t pcid    = cpu->pcid_manager->get_pcid(proc);
 
     if (this->old_map != new_map) {
-        new_map->load(pcid);
+        new_map->activate(this->old_map, pcid, true);
+        cpu->active_proc = proc;
     }
 }
 
 ScopedAddressSpaceSwitch::~ScopedAddressSpaceSwitch() {
-    PageMap* curr_map = VirtualManager::curr_map();
+    cpu::PerCpuData* cpu = cpu::CpuCoreManager::get().get_current_core();
+    PageMap* curr_map    = VirtualManager::curr_map();
 
     if (curr_map != old_map) {
-        old_map->load(this->old_pcid);
+        old_map->activate(curr_map, this->old_pcid, true);
+        cpu->active_proc = this->old_proc;
     }
 }
 }  // namespace kernel::memory
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "task/process.hpp"
 #include "boot/boot.h"
+#include "arch.hpp"
+#include "hal/smp_manager.hpp"
 #include "memory/memory.hpp"
 #include "memory/pagemap.hpp"
 #include "memory/vma.hpp"
@@ -12,6 +14,26 @@ namespace kernel::task {
 Process* Process::kernel_proc         = nullptr;
 std::atomic<size_t> Process::next_pid = 0;
 
+namespace {
+// Put the calling core back on the kernel's map if `arg`, a dying process,
+// is the one it has loaded, so `active_proc` never outlives its process.
+void leave_address_space(void* arg) {
+    Process* proc        = static_cast<Process*>(arg);
+    Process* kproc       = Process::kernel_proc;
+    cpu::PerCpuData* cpu = cpu::CpuCoreManager::get().get_current_core();
+
+    if (cpu->active_proc != proc) {
+        return;
+    }
+
+    uint16_t pcid    = cpu->pcid_manager->get_pcid(kproc);
+    bool needs_flush = (kproc->pcid_cache[cpu->core_idx] == static_cast<uint16_t>(-1));
+
+    kproc->map->activate(proc->map, pcid, needs_flush);
+    cpu->active_proc = kproc;
+}
+}  // namespace
+
 Thread::Thread(Process* proc, void (*callback)(void*), void* args) {
     if (proc == nullptr) {
         PANIC("Task: Thread's parent process not present!");
@@ -78,6 +100,23 @@ Process::Process() {
 }
 
 Process::~Process() {
+    // Before its PCIDs and map go: no core may keep running on them, or
+    // switch back from them through a dangling `active_proc`. Waiting for
+    // the other cores' answers needs interrupts on here; skipping them
+    // would leave those cores on freed memory.
+    if (cpu::CpuCoreManager::get().initialized() && !arch::interrupt_status()) {
+        PANIC("Task: process %zu destroyed with interrupts disabled", this->pid);
+    }
+
+    cpu::preempt_disable();
+    leave_address_space(this);
+
+    if (cpu::CpuCoreManager::get().initialized()) {
+        cpu::CpuCoreManager::call_on_others(leave_address_space, this);
+    }
+
+    cpu::preempt_enable();
+
     if (this->pcid_cache) {
         for (size_t i = 0; i < mp_request.response->cpu_count; ++i) {
             uint16_t id = this->pcid_cache[i];
@@ -85,9 +124,9 @@ Process::~Process() {
             if ((id > 0) && id != static_cast<uint16_t>(-1)) {
                 memory::PcidManager::get().free_pcid(id);
             }
-
-            delete[] this->pcid_cache;
         }
+
+        delete[] this->pcid_cache;
     }
 
     while (!this->children.empty()) {
@@ -130,7 +169,7 @@ void* Process::mmap(void* addr, size_t len, int prot, int flags) {
     }
 
     if (flags & MAP_POPULATE) {
-        flags &= ~memory::Lazy;
+        flag &= static_cast<uint8_t>(~memory::Lazy);
     }
 
     size_t aligned_size = align_up(len, page_size);
@@ -177,21 +216,48 @@ int Process::mprotect(void* addr, size_t len, int prot) {
         flags |= memory::Execute;
     }
 
-    uintptr_t curr_virt  = virt_start;
-    uintptr_t virt_end   = virt_start + aligned_len;
-    uint16_t active_pcid = memory::PcidManager::get().get_pcid(this);
+    uintptr_t curr_virt = virt_start;
+    uintptr_t virt_end  = virt_start + aligned_len;
+    int ret             = 0;
+
+    // Keep the promoter from collapsing a table we're splitting or rewriting
+    LockGuard guard(this->vma.mutex);
 
-    // TODO: Implement shatter page in PageMap
     while (curr_virt < virt_end) {
-        size_t chunk_size = this->map->set_page_flags(curr_virt, flags, cache, active_pcid);
+        size_t leaf = this->map->leaf_size(curr_virt);
+
+        // Shatter a huge page the range only covers part of, so the rest of
+        // it keeps its protection
+        while ((leaf > memory::PAGE_SIZE_4K) &&
+               (!is_aligned(curr_virt, leaf) || ((virt_end - curr_virt) < leaf))) {
+            if (!this->map->split(curr_virt)) {
+                leaf = 0;
+                break;
+            }
+
+            leaf = this->map->leaf_size(curr_virt);
+        }
+
+        size_t chunk_size = 0;
+
+        if (leaf != 0) {
+            chunk_size = this->map->set_page_flags(curr_virt, flags, cache, false);
+        }
 
         if (chunk_size == 0) {
-            return -1;
+            ret = -1;
+            break;
         }
 
         curr_virt += chunk_size;
     }
 
-    return 0;
+    // One shootdown for the whole range; whatever changed before a failure
+    // must be flushed as well.
+    if (curr_virt > virt_start) {
+        this->map->flush_tlb(virt_start, (curr_virt - virt_start) / memory::PAGE_SIZE_4K);
+    }
+
+    return ret;
 }
 }  // namespace kernel::task
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "task/scheduler.hpp"
 #include "hal/smp_manager.hpp"
 #include "hal/timer.hpp"
+#include "memory/reclaim.hpp"
 
 // Low-level context switch routine implemented in architecture-specific assembly.
 extern "C" void context_switch(kernel::task::Thread* prev, kernel::task::Thread* next);
@@ -53,6 +54,24 @@ void Scheduler::add_thread(Thread* t) {
     }
 }
 
+void Scheduler::switch_address_space(Process* next_proc) {
+    cpu::PerCpuData* cpu = cpu::CpuCoreManager::get().get_core_by_index(this->cpu_id);
+
+    // Switching user -> kernel thread -> same user costs no CR3 write at all
+    if (!next_proc || (next_proc == Process::kernel_proc) || (next_proc == cpu->active_proc)) {
+        return;
+    }
+
+    memory::PcidManager* pcid_manager = cpu->pcid_manager;
+    memory::PageMap* prev_map         = cpu->active_proc ? cpu->active_proc->map : nullptr;
+
+    uint16_t pcid    = pcid_manager->get_pcid(next_proc);
+    bool needs_flush = (next_proc->pcid_cache[cpu->core_idx] == static_cast<uint16_t>(-1));
+
+    next_proc->map->activate(prev_map, pcid, needs_flush);
+    cpu->active_proc = next_proc;
+}
+
 Thread* Scheduler::get_next_thread() {
     // Pick thread from the highest priority none-empty queue
     if (this->active_queues_bitmap != 0) {
@@ -182,21 +201,11 @@ void Scheduler::schedule() {
         return;
     }
 
-    Process* prev_proc = prev ? prev->owner : nullptr;
-    Process* next_proc = next->owner;
-
     // Update CPU bookkeeping
     cpu->curr_thread = next;
     next->state      = Running;
 
-    if ((!prev || prev_proc != next_proc) && next_proc) {
-        memory::PcidManager* pcid_manager = cpu->pcid_manager;
-
-        uint16_t pcid    = pcid_manager->get_pcid(next_proc);
-        bool needs_flush = (next_proc->pcid_cache[cpu->core_idx] == static_cast<uint16_t>(-1));
-
-        next_proc->map->load(pcid, needs_flush);
-    }
+    this->switch_address_space(next->owner);
 
     // Eager Switching
     if (prev && prev->state != Zombie) {
@@ -254,6 +263,17 @@ cpu::IrqStatus Scheduler::tick() {
         }
     }
 
+    // Wake the page reclaimer once the PMM fell below its low watermark.
+    if (Thread* reclaimer = memory::Reclaimer::pending_wakeup(this->cpu_id)) {
+        this->unblock(reclaimer);
+    }
+
+    // Inside a per-CPU critical section; `preempt_enable` picks this up.
+    if (cpu->preempt_count != 0) {
+        cpu->reschedule_needed = true;
+        return cpu::IrqStatus::Handled;
+    }
+
     Thread* curr = cpu->curr_thread;
 
     // If we are Idle and a work just arrived (via wake up above, schedule immediately).
@@ -508,17 +528,7 @@ void Scheduler::terminate() {
     Thread* next = this->get_next_thread();
     lock.unlock();
 
-    Process* prev_proc = curr->owner;
-    Process* next_proc = next->owner;
-
-    if (prev_proc != next_proc && next_proc) {
-        memory::PcidManager* pcid_manager = cpu->pcid_manager;
-
-        uint16_t pcid    = pcid_manager->get_pcid(next_proc);
-        bool needs_flush = (next_proc->pcid_cache[cpu->core_idx] == static_cast<uint16_t>(-1));
-
-        next_proc->map->load(pcid, needs_flush);
-    }
+    this->switch_address_space(next->owner);
 
     cpu->curr_thread = next;
     next->state      = Running;
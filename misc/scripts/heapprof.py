@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Symbolize a kernel heap profile.
+
+Build with PARAM_PROJECT_HEAP_PROFILE on, trigger a dump (syscall 1), save the
+serial log and run:
+
+    heapprof.py build/x64-Debug/noise.elf serial.log [--sort live|peak|allocs]
+
+Every `heapprof: site=...` line of the log becomes one row, with the call site
+resolved to function and source line. Sites that allocate a lot of one size
+are the candidates for a dedicated KmemCache.
+"""
+
+import argparse
+import re
+import shutil
+import subprocess
+import sys
+
+SITE_RE = re.compile(
+    r"heapprof: site=0x([0-9a-fA-F]+) allocs=(\d+) frees=(\d+) live=(\d+) peak=(\d+)"
+)
+BEGIN_RE = re.compile(r"heapprof: begin dropped=(\d+) untracked=(\d+)")
+
+
+def parse_dump(lines):
+    # Only the last dump in the log counts
+    sites = {}
+    header = None
+
+    for line in lines:
+        begin = BEGIN_RE.search(line)
+        if begin:
+            sites = {}
+            header = (int(begin.group(1)), int(begin.group(2)))
+            continue
+
+        match = SITE_RE.search(line)
+        if match:
+            addr = int(match.group(1), 16)
+            sites[addr] = {
+                "allocs": int(match.group(2)),
+                "frees": int(match.group(3)),
+                "live": int(match.group(4)),
+                "peak": int(match.group(5)),
+            }
+
+    return header, sites
+
+
+def find_addr2line(requested):
+    for tool in [requested, "llvm-addr2line", "addr2line"]:
+        if tool and shutil.which(tool):
+            return tool
+
+    sys.exit("[ERROR] Neither llvm-addr2line nor addr2line is on PATH")
+
+
+def symbolize(tool, elf, addrs):
+    if not addrs:
+        return {}
+
+    # A return address points past the call; step back into it
+    query = [f"0x{addr - 1:x}" for addr in addrs]
+    result = subprocess.run(
+        [tool, "-f", "-C", "-e", elf] + query, capture_output=True, text=True, check=True
+    )
+
+    out = result.stdout.splitlines()
+    symbols = {}
+
+    for i, addr in enumerate(addrs):
+        func = out[2 * i] if (2 * i) < len(out) else "??"
+        loc = out[2 * i + 1] if (2 * i + 1) < len(out) else "??:0"
+        symbols[addr] = (func, loc)
+
+    return symbols
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Symbolize a kernel heap profile dump")
+    parser.add_argument("elf", help="kernel image the dump was taken from (noise.elf)")
+    parser.add_argument("log", nargs="?", default="-", help="serial log, '-' for stdin")
+    parser.add_argument("--sort", choices=["live", "peak", "allocs"], default="live")
+    parser.add_argument("--top", type=int, default=0, help="only show the first N sites")
+    parser.add_argument("--addr2line", default=None, help="addr2line binary to use")
+    args = parser.parse_args()
+
+    if args.log == "-":
+        header, sites = parse_dump(sys.stdin)
+    else:
+        with open(args.log, errors="replace") as f:
+            header, sites = parse_dump(f)
+
+    if header is None:
+        sys.exit("[ERROR] No heap profile dump found in the log")
+
+    order = sorted(sites, key=lambda addr: sites[addr][args.sort], reverse=True)
+    if args.top > 0:
+        order = order[: args.top]
+
+    symbols = symbolize(find_addr2line(args.addr2line), args.elf, order)
+
+    print(f"{'live':>12} {'peak':>12} {'allocs':>10} {'frees':>10}  site")
+    for addr in order:
+        s = sites[addr]
+        func, loc = symbols[addr]
+        print(f"{s['live']:>12} {s['peak']:>12} {s['allocs']:>10} {s['frees']:>10}  {func} ({loc})")
+
+    dropped, untracked = header
+    total_live = sum(s["live"] for s in sites.values())
+    print(f"\n{len(sites)} sites, {total_live} bytes live")
+
+    if dropped or untracked:
+        print(f"[WARN] {dropped} allocations not recorded, {untracked} frees of unknown pointers")
+
+
+if __name__ == "__main__":
+    main()
\ No newline at end of file